@@ -7,7 +7,15 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <rg/bounds.h>
+#include <rg/gl_state.h>
+#include <rg/render_queue.h>
+#include <rg/texture_registry.h>
+#include <rg/vertex_packing.h>
 
+#include <cstdint>
+#include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 using namespace std;
@@ -25,98 +33,535 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// GPU side vertex layout of a mesh. The packed formats need the model_packed.vs vertex shader.
+enum class VertexFormat {
+    Full,            // Vertex as is, 56 bytes
+    Packed,          // PackedVertex, 24 bytes
+    PackedQuantized  // QuantizedVertex, 20 bytes
+};
+
+// normal and tangent as 10_10_10_2 snorm, the w of the tangent is the sign of the bitangent
+// (bitangent = cross(normal, tangent) * sign). texture coordinates as half floats.
+struct PackedVertex {
+    glm::vec3 Position;
+    uint32_t  Normal;
+    uint32_t  Tangent;
+    uint16_t  TexCoords[2];
+};
+
+// like PackedVertex, with the position quantized to 16 bits inside the bounds of the mesh.
+// the fourth component only keeps the rest of the vertex 4 byte aligned.
+struct QuantizedVertex {
+    uint16_t  Position[4];
+    uint32_t  Normal;
+    uint32_t  Tangent;
+    uint16_t  TexCoords[2];
+};
+
+static_assert(sizeof(PackedVertex) == 24, "PackedVertex must not be padded");
+static_assert(sizeof(QuantizedVertex) == 20, "QuantizedVertex must not be padded");
+
+// meshes with up to this many vertices are drawn with 16 bit indices
+const size_t MAX_VERTICES_FOR_16BIT_INDICES = 65536;
+
+inline size_t IndexTypeSize(GLenum indexType)
+{
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+}
+
+inline vector<unsigned short> NarrowIndices(const unsigned int *indices, size_t indexCount)
+{
+    return vector<unsigned short>(indices, indices + indexCount);
+}
+
+inline size_t VertexFormatSize(VertexFormat format)
+{
+    switch (format)
+    {
+        case VertexFormat::Packed:          return sizeof(PackedVertex);
+        case VertexFormat::PackedQuantized: return sizeof(QuantizedVertex);
+        default:                            return sizeof(Vertex);
+    }
+}
+
+
+enum class TextureType : unsigned char {
+    Diffuse,
+    Specular,
+    Normal,
+    Height,
+    Count
+};
+
+// every texture type gets its own block of texture units: the Nth texture of a type (the N in
+// texture_diffuseN) is always bound to unit type * SAMPLERS_PER_TEXTURE_TYPE + N - 1. So the sampler
+// uniforms of a program only have to be set once, not for every mesh that is drawn with it.
+const unsigned int SAMPLERS_PER_TEXTURE_TYPE = 4;
+
+// the GLSL name of the type, without the number: texture_diffuse, texture_specular, ...
+inline const char *TextureTypeName(TextureType type)
+{
+    switch (type)
+    {
+        case TextureType::Diffuse:  return "texture_diffuse";
+        case TextureType::Specular: return "texture_specular";
+        case TextureType::Normal:   return "texture_normal";
+        case TextureType::Height:   return "texture_height";
+        default:                    return "";
+    }
+}
 
+inline bool ParseTextureType(const string &name, TextureType &type)
+{
+    for (unsigned int i = 0; i < (unsigned int) TextureType::Count; i++)
+    {
+        if (name == TextureTypeName((TextureType) i))
+        {
+            type = (TextureType) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// sets the sampler uniforms prefix + texture_diffuse1 ... of the program (which has to be in use) to their
+// fixed texture units. Does nothing when the program was already set up for the same prefix.
+inline void AssignSamplerUnits(Shader &shader, const string &prefix)
+{
+    if (shader.samplerUnitsAssigned && shader.samplerUnitsPrefix == prefix)
+        return;
+    for (unsigned int type = 0; type < (unsigned int) TextureType::Count; type++)
+    {
+        for (unsigned int n = 1; n <= SAMPLERS_PER_TEXTURE_TYPE; n++)
+            shader.setInt(prefix + TextureTypeName((TextureType) type) + std::to_string(n),
+                          (int) (type * SAMPLERS_PER_TEXTURE_TYPE + n - 1));
+    }
+    shader.samplerUnitsPrefix = prefix;
+    shader.samplerUnitsAssigned = true;
+}
 
 struct Texture {
     unsigned int id;
-    string type;
+    TextureType type;
     string path;
+    rg::TextureHandle handle; // keeps the shared texture alive while a mesh uses it
+};
+
+// converts vertices into the GPU layout of the format. quantized formats also return the transform
+// that maps the quantized positions back to model space.
+inline void PackVertices(const Vertex *vertexData, size_t vertexCount, VertexFormat format, vector<unsigned char> &out,
+                         glm::vec3 &positionOffset, glm::vec3 &positionScale);
+
+// sets the vertex attribute pointers of a format for the currently bound VAO and GL_ARRAY_BUFFER
+inline void SetupVertexAttributes(VertexFormat format);
+
+// where a mesh lives inside a MeshArena
+struct MeshArenaRange {
+    GLint   baseVertex = 0;
+    size_t  indexOffset = 0;   // in bytes
+    size_t  indexCount = 0;    // 0 when the mesh did not fit
+    GLenum  indexType = GL_UNSIGNED_INT;
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
+};
+
+// one vertex buffer and one index buffer with a single VAO, shared by all meshes of a model.
+// meshes are appended one after another and drawn with glDrawElementsBaseVertex, so their indices stay
+// local to the mesh (which keeps 16 bit indices usable) and the VAO only has to be bound once per model.
+class MeshArena {
+public:
+    unsigned int VAO = 0;
+    unsigned int VBO = 0;
+    unsigned int EBO = 0;
+    VertexFormat format;
+
+    // reserves room for vertexCount vertices and indexBytes bytes of indices (see IndexBytesInArena)
+    MeshArena(size_t vertexCount, size_t indexBytes, VertexFormat format) : format(format)
+    {
+        vertexCapacity = vertexCount;
+        indexCapacity = indexBytes;
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        rg::GLState &state = rg::GLState::Get();
+        state.bindVertexArray(VAO);
+        state.bindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * VertexFormatSize(format), nullptr, GL_STATIC_DRAW);
+        state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, nullptr, GL_STATIC_DRAW);
+        SetupVertexAttributes(format);
+    }
+
+    ~MeshArena()
+    {
+        rg::GLState &state = rg::GLState::Get();
+        state.deleteVertexArray(VAO);
+        state.deleteBuffer(VBO);
+        state.deleteBuffer(EBO);
+    }
+
+    MeshArena(const MeshArena &) = delete;
+    MeshArena &operator=(const MeshArena &) = delete;
+
+    // bytes a mesh takes up in the index buffer; sub-allocations are kept 4 byte aligned
+    static size_t IndexBytesInArena(size_t vertexCount, GLenum indexType, size_t indexCount)
+    {
+        if (indexType == GL_UNSIGNED_INT && vertexCount <= MAX_VERTICES_FOR_16BIT_INDICES)
+            indexType = GL_UNSIGNED_SHORT;
+        return (indexCount * IndexTypeSize(indexType) + 3) & ~size_t(3);
+    }
+
+    // appends a mesh. 32 bit indices are narrowed when the vertex count allows it.
+    MeshArenaRange Upload(const Vertex *vertexData, size_t vertexCount, const void *indexData, GLenum indexType, size_t indexCount)
+    {
+        MeshArenaRange range;
+        vector<unsigned short> narrowed;
+        if (indexType == GL_UNSIGNED_INT && vertexCount <= MAX_VERTICES_FOR_16BIT_INDICES)
+        {
+            narrowed = NarrowIndices(static_cast<const unsigned int*>(indexData), indexCount);
+            indexData = narrowed.data();
+            indexType = GL_UNSIGNED_SHORT;
+        }
+        size_t indexBytes = IndexBytesInArena(vertexCount, indexType, indexCount);
+        if (vertexUsed + vertexCount > vertexCapacity || indexUsed + indexBytes > indexCapacity)
+        {
+            cout << "ERROR::MESH_ARENA::OUT_OF_SPACE" << endl;
+            range.indexType = indexType;
+            return range;
+        }
+        range.baseVertex = vertexUsed;
+        range.indexOffset = indexUsed;
+        range.indexCount = indexCount;
+        range.indexType = indexType;
+
+        size_t vertexSize = VertexFormatSize(format);
+        rg::GLState &state = rg::GLState::Get();
+        state.bindBuffer(GL_ARRAY_BUFFER, VBO);
+        if (format == VertexFormat::Full)
+        {
+            glBufferSubData(GL_ARRAY_BUFFER, vertexUsed * vertexSize, vertexCount * vertexSize, vertexData);
+        }
+        else
+        {
+            vector<unsigned char> packed;
+            PackVertices(vertexData, vertexCount, format, packed, range.positionOffset, range.positionScale);
+            glBufferSubData(GL_ARRAY_BUFFER, vertexUsed * vertexSize, packed.size(), packed.data());
+        }
+        // the element buffer binding is VAO state, so it is bound through the VAO
+        state.bindVertexArray(VAO);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexUsed, indexCount * IndexTypeSize(indexType), indexData);
+
+        vertexUsed += vertexCount;
+        indexUsed += indexBytes;
+        return range;
+    }
+
+private:
+    size_t vertexCapacity = 0;
+    size_t vertexUsed = 0;
+    size_t indexCapacity = 0;
+    size_t indexUsed = 0;
+};
+
+// what a mesh keeps in CPU memory once its data is on the GPU
+enum class MeshCpuCopy {
+    Keep,       // vertices and indices
+    Positions,  // only positions and indices, enough for picking and collision
+    Drop        // nothing, the mesh data only lives on the GPU
 };
 
 class Mesh {
 public:
     // mesh Data
-    vector<Vertex>       vertices;
-    vector<unsigned int> indices;
-    vector<Texture>      textures;
+    vector<Vertex>         vertices;
+    vector<glm::vec3>      positions;   // only filled with MeshCpuCopy::Positions
+    // only one of the index vectors is filled, depending on indexType
+    vector<unsigned int>   indices;
+    vector<unsigned short> indices16;
+    vector<Texture>        textures;
+    // texture unit of every texture, resolved from the types when the mesh is created
+    vector<unsigned char>  textureUnits;
 
     unsigned int VAO;
+    unsigned int indexCount;
+    GLenum indexType;
+    // position of the mesh inside the buffers of its arena
+    GLint baseVertex;
+    size_t indexOffset;
+    VertexFormat format;
+    // maps quantized positions back to model space: position = positionOffset + quantized * positionScale
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    // in model space, computed from the full precision positions when the mesh is created
+    rg::Bounds bounds;
     std::string glslIdentifierPrefix;
     // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // the vectors are moved in, pass them with std::move to avoid copying the mesh data
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, VertexFormat format = VertexFormat::Full,
+         MeshCpuCopy cpuCopy = MeshCpuCopy::Keep)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->textures = std::move(textures);
+        if (this->vertices.size() <= MAX_VERTICES_FOR_16BIT_INDICES)
+            this->indices16 = NarrowIndices(indices.data(), indices.size());
+        else
+            this->indices = std::move(indices);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupCpuCopy(format);
+        ApplyCpuCopy(cpuCopy);
+        AssignTextureUnits();
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    Mesh(vector<Vertex> vertices, vector<unsigned short> indices, vector<Texture> textures, VertexFormat format = VertexFormat::Full,
+         MeshCpuCopy cpuCopy = MeshCpuCopy::Keep)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
+        this->vertices = std::move(vertices);
+        this->indices16 = std::move(indices);
+        this->textures = std::move(textures);
+        setupCpuCopy(format);
+        ApplyCpuCopy(cpuCopy);
+        AssignTextureUnits();
+    }
+
+    // constructs a mesh straight from externally owned data (e.g. a mapped cooked model file).
+    // the data is uploaded to the GPU and no CPU side copy is kept.
+    // indexType is GL_UNSIGNED_SHORT or GL_UNSIGNED_INT; 32 bit indices are narrowed when the vertex count allows it.
+    Mesh(const Vertex *vertexData, size_t vertexCount, const void *indexData, GLenum indexType, size_t indexCount,
+         vector<Texture> textures, VertexFormat format = VertexFormat::Full)
+    {
+        this->textures = std::move(textures);
+        std::shared_ptr<MeshArena> ownArena = std::make_shared<MeshArena>(
+                vertexCount, MeshArena::IndexBytesInArena(vertexCount, indexType, indexCount), format);
+        setupMesh(std::move(ownArena), vertexData, vertexCount, indexData, indexType, indexCount);
+        AssignTextureUnits();
+    }
+
+    // like the above, but sub-allocates the mesh from an arena shared with other meshes
+    Mesh(std::shared_ptr<MeshArena> arena, const Vertex *vertexData, size_t vertexCount, const void *indexData, GLenum indexType,
+         size_t indexCount, vector<Texture> textures)
+    {
+        this->textures = std::move(textures);
+        setupMesh(std::move(arena), vertexData, vertexCount, indexData, indexType, indexCount);
+        AssignTextureUnits();
+    }
+
+    // trims the CPU side data to what the policy keeps. Positions are extracted from the full
+    // vertices, a mesh that already dropped them keeps what it has.
+    void ApplyCpuCopy(MeshCpuCopy cpuCopy)
+    {
+        if (cpuCopy == MeshCpuCopy::Keep)
+            return;
+        if (cpuCopy == MeshCpuCopy::Positions && !vertices.empty())
+        {
+            positions.resize(vertices.size());
+            for (size_t i = 0; i < vertices.size(); i++)
+                positions[i] = vertices[i].Position;
+        }
+        else
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            vector<glm::vec3>().swap(positions);
+            vector<unsigned int>().swap(indices);
+            vector<unsigned short>().swap(indices16);
         }
+        vector<Vertex>().swap(vertices);
+    }
 
+    // render the mesh
+    void Draw(Shader &shader)
+    {
+        AssignSamplerUnits(shader, glslIdentifierPrefix);
+        rg::GLState::Get().bindVertexArray(VAO);
+        DrawWithBoundArena(shader);
+    }
 
+    // render the mesh, expects the VAO of its arena to be bound already and the sampler units of the
+    // shader to be assigned (see Model::Draw)
+    void DrawWithBoundArena(Shader &shader)
+    {
+        // bind appropriate textures, the sampler uniforms already point at their units.
+        // meshes sharing a material skip the binds, the state cache sees the textures are still there
+        rg::GLState &state = rg::GLState::Get();
+        for(unsigned int i = 0; i < textures.size(); i++)
+            state.bindTextureUnit(textureUnits[i], GL_TEXTURE_2D, textures[i].id);
+
+        // identity for the unquantized formats, so the same shader draws all of them
+        shader.setVec3("positionOffset", positionOffset);
+        shader.setVec3("positionScale", positionScale);
 
         // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, (void*)indexOffset, baseVertex);
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // records the mesh instead of drawing it: packet gets the arena, the textures and the index range of
+    // the mesh, everything else (program, render state, depth) is taken as the caller filled it in.
+    // Textures past DrawPacket::MaxTextures are not bound.
+    // Uniforms queued before for the draw, e.g. the model matrix, stay with it.
+    void Submit(rg::CommandBuffer &queue, const Shader &shader, rg::DrawPacket packet) const
+    {
+        packet.vertexArray = VAO;
+        packet.textureCount = 0;
+        for (unsigned int i = 0; i < textures.size() && i < rg::DrawPacket::MaxTextures; i++)
+            packet.textures[packet.textureCount++] = {textureUnits[i], GL_TEXTURE_2D, textures[i].id};
+        queue.uniform(shader.location("positionOffset"), positionOffset);
+        queue.uniform(shader.location("positionScale"), positionScale);
+        packet.primitive = rg::Primitive::Triangles;
+        packet.indexType = indexType == GL_UNSIGNED_SHORT ? rg::IndexType::UnsignedShort : rg::IndexType::UnsignedInt;
+        packet.count = indexCount;
+        packet.first = indexOffset;
+        packet.baseVertex = baseVertex;
+        queue.add(packet);
     }
 
 private:
     // render data
-    unsigned int VBO, EBO;
+    std::shared_ptr<MeshArena> arena; // owns the buffers, shared with the other meshes of the model
 
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+    // numbers the textures of every type in order, texture_diffuse1, texture_diffuse2, ... and maps them
+    // to their units. textures past SAMPLERS_PER_TEXTURE_TYPE of one type have no sampler and are dropped.
+    void AssignTextureUnits()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        unsigned int count[(unsigned int) TextureType::Count] = {};
+        vector<Texture> assigned;
+        assigned.reserve(textures.size());
+        textureUnits.clear();
+        for (Texture &texture : textures)
+        {
+            unsigned int type = (unsigned int) texture.type;
+            if (count[type] == SAMPLERS_PER_TEXTURE_TYPE)
+            {
+                cout << "ERROR::MESH::TOO_MANY_TEXTURES " << TextureTypeName(texture.type) << " " << texture.path << endl;
+                continue;
+            }
+            textureUnits.push_back((unsigned char) (type * SAMPLERS_PER_TEXTURE_TYPE + count[type]++));
+            assigned.push_back(std::move(texture));
+        }
+        textures = std::move(assigned);
+    }
+
+    void setupCpuCopy(VertexFormat format)
+    {
+        const void *indexData = indices16.data();
+        GLenum type = GL_UNSIGNED_SHORT;
+        size_t count = indices16.size();
+        if (indices16.empty() && !indices.empty())
+        {
+            indexData = indices.data();
+            type = GL_UNSIGNED_INT;
+            count = indices.size();
+        }
+        std::shared_ptr<MeshArena> ownArena = std::make_shared<MeshArena>(
+                vertices.size(), MeshArena::IndexBytesInArena(vertices.size(), type, count), format);
+        setupMesh(std::move(ownArena), vertices.data(), vertices.size(), indexData, type, count);
+    }
+
+    // uploads the mesh into its arena
+    void setupMesh(std::shared_ptr<MeshArena> meshArena, const Vertex *vertexData, size_t vertexCount, const void *indexData,
+                   GLenum indexType, size_t indexCount)
+    {
+        arena = std::move(meshArena);
+        if (vertexCount)
+            bounds = rg::computeBounds(&vertexData[0].Position, vertexCount, sizeof(Vertex));
+        MeshArenaRange range = arena->Upload(vertexData, vertexCount, indexData, indexType, indexCount);
+        this->VAO = arena->VAO;
+        this->format = arena->format;
+        this->indexCount = range.indexCount;
+        this->indexType = range.indexType;
+        this->baseVertex = range.baseVertex;
+        this->indexOffset = range.indexOffset;
+        this->positionOffset = range.positionOffset;
+        this->positionScale = range.positionScale;
+    }
+};
+
+namespace detail {
+    inline glm::vec3 SafeNormalize(const glm::vec3 &v)
+    {
+        float length = glm::length(v);
+        return length > 0.0f ? v / length : glm::vec3(0.0f);
+    }
+
+    template <typename TPackedVertex>
+    void PackNormalTangentTexCoords(const Vertex &vertex, TPackedVertex &packed)
+    {
+        glm::vec3 normal = SafeNormalize(vertex.Normal);
+        glm::vec3 tangent = SafeNormalize(vertex.Tangent);
+        // the bitangent is rebuilt in the shader as cross(normal, tangent), only its orientation has to be stored
+        float sign = glm::dot(glm::cross(normal, tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+        packed.Normal = rg::packSnorm1010102(normal.x, normal.y, normal.z, 0.0f);
+        packed.Tangent = rg::packSnorm1010102(tangent.x, tangent.y, tangent.z, sign);
+        packed.TexCoords[0] = rg::floatToHalf(vertex.TexCoords.x);
+        packed.TexCoords[1] = rg::floatToHalf(vertex.TexCoords.y);
+    }
+
+    // normals, tangents (with the bitangent sign in w) and texture coordinates of both packed formats
+    inline void SetupPackedAttributes(size_t stride, size_t normalOffset, size_t tangentOffset, size_t texCoordsOffset)
+    {
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)normalOffset);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)texCoordsOffset);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)tangentOffset);
+    }
+}
 
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+inline void PackVertices(const Vertex *vertexData, size_t vertexCount, VertexFormat format, vector<unsigned char> &out,
+                         glm::vec3 &positionOffset, glm::vec3 &positionScale)
+{
+    positionOffset = glm::vec3(0.0f);
+    positionScale = glm::vec3(1.0f);
+    if (format == VertexFormat::Full)
+    {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char*>(vertexData);
+        out.assign(bytes, bytes + vertexCount * sizeof(Vertex));
+    }
+    else if (format == VertexFormat::Packed)
+    {
+        out.resize(vertexCount * sizeof(PackedVertex));
+        PackedVertex *packed = reinterpret_cast<PackedVertex*>(out.data());
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            packed[i].Position = vertexData[i].Position;
+            detail::PackNormalTangentTexCoords(vertexData[i], packed[i]);
+        }
+    }
+    else
+    {
+        glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            boundsMin = i == 0 ? vertexData[i].Position : glm::min(boundsMin, vertexData[i].Position);
+            boundsMax = i == 0 ? vertexData[i].Position : glm::max(boundsMax, vertexData[i].Position);
+        }
+        positionOffset = boundsMin;
+        positionScale = boundsMax - boundsMin;
+        // flat along an axis: any scale works, 1 keeps the division below defined
+        for (int axis = 0; axis < 3; axis++)
+            if (positionScale[axis] <= 0.0f)
+                positionScale[axis] = 1.0f;
+
+        out.resize(vertexCount * sizeof(QuantizedVertex));
+        QuantizedVertex *packed = reinterpret_cast<QuantizedVertex*>(out.data());
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            glm::vec3 unit = (vertexData[i].Position - positionOffset) / positionScale;
+            for (int axis = 0; axis < 3; axis++)
+                packed[i].Position[axis] = rg::quantizeUnorm16(unit[axis]);
+            packed[i].Position[3] = 0;
+            detail::PackNormalTangentTexCoords(vertexData[i], packed[i]);
+        }
+    }
+}
+
+inline void SetupVertexAttributes(VertexFormat format)
+{
+    if (format == VertexFormat::Full)
+    {
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
         // vertex Positions
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -132,8 +577,20 @@ private:
         // vertex bitangent
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
     }
-};
-#endif
\ No newline at end of file
+    else if (format == VertexFormat::Packed)
+    {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+        detail::SetupPackedAttributes(sizeof(PackedVertex), offsetof(PackedVertex, Normal), offsetof(PackedVertex, Tangent),
+                                      offsetof(PackedVertex, TexCoords));
+    }
+    else
+    {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, Position));
+        detail::SetupPackedAttributes(sizeof(QuantizedVertex), offsetof(QuantizedVertex, Normal), offsetof(QuantizedVertex, Tangent),
+                                      offsetof(QuantizedVertex, TexCoords));
+    }
+}
+#endif
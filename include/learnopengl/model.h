@@ -7,23 +7,121 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <stb_image.h>
 #include <assimp/Importer.hpp>
+#include <assimp/DefaultIOSystem.h>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
-
+#include <rg/bounds.h>
+#include <rg/mesh_cache.h>
+#include <rg/mesh_optimizer.h>
+#include <rg/occlusion.h>
+#include <rg/texture_loader.h>
+#include <rg/service_locator.h>
+#include <rg/texture_registry.h>
+
+#include <algorithm>
+#include <cstddef>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <atomic>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// CPU side data of a single mesh, produced by the import stage. The import stage never touches
+// OpenGL, so it can run on a worker thread.
+struct MeshData {
+    // storage, used when the mesh was imported through ASSIMP
+    vector<Vertex>         vertices;
+    vector<unsigned int>   indices;     // emptied once the mesh is small enough for indices16
+    vector<unsigned short> indices16;
+    // what gets uploaded: either the vectors above or a mapped cooked model file
+    const Vertex          *vertexData = nullptr;
+    size_t                 vertexCount = 0;
+    const void            *indexData = nullptr;
+    GLenum                 indexType = GL_UNSIGNED_INT;
+    size_t                 indexCount = 0;
+    vector<Texture>        textures;
+};
+
+// everything the import stage produces for a model
+struct ModelImport {
+    string directory;
+    rg::CookedModelFile cooked;                          // keeps the cooked mesh data mapped until it is uploaded
+    vector<MeshData> meshes;
+    vector<Texture> textures;                            // distinct textures of the model
+    unordered_map<string, unsigned int> textureIndexByPath; // index into textures
+    vector<rg::EncodedImage> encodedTextures;            // only filled when streaming
+    vector<rg::DecodedImage> decodedTextures;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    rg::OccluderMesh occluder;
+    bool ok = false;
+    std::atomic<bool> done{false};
+    // upload progress, only touched on the GL thread
+    size_t nextMesh = 0;
+    size_t nextTexture = 0;
+};
+
+// remembers the files ASSIMP opens during an import, e.g. the material library of an .obj, so the
+// cooked model can tell when one of them changed
+class RecordingIOSystem : public Assimp::DefaultIOSystem
+{
+public:
+    Assimp::IOStream *Open(const char *file, const char *mode = "rb") override
+    {
+        Assimp::IOStream *stream = Assimp::DefaultIOSystem::Open(file, mode);
+        if (stream && std::find(opened.begin(), opened.end(), file) == opened.end())
+            opened.push_back(file);
+        return stream;
+    }
+
+    // the files opened besides source, in the order they were first opened
+    vector<string> dependencies(const string &source) const
+    {
+        vector<string> result;
+        for (const string &file : opened)
+        {
+            if (file != source)
+                result.push_back(file);
+        }
+        return result;
+    }
+
+private:
+    vector<string> opened;
+};
+
+// limits how many bytes all streaming models upload to the GPU in a single frame.
+// the first upload of a frame always goes through, so an item bigger than the budget still makes progress.
+struct UploadBudget {
+    size_t bytesLeft;
+    bool uploadedAny = false;
+
+    explicit UploadBudget(size_t bytes) : bytesLeft(bytes) {}
 
+    bool take(size_t bytes)
+    {
+        if (uploadedAny && bytes > bytesLeft)
+            return false;
+        bytesLeft -= std::min(bytes, bytesLeft);
+        uploadedAny = true;
+        return true;
+    }
+};
+
+enum class ModelLoadMode {
+    Blocking,   // everything is loaded and uploaded in the constructor
+    Streaming   // parsing/decoding on a worker thread, uploads spread over frames with StreamUploads
+};
 
 class Model
 {
@@ -33,47 +131,372 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    VertexFormat vertexFormat;
+    MeshCpuCopy cpuCopy;
+    // in model space. Empty until the import is done, the box of the import while streaming,
+    // the union of the mesh bounds once the model is ready.
+    rg::Bounds bounds;
+    // in model space, built from all meshes on import. Empty until the model is ready, and for models
+    // that are not closed.
+    rg::OccluderMesh occluder;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // the packed vertex formats have to be drawn with the model_packed.vs vertex shader.
+    // cpuCopy decides what the meshes keep in memory after their data was uploaded.
+    Model(string const &path, bool gamma = false, ModelLoadMode mode = ModelLoadMode::Blocking,
+          VertexFormat format = VertexFormat::Full, MeshCpuCopy cpuCopy = MeshCpuCopy::Keep)
+        : gammaCorrection(gamma), vertexFormat(format), cpuCopy(cpuCopy)
+    {
+        directory = path.substr(0, path.find_last_of('/'));
+        pending = std::make_shared<ModelImport>();
+        if (mode == ModelLoadMode::Blocking)
+        {
+            importModel(*pending, path, false);
+            pending->done = true;
+            finishLoading();
+        }
+        else
+        {
+            std::shared_ptr<ModelImport> import = pending;
+            rg::ServiceLocator::Get().getJobSystem().run([import, path]() {
+                importModel(*import, path, true);
+                import->done = true;
+            });
+        }
+    }
+
+    ~Model()
     {
-        loadModel(path);
+        if (placeholderVAO)
+        {
+            rg::GLState::Get().deleteVertexArray(placeholderVAO);
+            rg::GLState::Get().deleteBuffer(placeholderVBO);
+        }
+    }
+
+    Model(const Model &) = delete;
+    Model &operator=(const Model &) = delete;
+
+    bool IsReady() const { return pending == nullptr; }
+
+    // uploads as much of a streaming model as the budget allows. call once per frame on the GL thread.
+    void StreamUploads(UploadBudget &budget)
+    {
+        if (!pending || !pending->done)
+            return;
+        ModelImport &import = *pending;
+        if (!placeholderVAO)
+        {
+            createPlaceholder(import.boundsMin, import.boundsMax);
+            rg::Aabb box;
+            box.min = import.boundsMin;
+            box.max = import.boundsMax;
+            bounds = rg::computeBounds(box);
+        }
+
+        while (import.nextMesh < import.meshes.size())
+        {
+            MeshData &data = import.meshes[import.nextMesh];
+            if (!budget.take(data.vertexCount * VertexFormatSize(vertexFormat) + data.indexCount * IndexTypeSize(data.indexType)))
+                return;
+            meshes.push_back(createMesh(import, data));
+            import.nextMesh++;
+        }
+        while (import.nextTexture < import.textures.size())
+        {
+            const rg::DecodedImage &image = import.decodedTextures[import.nextTexture];
+            if (!budget.take(image.byteSize()))
+                return;
+            Texture &texture = import.textures[import.nextTexture];
+            texture.handle = rg::TextureRegistry::Get().adopt(import.encodedTextures[import.nextTexture], image,
+                                                              textureUsage(texture.type));
+            texture.id = texture.handle.id();
+            // the pixels are on the GPU now
+            import.decodedTextures[import.nextTexture] = rg::DecodedImage();
+            import.encodedTextures[import.nextTexture] = rg::EncodedImage();
+            import.nextTexture++;
+        }
+        finishLoading();
     }
 
-    // draws the model, and thus all its meshes
+    // draws the model, and thus all its meshes. until a streaming model is ready only its bounding box is drawn.
     void Draw(Shader &shader)
     {
+        if (!IsReady())
+        {
+            drawPlaceholder(shader);
+            return;
+        }
+        if (!arena)
+            return;
+        AssignSamplerUnits(shader, glslIdentifierPrefix);
+        // all meshes share the buffers of the arena, so its VAO is bound once for the whole model
+        rg::GLState::Get().bindVertexArray(arena->VAO);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawWithBoundArena(shader);
+    }
+
+    // like Draw, but skips the model or single meshes outside the frustum. The frustum has to be in
+    // model space, i.e. extracted from projection * view * model (see rg::Frustum).
+    void Draw(Shader &shader, const rg::Frustum &frustum, rg::CullStats &stats)
+    {
+        unsigned int items = IsReady() ? meshes.size() : 1;
+        if (!frustum.intersects(bounds))
+        {
+            stats.record(false, items);
+            return;
+        }
+        if (!IsReady())
+        {
+            // without a placeholder yet there is nothing to draw, its bounds are still empty
+            if (placeholderVAO)
+                stats.record(true);
+            drawPlaceholder(shader);
+            return;
+        }
+        if (!arena)
+            return;
+        AssignSamplerUnits(shader, glslIdentifierPrefix);
+        bool arenaBound = false;
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        {
+            bool visible = frustum.intersects(meshes[i].bounds);
+            stats.record(visible);
+            if (!visible)
+                continue;
+            if (!arenaBound)
+            {
+                rg::GLState::Get().bindVertexArray(arena->VAO);
+                arenaBound = true;
+            }
+            meshes[i].DrawWithBoundArena(shader);
+        }
+    }
+
+    // like Draw with a frustum, but records the visible meshes into a command buffer instead of drawing
+    // them. packet has the program, render state and depth of the draws filled in, every mesh gets
+    // modelMatrix as "model". Does not touch OpenGL, so it runs on any thread; the sampler units of the
+    // shader have to be assigned for the prefix of the model already (see AssignSamplerUnits).
+    void Submit(rg::CommandBuffer &queue, const Shader &shader, const rg::DrawPacket &packet, const glm::mat4 &modelMatrix,
+                const rg::Frustum &frustum, rg::CullStats &stats) const
+    {
+        unsigned int items = IsReady() ? meshes.size() : 1;
+        if (!frustum.intersects(bounds))
+        {
+            stats.record(false, items);
+            return;
+        }
+        int modelLocation = shader.location("model");
+        if (!IsReady())
+        {
+            if (!placeholderVAO)
+                return;
+            stats.record(true);
+            rg::DrawPacket lines = packet;
+            lines.vertexArray = placeholderVAO;
+            lines.textureCount = 0;
+            lines.primitive = rg::Primitive::Lines;
+            lines.indexType = rg::IndexType::None;
+            lines.count = 24;
+            lines.first = 0;
+            // the placeholder positions are never quantized
+            queue.uniform(modelLocation, modelMatrix);
+            queue.uniform(shader.location("positionOffset"), glm::vec3(0.0f));
+            queue.uniform(shader.location("positionScale"), glm::vec3(1.0f));
+            queue.add(lines);
+            return;
+        }
+        if (!arena)
+            return;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            bool visible = frustum.intersects(meshes[i].bounds);
+            stats.record(visible);
+            if (!visible)
+                continue;
+            queue.uniform(modelLocation, modelMatrix);
+            meshes[i].Submit(queue, shader, packet);
+        }
     }
 
     void SetShaderTextureNamePrefix(std::string prefix) {
+        glslIdentifierPrefix = prefix;
         for (Mesh& mesh: meshes) {
             mesh.glslIdentifierPrefix = prefix;
         }
     }
 private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+    std::shared_ptr<ModelImport> pending; // shared with the worker thread while the model is loading
+    std::string glslIdentifierPrefix;
+    std::shared_ptr<MeshArena> arena;     // vertex and index buffers of all meshes
+    unsigned int placeholderVAO = 0;
+    unsigned int placeholderVBO = 0;
+
+    static const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+    // loads a model with supported ASSIMP extensions from file into CPU memory. Does not touch OpenGL.
+    // the imported meshes are cooked into a binary file next to the source, so ASSIMP only runs again
+    // when the content of the source file, or of a file it references (the .mtl), changes.
+    static void importModel(ModelImport &import, string const &path, bool decodeTextures)
     {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+        // retrieve the directory path of the filepath
+        import.directory = path.substr(0, path.find_last_of('/'));
+
+        rg::CookedModelKey key;
+        key.importFlags = importFlags;
+        key.vertexStride = sizeof(Vertex);
+        bool hashed = rg::hashFileContents(path, key.sourceHash);
+        string cookedPath = rg::cookedPathFor(path);
+        if (hashed && loadCookedModel(import, cookedPath, key))
         {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            import.ok = true;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
+        else
+        {
+            // read file via ASSIMP
+            Assimp::Importer importer;
+            RecordingIOSystem *io = new RecordingIOSystem();
+            importer.SetIOHandler(io); // the importer owns and deletes it
+            const aiScene* scene = importer.ReadFile(path, importFlags);
+            // check for errors
+            if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+            {
+                cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+                return;
+            }
+
+            // process ASSIMP's root node recursively
+            processNode(import, scene->mRootNode, scene);
+            optimizeMeshes(import, path);
+            import.ok = true;
+
+            if (hashed)
+                writeCookedModel(import, cookedPath, key, io->dependencies(path));
+        }
+        computeBounds(import);
+        computeOccluder(import);
+
+        if (decodeTextures)
+        {
+            vector<string> paths;
+            vector<rg::TextureUsage> usages;
+            for (const Texture &texture : import.textures)
+            {
+                paths.push_back(import.directory + '/' + texture.path);
+                usages.push_back(textureUsage(texture.type));
+            }
+            rg::TextureLoader loader;
+            import.encodedTextures = loader.read(paths);
+            import.decodedTextures = loader.decode(import.encodedTextures, usages);
+            loader.printTimings(cout);
+        }
+    }
+
+    static bool loadCookedModel(ModelImport &import, string const &cookedPath, const rg::CookedModelKey &key)
+    {
+        if (!import.cooked.open(cookedPath, key))
+            return false;
+        for (const rg::CookedMesh &cookedMesh : import.cooked.meshes())
+        {
+            MeshData data;
+            data.vertexData = static_cast<const Vertex*>(cookedMesh.vertices);
+            data.vertexCount = cookedMesh.vertexCount;
+            data.indexData = cookedMesh.indices;
+            data.indexType = cookedMesh.indexSize == sizeof(unsigned short) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+            data.indexCount = cookedMesh.indexCount;
+            for (const rg::CookedTexture &cookedTexture : cookedMesh.textures)
+            {
+                TextureType type;
+                if (!ParseTextureType(cookedTexture.type, type))
+                {
+                    cout << "ERROR::MODEL::UNKNOWN_TEXTURE_TYPE " << cookedTexture.type << endl;
+                    continue;
+                }
+                data.textures.push_back(loadTexture(import, cookedTexture.path.c_str(), type));
+            }
+            import.meshes.push_back(std::move(data));
+        }
+        return true;
+    }
+
+    static void writeCookedModel(const ModelImport &import, string const &cookedPath, const rg::CookedModelKey &key,
+                                 const vector<string> &dependencies)
+    {
+        vector<rg::CookedMesh> cookedMeshes(import.meshes.size());
+        for (unsigned int i = 0; i < import.meshes.size(); i++)
+        {
+            rg::CookedMesh &cookedMesh = cookedMeshes[i];
+            cookedMesh.vertices = import.meshes[i].vertexData;
+            cookedMesh.vertexCount = import.meshes[i].vertexCount;
+            cookedMesh.indices = import.meshes[i].indexData;
+            cookedMesh.indexCount = import.meshes[i].indexCount;
+            cookedMesh.indexSize = IndexTypeSize(import.meshes[i].indexType);
+            for (const Texture &texture : import.meshes[i].textures)
+                cookedMesh.textures.push_back({TextureTypeName(texture.type), texture.path});
+        }
+        rg::writeCookedModel(cookedPath, key, cookedMeshes, dependencies);
+    }
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+    // welds the per-corner vertices ASSIMP produces and reorders them for the vertex cache, overdraw and
+    // vertex fetch, then narrows the indices to 16 bits where possible. Only runs on import, the cooked
+    // file stores the optimized meshes.
+    static void optimizeMeshes(ModelImport &import, string const &path)
+    {
+        rg::MeshOptimizationStats total;
+        for (MeshData &data : import.meshes)
+        {
+            total += rg::optimizeMesh(data.vertices, data.indices, offsetof(Vertex, Position));
+            data.vertexData = data.vertices.data();
+            data.vertexCount = data.vertices.size();
+            if (data.vertexCount <= MAX_VERTICES_FOR_16BIT_INDICES)
+            {
+                data.indices16 = NarrowIndices(data.indices.data(), data.indices.size());
+                vector<unsigned int>().swap(data.indices);
+                data.indexData = data.indices16.data();
+                data.indexType = GL_UNSIGNED_SHORT;
+                data.indexCount = data.indices16.size();
+            }
+            else
+            {
+                data.indexData = data.indices.data();
+                data.indexType = GL_UNSIGNED_INT;
+                data.indexCount = data.indices.size();
+            }
+        }
+        cout << "MODEL::OPTIMIZED " << path << ": " << total << endl;
+    }
+
+    static void computeBounds(ModelImport &import)
+    {
+        bool first = true;
+        for (const MeshData &data : import.meshes)
+        {
+            for (size_t i = 0; i < data.vertexCount; i++)
+            {
+                const glm::vec3 &p = data.vertexData[i].Position;
+                import.boundsMin = first ? p : glm::min(import.boundsMin, p);
+                import.boundsMax = first ? p : glm::max(import.boundsMax, p);
+                first = false;
+            }
+        }
+    }
+
+    static void computeOccluder(ModelImport &import)
+    {
+        rg::OccluderBuilder builder;
+        for (const MeshData &data : import.meshes)
+        {
+            // meshes without vertices or indices have nothing to rasterize
+            if (!data.vertexData || !data.indexData || data.indexCount == 0)
+                continue;
+            builder.addTriangles(&data.vertexData->Position, sizeof(Vertex), data.indexData,
+                                 IndexTypeSize(data.indexType), data.indexCount);
+        }
+        import.occluder = builder.build();
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    static void processNode(ModelImport &import, aiNode *node, const aiScene *scene)
     {
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -81,22 +504,21 @@ private:
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            import.meshes.push_back(processMesh(import, mesh, scene));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(import, node->mChildren[i], scene);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    static MeshData processMesh(ModelImport &import, aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshData data;
+        vector<Texture> &textures = data.textures;
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -137,9 +559,14 @@ private:
                 vertex.Bitangent = vector;
             }
             else
+            {
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+                // zeroed so identical vertices also compare equal byte for byte when they are welded
+                vertex.Tangent = glm::vec3(0.0f);
+                vertex.Bitangent = glm::vec3(0.0f);
+            }
 
-            vertices.push_back(vertex);
+            data.vertices.push_back(vertex);
 
 
         }
@@ -149,7 +576,7 @@ private:
             aiFace face = mesh->mFaces[i];
             // retrieve all indices of the face and store them in the indices vector
             for(unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
+                data.indices.push_back(face.mIndices[j]);
         }
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
@@ -164,55 +591,206 @@ private:
 
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+        vector<Texture> diffuseMaps = loadMaterialTextures(import, material, aiTextureType_DIFFUSE, TextureType::Diffuse);
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+        vector<Texture> specularMaps = loadMaterialTextures(import, material, aiTextureType_SPECULAR, TextureType::Specular);
         textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+        std::vector<Texture> normalMaps = loadMaterialTextures(import, material, aiTextureType_HEIGHT, TextureType::Normal);
         textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+        std::vector<Texture> heightMaps = loadMaterialTextures(import, material, aiTextureType_AMBIENT, TextureType::Height);
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
+        // return the extracted mesh data, optimizeMeshes points the views at it
+        return data;
+    }
 
-
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+    // normal maps (aiTextureType_HEIGHT in .obj files) are compressed as such, everything else as color
+    static rg::TextureUsage textureUsage(TextureType type)
+    {
+        return type == TextureType::Normal ? rg::TextureUsage::NormalMap : rg::TextureUsage::Color;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
+    // checks all material textures of a given type and registers the textures if they're not registered yet.
     // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    static vector<Texture> loadMaterialTextures(ModelImport &import, aiMaterial *mat, aiTextureType type, TextureType textureType)
     {
         vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            textures.push_back(loadTexture(import, str.C_Str(), textureType));
+        }
+        return textures;
+    }
+
+    // registers a single texture of the model, unless a texture with the same filepath was already registered.
+    // the texture itself is loaded later, together with all the others.
+    static Texture loadTexture(ModelImport &import, const char *path, TextureType type)
+    {
+        // check if texture was loaded before and if so, skip loading a new texture
+        auto loaded = import.textureIndexByPath.find(path);
+        if (loaded != import.textureIndexByPath.end())
+            return import.textures[loaded->second]; // a texture with the same filepath has already been loaded (optimization)
+        // if texture hasn't been loaded already, queue it
+        Texture texture;
+        texture.id = 0;
+        texture.type = type;
+        texture.path = path;
+        import.textureIndexByPath.emplace(texture.path, import.textures.size());
+        import.textures.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture;
+    }
+
+    // the arena is sized for all meshes of the import as soon as the first one is uploaded.
+    // the CPU side data is moved into the mesh (or released), it is not needed by the import anymore.
+    Mesh createMesh(const ModelImport &import, MeshData &data)
+    {
+        if (!arena)
+        {
+            size_t vertexCount = 0;
+            size_t indexBytes = 0;
+            for (const MeshData &other : import.meshes)
+            {
+                vertexCount += other.vertexCount;
+                indexBytes += MeshArena::IndexBytesInArena(other.vertexCount, other.indexType, other.indexCount);
+            }
+            arena = std::make_shared<MeshArena>(vertexCount, indexBytes, vertexFormat);
+        }
+        Mesh mesh(arena, data.vertexData, data.vertexCount, data.indexData, data.indexType, data.indexCount, std::move(data.textures));
+        mesh.glslIdentifierPrefix = glslIdentifierPrefix;
+        if (cpuCopy != MeshCpuCopy::Drop)
+        {
+            if (!data.vertices.empty())
+            {
+                mesh.vertices = std::move(data.vertices);
+                mesh.indices = std::move(data.indices);
+                mesh.indices16 = std::move(data.indices16);
+            }
+            else
+            {
+                // cooked data lives in the mapped file, which is closed once loading is finished
+                mesh.vertices.assign(data.vertexData, data.vertexData + data.vertexCount);
+                if (data.indexType == GL_UNSIGNED_SHORT)
+                    mesh.indices16.assign(static_cast<const unsigned short*>(data.indexData),
+                                          static_cast<const unsigned short*>(data.indexData) + data.indexCount);
+                else
+                    mesh.indices.assign(static_cast<const unsigned int*>(data.indexData),
+                                        static_cast<const unsigned int*>(data.indexData) + data.indexCount);
+            }
+            mesh.ApplyCpuCopy(cpuCopy);
+        }
+        vector<Vertex>().swap(data.vertices);
+        vector<unsigned int>().swap(data.indices);
+        vector<unsigned short>().swap(data.indices16);
+        data.vertexData = nullptr;
+        data.indexData = nullptr;
+        return mesh;
+    }
+
+    // uploads whatever the budget did not cover yet, hands the textures to the meshes and releases the import data.
+    void finishLoading()
+    {
+        ModelImport &import = *pending;
+        while (import.nextMesh < import.meshes.size())
+        {
+            meshes.push_back(createMesh(import, import.meshes[import.nextMesh]));
+            import.nextMesh++;
+        }
+
+        // textures that were not decoded up front are acquired from the shared registry in one batch
+        // (anything not cached yet is decoded concurrently)
+        if (import.decodedTextures.empty() && !import.textures.empty())
+        {
+            vector<string> paths;
+            vector<rg::TextureUsage> usages;
+            for (const Texture &texture : import.textures)
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+                paths.push_back(import.directory + '/' + texture.path);
+                usages.push_back(textureUsage(texture.type));
+            }
+            vector<rg::TextureHandle> handles = rg::TextureRegistry::Get().acquire(paths, usages);
+            for(unsigned int k = 0; k < handles.size(); k++)
+            {
+                import.textures[k].id = handles[k].id();
+                import.textures[k].handle = handles[k];
+            }
+        }
+        else
+        {
+            while (import.nextTexture < import.textures.size())
+            {
+                Texture &texture = import.textures[import.nextTexture];
+                texture.handle = rg::TextureRegistry::Get().adopt(import.encodedTextures[import.nextTexture],
+                                                                  import.decodedTextures[import.nextTexture],
+                                                                  textureUsage(texture.type));
+                texture.id = texture.handle.id();
+                import.nextTexture++;
+            }
+        }
+
+        bounds = rg::Bounds();
+        for (const Mesh &mesh : meshes)
+            bounds.extend(mesh.bounds);
+        occluder = std::move(import.occluder);
+
+        // moved out, so no handle is left in the import data that a worker thread might still be holding on to
+        textures_loaded = std::move(import.textures);
+        for(Mesh &mesh : meshes)
+        {
+            for(Texture &texture : mesh.textures)
+            {
+                const Texture &loaded = textures_loaded[import.textureIndexByPath.at(texture.path)];
+                texture.id = loaded.id;
+                texture.handle = loaded.handle;
+            }
+        }
+        pending.reset();
+    }
+
+    void createPlaceholder(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax)
+    {
+        glm::vec3 corners[8];
+        for (int i = 0; i < 8; i++)
+            corners[i] = glm::vec3((i & 1) ? boundsMax.x : boundsMin.x,
+                                   (i & 2) ? boundsMax.y : boundsMin.y,
+                                   (i & 4) ? boundsMax.z : boundsMin.z);
+        // the 12 edges of the box, as pairs of corners that differ in exactly one axis
+        glm::vec3 lines[24];
+        int n = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            for (int axis = 1; axis < 8; axis <<= 1)
+            {
+                if (!(i & axis))
                 {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
+                    lines[n++] = corners[i];
+                    lines[n++] = corners[i | axis];
                 }
             }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
         }
-        return textures;
+
+        glGenVertexArrays(1, &placeholderVAO);
+        glGenBuffers(1, &placeholderVBO);
+        rg::GLState::Get().bindVertexArray(placeholderVAO);
+        rg::GLState::Get().bindBuffer(GL_ARRAY_BUFFER, placeholderVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(lines), lines, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    }
+
+    void drawPlaceholder(Shader &shader)
+    {
+        if (!placeholderVAO)
+            return;
+        // the placeholder positions are never quantized
+        shader.setVec3("positionOffset", glm::vec3(0.0f));
+        shader.setVec3("positionScale", glm::vec3(1.0f));
+        rg::GLState::Get().bindVertexArray(placeholderVAO);
+        glDrawArrays(GL_LINES, 0, 24);
     }
 };
 
@@ -237,7 +815,7 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        rg::GLState::Get().bindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -7,6 +7,7 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <rg/bounds.h>
 #include <rg/event_controller.h>
 #include <vector>
 #include <rg/Error.h>
@@ -56,6 +57,11 @@ public:
         return glm::lookAt(Position, Position + Front, Up);
     }
 
+    // the ray through the center of the view, for picking what the camera looks at
+    rg::Ray GetRay() const {
+        return rg::Ray{Position, Front};
+    }
+
     void ProcessKeyboard(Direction direction, float deltaTime) {
         float velocity = MovementSpeed * deltaTime;
        switch (direction) {
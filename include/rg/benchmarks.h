@@ -0,0 +1,17 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_BENCHMARKS_H
+#define PROJECT_BASE_BENCHMARKS_H
+
+#include <string>
+
+namespace rg {
+    // Headless micro benchmarks of the CPU side of the renderer, `project_base --bench <name>`
+    // runs one instead of the scene. No window and no GL context are created.
+    // Returns the exit code of the process, an unknown name lists the benchmarks and fails.
+    int runBenchmark(const std::string &name);
+}
+
+#endif //PROJECT_BASE_BENCHMARKS_H
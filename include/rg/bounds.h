@@ -0,0 +1,108 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_BOUNDS_H
+#define PROJECT_BASE_BOUNDS_H
+
+#include <cstddef>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+namespace rg {
+    struct Aabb {
+        // inverted, so the first extend() sets both corners
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+        bool empty() const { return min.x > max.x; }
+        glm::vec3 center() const { return (min + max) * 0.5f; }
+        // half of the size along every axis
+        glm::vec3 extents() const { return (max - min) * 0.5f; }
+
+        void extend(const glm::vec3 &point) {
+            min = glm::min(min, point);
+            max = glm::max(max, point);
+        }
+        void extend(const Aabb &other) {
+            min = glm::min(min, other.min);
+            max = glm::max(max, other.max);
+        }
+
+        // the box around this box after the transform
+        Aabb transformed(const glm::mat4 &transform) const;
+    };
+
+    struct BoundingSphere {
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = -1.0f;
+
+        bool empty() const { return radius < 0.0f; }
+        // scaled by the largest scale of the transform, so it stays conservative under non-uniform scaling
+        BoundingSphere transformed(const glm::mat4 &transform) const;
+    };
+
+    // Both volumes of the same geometry: the sphere is the cheaper test, the box the tighter one.
+    struct Bounds {
+        Aabb box;
+        BoundingSphere sphere;
+
+        bool empty() const { return box.empty(); }
+        Bounds transformed(const glm::mat4 &transform) const;
+        // grows both volumes until they contain other as well
+        void extend(const Bounds &other);
+    };
+
+    struct Ray {
+        glm::vec3 origin;
+        glm::vec3 direction;    // does not have to be normalized, distances are in multiples of it
+    };
+
+    // slab test: true when the ray enters the box within [0, maxDistance], distance is where it enters
+    // (0 when the origin is inside)
+    bool intersects(const Ray &ray, const Aabb &box, float maxDistance, float &distance);
+
+    // bounds of count points that are stride bytes apart, e.g. the positions of an array of vertices:
+    //     computeBounds(&vertices[0].Position, vertices.size(), sizeof(Vertex))
+    Bounds computeBounds(const glm::vec3 *points, size_t count, size_t stride = sizeof(glm::vec3));
+    // bounds of a box, the sphere is the one through its corners
+    Bounds computeBounds(const Aabb &box);
+
+    // The six clip planes of a projection * view matrix. The planes are in the space the matrix transforms
+    // from, so the planes of projection * view * model are in model space, where the bounds of a model can
+    // be tested as they are instead of being transformed every frame.
+    // The tests are conservative: false only for volumes that are entirely outside one of the planes.
+    class Frustum {
+    public:
+        static Frustum fromMatrix(const glm::mat4 &matrix);
+
+        bool intersects(const BoundingSphere &sphere) const;
+        bool intersects(const Aabb &box) const;
+        // the sphere first, only volumes passing it pay for the box test. Empty bounds (geometry that
+        // is not known yet) count as visible.
+        bool intersects(const Bounds &bounds) const;
+
+        // left, right, bottom, top, near, far: xyz is the normal pointing inside, normalized, w the distance
+        glm::vec4 planes[6];
+    };
+
+    // what the culling of one frame did, counted in draw items (meshes, instances)
+    struct CullStats {
+        unsigned int submitted = 0;
+        unsigned int culled = 0;
+
+        void record(bool visible, unsigned int count = 1) {
+            (visible ? submitted : culled) += count;
+        }
+
+        // adds the counts of another part of the frame, e.g. one recorded on another thread
+        CullStats &operator+=(const CullStats &other) {
+            submitted += other.submitted;
+            culled += other.culled;
+            return *this;
+        }
+    };
+}
+
+#endif //PROJECT_BASE_BOUNDS_H
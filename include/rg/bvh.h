@@ -0,0 +1,89 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_BVH_H
+#define PROJECT_BASE_BVH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <rg/bounds.h>
+#include <rg/culling.h>
+
+namespace rg {
+    struct BvhCounters {
+        double buildMilliseconds = 0.0;     // of the last build
+        double refitMilliseconds = 0.0;     // of the last refit
+        unsigned int builds = 0;
+        unsigned int refits = 0;
+        unsigned int refitNodes = 0;        // nodes the last refit recomputed
+        // of the last query
+        unsigned int nodesVisited = 0;
+        unsigned int objectsTested = 0;     // objects of the leaves the frustum cuts, tested by the culling
+                                            // kernel; the rest came with whole subtrees
+    };
+
+    struct BvhHit {
+        uint32_t object;
+        float distance;     // where the ray enters the box of the object
+    };
+
+    // Bounding volume hierarchy over the world space boxes of the objects of a scene, an object is
+    // the index of its box; empty boxes are never visible nor hit. Built top down with a binned surface
+    // area heuristic; objects that move are updated in place and refit() grows or shrinks the boxes above
+    // them without changing the tree, which is good as long as the objects do not move far from where
+    // they were when it was built.
+    class Bvh {
+    public:
+        void build(const std::vector<Aabb> &boxes);
+        void clear();
+
+        size_t size() const { return m_boxes.size(); }
+        const Aabb &box(uint32_t object) const { return m_boxes[object]; }
+        // changes the box of an object, the tree follows with the next refit()
+        void update(uint32_t object, const Aabb &box);
+        // recomputes the boxes on the paths from the updated objects to the root
+        void refit();
+
+        // replaces visible with the objects whose boxes intersect the frustum. Subtrees entirely inside
+        // are taken without testing their objects, subtrees entirely outside one plane are skipped. The
+        // objects of the leaves the frustum cuts are collected and tested in one CullingBatch::cull.
+        void query(const Frustum &frustum, std::vector<uint32_t> &visible);
+        // the nearest object whose box the ray enters within maxDistance
+        bool raycast(const Ray &ray, BvhHit &hit, float maxDistance = 1e30f) const;
+
+        const BvhCounters &counters() const { return m_counters; }
+
+        static constexpr unsigned int MaxLeafSize = 4;
+        static constexpr unsigned int SahBins = 12;
+
+    private:
+        struct Node {
+            Aabb box;
+            uint32_t left = 0;          // the right child is left + 1, 0 for leaves (the root is nobody's child)
+            uint32_t parent = 0;
+            // the objects of the whole subtree are m_objects[objectBegin, objectEnd)
+            uint32_t objectBegin = 0;
+            uint32_t objectEnd = 0;
+        };
+
+        std::vector<Aabb> m_boxes;           // by object
+        std::vector<uint32_t> m_objects;     // objects in tree order
+        std::vector<uint32_t> m_leafOf;      // by object
+        std::vector<Node> m_nodes;           // 0 is the root, children come after their parents
+        std::vector<uint32_t> m_dirtyLeaves;
+        std::vector<glm::vec3> m_centroids;  // only used while building
+        // only used while querying
+        CullingBatch m_candidateBoxes;
+        std::vector<uint32_t> m_candidates;  // the object of each box of m_candidateBoxes
+        std::vector<uint32_t> m_candidatesVisible;
+        BvhCounters m_counters;
+
+        void split(uint32_t node);
+        void queryNode(uint32_t node, const Frustum &frustum, unsigned int planeMask, std::vector<uint32_t> &visible);
+    };
+}
+
+#endif //PROJECT_BASE_BVH_H
@@ -0,0 +1,45 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_CULLING_H
+#define PROJECT_BASE_CULLING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <rg/bounds.h>
+#include <rg/simd.h>
+
+namespace rg {
+    // World space boxes of many objects, stored as one array per component (center and extents), so the
+    // culling kernels test 4 (SSE) or 8 (AVX2) boxes against a plane with a handful of instructions.
+    // The result is the compact list of the indices of the visible boxes, in order, which is what
+    // draw submission walks.
+    class CullingBatch {
+    public:
+        void clear();
+        void reserve(size_t count);
+        // returns the index of the box, the one the visible list refers to
+        uint32_t add(const Aabb &box);
+        size_t size() const { return m_centerX.size(); }
+
+        // replaces visible with the indices of the boxes intersecting the frustum and returns how many there are.
+        // The test is Frustum::intersects(Aabb) for every box. Kernels: scalar, SSE and AVX2; a CPU with AVX
+        // but not AVX2 gets the SSE one, packing the visible indices needs the 8 wide integer permute.
+        size_t cull(const Frustum &frustum, std::vector<uint32_t> &visible, SimdLevel simd = bestSimdLevel()) const;
+
+        // the kernel that runs for a requested level
+        static SimdLevel kernelLevel(SimdLevel requested);
+
+        // boxes per kernel call, the visible list may be written this far past its final size
+        static constexpr size_t MaxLanes = 8;
+
+    private:
+        std::vector<float> m_centerX, m_centerY, m_centerZ;
+        std::vector<float> m_extentX, m_extentY, m_extentZ;
+    };
+}
+
+#endif //PROJECT_BASE_CULLING_H
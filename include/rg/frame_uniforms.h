@@ -0,0 +1,125 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_FRAME_UNIFORMS_H
+#define PROJECT_BASE_FRAME_UNIFORMS_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace rg {
+    // Fixed binding points of the per frame uniform blocks. Every program declaring a block with one
+    // of these names gets it bound by bindFrameUniformBlocks, GLSL 330 has no layout(binding = N).
+    const unsigned int FRAME_CAMERA_BINDING = 0;
+    const unsigned int FRAME_LIGHTS_BINDING = 1;
+    const char *const FRAME_CAMERA_BLOCK = "FrameCamera";
+    const char *const FRAME_LIGHTS_BLOCK = "FrameLights";
+
+    const size_t FRAME_POINT_LIGHTS = 2;
+
+    // The structs below mirror the layout(std140) blocks in the shaders member for member.
+    // Every vec3 is followed by a float (or padding), which is where std140 puts the next scalar.
+    struct FrameCamera {
+        glm::mat4 projection;
+        glm::mat4 view;
+        glm::mat4 skyboxView;   // view without the translation
+        glm::vec3 viewPosition;
+        float padding0;
+    };
+
+    struct FrameDirLight {
+        glm::vec3 direction;
+        float padding0;
+        glm::vec3 ambient;
+        float padding1;
+        glm::vec3 diffuse;
+        float padding2;
+        glm::vec3 specular;
+        float padding3;
+    };
+
+    struct FramePointLight {
+        glm::vec3 position;
+        float constant;
+        glm::vec3 ambient;
+        float linear;
+        glm::vec3 diffuse;
+        float quadratic;
+        glm::vec3 specular;
+        float padding0;
+    };
+
+    struct FrameSpotLight {
+        glm::vec3 position;
+        float cutOff;
+        glm::vec3 direction;
+        float outerCutOff;
+        glm::vec3 ambient;
+        float constant;
+        glm::vec3 diffuse;
+        float linear;
+        glm::vec3 specular;
+        float quadratic;
+    };
+
+    struct FrameLights {
+        FrameDirLight dirLight;
+        FramePointLight pointLights[FRAME_POINT_LIGHTS];
+        FrameSpotLight spotLight;
+    };
+
+    static_assert(sizeof(FrameCamera) == 208, "FrameCamera does not match the std140 block");
+    static_assert(sizeof(FrameDirLight) == 64 && sizeof(FramePointLight) == 64 && sizeof(FrameSpotLight) == 80,
+                  "light structs do not match the std140 structs");
+    static_assert(offsetof(FrameLights, spotLight) == 64 + 64 * FRAME_POINT_LIGHTS, "FrameLights does not match the std140 block");
+
+    // a range of a uniform buffer bound to a uniform block binding point, buffer 0 is none
+    struct UniformBlockRange {
+        unsigned int binding = 0;
+        unsigned int buffer = 0;
+        ptrdiff_t offset = 0;
+        ptrdiff_t size = 0;
+
+        bool operator==(const UniformBlockRange &other) const {
+            return binding == other.binding && buffer == other.buffer && offset == other.offset && size == other.size;
+        }
+    };
+
+    // binds the FrameCamera and FrameLights blocks of a linked program, if it has them, to their binding points
+    void bindFrameUniformBlocks(unsigned int program);
+
+    // One uniform buffer holding both blocks, written once per frame with a single glBufferSubData.
+    // The lights start at the first offset after the camera that satisfies GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+    class FrameUniformBuffer {
+    public:
+        static constexpr size_t LightSets = 2;
+
+        FrameCamera camera{};
+        FrameLights lights{};
+        // Further sets of lights, for draws lit differently in the same frame. Every set is a block of its
+        // own in the buffer, so those draws do not have to wait for a light to be changed between them and
+        // can be submitted in any order. Set 0 is lights, set i extraLights[i - 1].
+        FrameLights extraLights[LightSets - 1]{};
+
+        FrameUniformBuffer();
+        ~FrameUniformBuffer();
+        FrameUniformBuffer(const FrameUniformBuffer &) = delete;
+        FrameUniformBuffer &operator=(const FrameUniformBuffer &) = delete;
+
+        // uploads camera and lights
+        void update();
+        // the block of a set of lights, for binding it to FRAME_LIGHTS_BINDING. Set 0 is bound by default.
+        UniformBlockRange lightsRange(size_t set) const;
+
+    private:
+        unsigned int m_buffer = 0;
+        size_t m_lightsOffset = 0;
+        size_t m_lightsStride = 0;  // sizeof(FrameLights), aligned
+        std::vector<unsigned char> m_staging;
+    };
+}
+
+#endif //PROJECT_BASE_FRAME_UNIFORMS_H
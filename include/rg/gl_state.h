@@ -0,0 +1,96 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_GL_STATE_H
+#define PROJECT_BASE_GL_STATE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace rg {
+    struct GLStateCounters {
+        uint64_t issued = 0;    // calls that reached the driver
+        uint64_t skipped = 0;   // calls dropped because the state already had the value
+    };
+
+    // Shadow copy of the GL binding and fixed function state the renderer touches. Every bind and
+    // state change of the rg and learnopengl code goes through here, so setting a value the context
+    // already has costs a compare instead of a driver call. Only valid on the thread owning the context.
+    //
+    // The shadow copy is only right as long as nobody changes the state behind its back: code that
+    // does (e.g. the ImGui backend) has to be followed by invalidate(), and GL objects have to be
+    // deleted through the delete* functions, because GL silently unbinds a deleted object and may
+    // hand out its name again.
+    class GLState {
+    public:
+        static GLState &Get() {
+            static GLState state;
+            return state;
+        }
+
+        void useProgram(unsigned int program);
+        void bindVertexArray(unsigned int vertexArray);
+        // GL_ARRAY_BUFFER and GL_UNIFORM_BUFFER are tracked. GL_ELEMENT_ARRAY_BUFFER belongs to the bound
+        // vertex array, it and the other targets are passed through.
+        void bindBuffer(unsigned int target, unsigned int buffer);
+        void bindBufferRange(unsigned int target, unsigned int index, unsigned int buffer, ptrdiff_t offset, ptrdiff_t size);
+        void bindFramebuffer(unsigned int framebuffer);
+
+        // unit is the index, not GL_TEXTURE0 + index
+        void activeTexture(unsigned int unit);
+        // binds to the active unit, GL_TEXTURE_2D and GL_TEXTURE_CUBE_MAP are tracked
+        void bindTexture(unsigned int target, unsigned int texture);
+        // makes unit active (if it is not already) and binds the texture to it
+        void bindTextureUnit(unsigned int unit, unsigned int target, unsigned int texture);
+
+        // GL_DEPTH_TEST, GL_CULL_FACE and GL_BLEND are tracked
+        void setEnabled(unsigned int capability, bool enabled);
+        void cullFace(unsigned int face);
+        void depthFunc(unsigned int function);
+        void blendFunc(unsigned int source, unsigned int destination);
+
+        void deleteProgram(unsigned int program);
+        void deleteVertexArray(unsigned int vertexArray);
+        void deleteBuffer(unsigned int buffer);
+        void deleteFramebuffer(unsigned int framebuffer);
+        void deleteTexture(unsigned int texture);
+
+        // forgets everything, the next call of each kind goes to the driver
+        void invalidate();
+
+        // starts counting a new frame, the counts of the one before stay available in lastFrame()
+        void beginFrame();
+        const GLStateCounters &counters() const { return m_counters; }
+        const GLStateCounters &lastFrame() const { return m_lastFrame; }
+
+        static constexpr unsigned int MaxTrackedTextureUnits = 32;
+
+    private:
+        GLState() { invalidate(); }
+
+        // returns true when the call has to be issued, and records the new value
+        bool change(unsigned int &current, unsigned int value);
+
+        unsigned int m_program;
+        unsigned int m_vertexArray;
+        unsigned int m_arrayBuffer;
+        unsigned int m_uniformBuffer;
+        unsigned int m_framebuffer;
+        unsigned int m_activeUnit;
+        unsigned int m_texture2D[MaxTrackedTextureUnits];
+        unsigned int m_textureCube[MaxTrackedTextureUnits];
+        unsigned int m_depthTest;
+        unsigned int m_cullFace;
+        unsigned int m_blend;
+        unsigned int m_cullFaceMode;
+        unsigned int m_depthFunc;
+        unsigned int m_blendSource;
+        unsigned int m_blendDestination;
+
+        GLStateCounters m_counters;
+        GLStateCounters m_lastFrame;
+    };
+}
+
+#endif //PROJECT_BASE_GL_STATE_H
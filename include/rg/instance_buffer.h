@@ -0,0 +1,39 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_INSTANCE_BUFFER_H
+#define PROJECT_BASE_INSTANCE_BUFFER_H
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+namespace rg {
+    // Per instance model matrices for instanced draws. The matrix is a mat4 vertex attribute with
+    // divisor 1 at locations FirstAttribute .. FirstAttribute + 3, one column per location:
+    //     layout (location = 3) in mat4 aInstanceModel;
+    class InstanceBuffer {
+    public:
+        static constexpr unsigned int FirstAttribute = 3;
+
+        InstanceBuffer();
+        ~InstanceBuffer();
+        InstanceBuffer(const InstanceBuffer &) = delete;
+        InstanceBuffer &operator=(const InstanceBuffer &) = delete;
+
+        // adds the instance attributes to a vertex array, which keeps reading them from this buffer
+        void attach(unsigned int vertexArray);
+        // replaces the transforms. The storage only grows, every upload orphans the old contents so
+        // a buffer updated every frame does not wait for the draws of the previous one.
+        void update(const glm::mat4 *transforms, size_t count);
+        size_t size() const { return m_count; }
+
+    private:
+        unsigned int m_buffer = 0;
+        size_t m_capacity = 0;
+        size_t m_count = 0;
+    };
+}
+
+#endif //PROJECT_BASE_INSTANCE_BUFFER_H
@@ -0,0 +1,125 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_JOB_SYSTEM_H
+#define PROJECT_BASE_JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rg {
+    class JobCounter;
+
+    enum class JobAffinity {
+        Any,        // any worker, or a thread waiting for jobs
+        MainThread  // only the main thread, e.g. for OpenGL calls; see JobSystem::runMainThreadJobs
+    };
+
+    struct Job {
+        std::function<void()> function;
+        JobCounter *counter = nullptr;
+        JobAffinity affinity = JobAffinity::Any;
+    };
+
+    // Counts the unfinished jobs of a group, to wait for them or to start jobs once they are done.
+    // It has to outlive the jobs counted and the jobs waiting for it, i.e. wait() for it before it is
+    // destroyed. A counter can be reused once it is done.
+    class JobCounter {
+    public:
+        JobCounter() = default;
+        JobCounter(const JobCounter &) = delete;
+        JobCounter &operator=(const JobCounter &) = delete;
+
+        bool done() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class JobSystem;
+        std::atomic<unsigned int> m_pending{0};
+        std::mutex m_mutex;
+        std::vector<Job> m_waiting;     // scheduled when m_pending drops to 0
+    };
+
+    struct JobSystemCounters {
+        uint64_t executed = 0;
+        uint64_t stolen = 0;            // taken from the deque of another thread
+        uint64_t mainThread = 0;        // executed by runMainThreadJobs
+    };
+
+    // Work stealing job scheduler. Every worker has a deque of its own: jobs a worker schedules go to the
+    // back of its deque and it takes its next job from the back too, while idle threads steal from the
+    // front of the others, so related jobs stay on one core and the oldest, largest pieces of work are
+    // what moves. Jobs from other threads are dealt out over the workers.
+    //
+    // Jobs with JobAffinity::MainThread are kept apart and only run on the main thread, the one that
+    // constructed the job system, when it calls runMainThreadJobs() or waits. Everything else must never
+    // touch OpenGL, the context is only current on the main thread.
+    class JobSystem {
+    public:
+        // threadCount workers besides the main thread, 0 runs every job on the main thread while it waits
+        explicit JobSystem(unsigned int threadCount = std::thread::hardware_concurrency());
+        // the workers finish the jobs that are scheduled, jobs still waiting for a counter are dropped
+        ~JobSystem();
+        JobSystem(const JobSystem &) = delete;
+        JobSystem &operator=(const JobSystem &) = delete;
+
+        // counter, if any, counts the job from now until it finished
+        void run(std::function<void()> job, JobCounter *counter = nullptr, JobAffinity affinity = JobAffinity::Any);
+        // like run, but the job is only scheduled once dependency is done
+        void runAfter(JobCounter &dependency, std::function<void()> job, JobCounter *counter = nullptr,
+                      JobAffinity affinity = JobAffinity::Any);
+        // runs other jobs until counter is done. The main thread runs main thread jobs too. The jobs run
+        // meanwhile can be any, so a frame should not wait for a counter next to long running jobs.
+        void wait(JobCounter &counter);
+
+        // runs fn(i) for every i in [0, count) and blocks until all are done. The calling thread works
+        // through the indices itself and the workers that are free help, it only ever runs fn.
+        void parallelFor(size_t count, const std::function<void(size_t)> &fn);
+
+        // runs the main thread jobs scheduled so far, returns how many. Main thread only, once a frame.
+        size_t runMainThreadJobs();
+
+        unsigned int threadCount() const { return (unsigned int) m_workers.size(); }
+        bool isMainThread() const { return std::this_thread::get_id() == m_mainThread; }
+        JobSystemCounters counters() const;
+
+    private:
+        struct Worker {
+            std::mutex mutex;
+            std::deque<Job> jobs;
+            std::thread thread;
+        };
+
+        std::vector<std::unique_ptr<Worker>> m_workers;
+        std::thread::id m_mainThread;
+        std::mutex m_mainMutex;
+        std::deque<Job> m_mainJobs;
+        std::atomic<size_t> m_queued{0};        // jobs in the worker deques
+        std::atomic<unsigned int> m_nextWorker{0};
+        std::mutex m_sleepMutex;
+        std::condition_variable m_wake;
+        bool m_stopping = false;
+        std::atomic<uint64_t> m_executed{0};
+        std::atomic<uint64_t> m_stolen{0};
+        std::atomic<uint64_t> m_mainThreadExecuted{0};
+
+        void schedule(Job job);
+        // the worker index of the calling thread, threadCount() for threads that are not workers
+        size_t self() const;
+        bool take(size_t self, Job &job);
+        bool takeMainThreadJob(Job &job);
+        void execute(Job &job);
+        void finish(JobCounter *counter);
+        void workerLoop(size_t index);
+    };
+}
+
+#endif //PROJECT_BASE_JOB_SYSTEM_H
@@ -0,0 +1,80 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_MESH_CACHE_H
+#define PROJECT_BASE_MESH_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+    // 64-bit FNV-1a, used to detect when a source asset has changed since it was cooked.
+    uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 14695981039346656037ull);
+    bool hashFileContents(const std::string &path, uint64_t &hash);
+
+    // Everything that decides whether a cooked file can be reused. If any of these differ
+    // from the header of the cooked file, or one of the dependencies the file lists changed,
+    // the source is imported again.
+    struct CookedModelKey {
+        uint64_t sourceHash = 0;
+        uint32_t importFlags = 0;
+        uint32_t vertexStride = 0;
+    };
+
+    struct CookedTexture {
+        std::string type;
+        std::string path;
+    };
+
+    // View of one mesh inside a mapped cooked file. The pointers stay valid as long as
+    // the CookedModelFile that produced them is alive.
+    struct CookedMesh {
+        const void *vertices = nullptr;
+        uint32_t vertexCount = 0;
+        const void *indices = nullptr;
+        uint32_t indexCount = 0;
+        uint32_t indexSize = 4; // 2 or 4 bytes per index
+        std::vector<CookedTexture> textures;
+    };
+
+    // Binary layout of a cooked model (all offsets are from the start of the file):
+    //   CookedFileHeader
+    //   CookedMeshRecord[meshCount]
+    //   string table (dependency paths, texture type/path records)
+    //   vertex and index blobs, each aligned to 16 bytes
+    class CookedModelFile {
+    public:
+        static constexpr uint32_t Version = 4;
+
+        CookedModelFile() = default;
+        ~CookedModelFile();
+        CookedModelFile(const CookedModelFile &) = delete;
+        CookedModelFile &operator=(const CookedModelFile &) = delete;
+
+        // Maps the cooked file and validates it against the key and the current contents of its
+        // dependencies. Returns false when the file is missing, stale or malformed, in which case
+        // the caller should import the source.
+        bool open(const std::string &cookedPath, const CookedModelKey &key);
+        const std::vector<CookedMesh> &meshes() const { return m_meshes; }
+
+    private:
+        void close();
+
+        void *m_mapping = nullptr;
+        size_t m_mappingSize = 0;
+        std::vector<CookedMesh> m_meshes;
+    };
+
+    // dependencies are the files besides the source the import read, e.g. the material library of
+    // an .obj; their contents are hashed now and again by every open().
+    bool writeCookedModel(const std::string &cookedPath, const CookedModelKey &key,
+                          const std::vector<CookedMesh> &meshes, const std::vector<std::string> &dependencies);
+
+    std::string cookedPathFor(const std::string &sourcePath);
+}
+
+#endif //PROJECT_BASE_MESH_CACHE_H
@@ -0,0 +1,63 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_MESH_OPTIMIZER_H
+#define PROJECT_BASE_MESH_OPTIMIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace rg {
+    // Vertices are treated as opaque blobs of `stride` bytes, the only thing the optimizer needs to
+    // know about the layout is where the float3 position is (for overdraw ordering).
+
+    // Average cache miss ratio: transformed vertices per triangle with a FIFO post-transform cache.
+    // 3.0 is the worst case, ~0.5-0.7 is typical for a well ordered closed mesh.
+    float computeACMR(const uint32_t *indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = 16);
+
+    // merges vertices with identical bytes and remaps the indices. Returns the new vertex count,
+    // the vertices are compacted in place.
+    size_t weldVertices(void *vertices, size_t vertexCount, size_t stride, uint32_t *indices, size_t indexCount);
+
+    // reorders triangles for the post-transform vertex cache (Forsyth, "Linear-speed vertex cache optimisation")
+    void optimizeVertexCache(uint32_t *indices, size_t indexCount, size_t vertexCount);
+
+    // reorders clusters of the (cache optimized) triangles so outward facing, likely occluding parts of the mesh
+    // are drawn first (Sander et al., "Fast triangle reordering for vertex locality and reduced overdraw").
+    // The clusters are split where the vertex cache was flushed, so the cache efficiency is kept.
+    void optimizeOverdraw(uint32_t *indices, size_t indexCount, const void *vertices, size_t vertexCount,
+                          size_t stride, size_t positionOffset);
+
+    // reorders the vertices in the order they are first referenced, so the vertex fetch walks memory
+    // linearly. Unreferenced vertices are dropped; returns the new vertex count.
+    size_t optimizeVertexFetch(void *vertices, size_t vertexCount, size_t stride, uint32_t *indices, size_t indexCount);
+
+    struct MeshOptimizationStats {
+        size_t verticesBefore = 0;
+        size_t verticesAfter = 0;
+        size_t triangles = 0;
+        float acmrBefore = 0.0f;
+        float acmrAfter = 0.0f;
+
+        MeshOptimizationStats &operator+=(const MeshOptimizationStats &other);
+    };
+    std::ostream &operator<<(std::ostream &out, const MeshOptimizationStats &stats);
+
+    // runs all of the above, in the order they have to run in
+    MeshOptimizationStats optimizeMesh(void *vertices, size_t &vertexCount, size_t stride, size_t positionOffset,
+                                       uint32_t *indices, size_t indexCount);
+
+    template<typename TVertex>
+    MeshOptimizationStats optimizeMesh(std::vector<TVertex> &vertices, std::vector<uint32_t> &indices, size_t positionOffset) {
+        size_t vertexCount = vertices.size();
+        MeshOptimizationStats stats = optimizeMesh(vertices.data(), vertexCount, sizeof(TVertex), positionOffset,
+                                                   indices.data(), indices.size());
+        vertices.resize(vertexCount);
+        return stats;
+    }
+}
+
+#endif //PROJECT_BASE_MESH_OPTIMIZER_H
@@ -0,0 +1,121 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_OCCLUSION_H
+#define PROJECT_BASE_OCCLUSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <rg/bounds.h>
+#include <rg/simd.h>
+
+namespace rg {
+    // Low poly stand-in of an opaque object for the occlusion buffer, in the space of the object
+    struct OccluderMesh {
+        std::vector<glm::vec3> vertices;    // three per triangle, counter-clockwise seen from outside
+
+        bool empty() const { return vertices.empty(); }
+        size_t triangleCount() const { return vertices.size() / 3; }
+    };
+
+    // Builds the occluder proxy of a mesh. The triangles are voxelized, the voxels the surface does not pass
+    // through and the outside cannot reach are the inside, and the proxy is the boundary of the inside,
+    // merged into as few rectangles as the grid allows. It lies within the mesh, so it never hides
+    // anything the mesh itself would not. A mesh that is not closed has no inside and no proxy.
+    class OccluderBuilder {
+    public:
+        // positions is the first position, stride bytes apart. indices are indexSize (2 or 4) bytes each,
+        // without them every three positions are a triangle and indexCount is the number of positions.
+        void addTriangles(const void *positions, size_t stride, const void *indices, size_t indexSize, size_t indexCount);
+        void addTriangles(const glm::vec3 *positions, size_t count) {
+            addTriangles(positions, sizeof(glm::vec3), nullptr, 0, count);
+        }
+
+        // resolution is the number of voxels along the longest side of the box of the triangles
+        OccluderMesh build(unsigned int resolution = DefaultResolution) const;
+
+        static constexpr unsigned int DefaultResolution = 24;
+
+    private:
+        std::vector<glm::vec3> m_triangles;
+        Aabb m_box;
+    };
+
+    struct OcclusionCounters {
+        // of the last rasterize()
+        unsigned int occluderTriangles = 0;     // added since begin()
+        unsigned int rasterizedTriangles = 0;   // left after near plane clipping and back face culling
+        double rasterizeMilliseconds = 0.0;
+        // since begin()
+        unsigned int tested = 0;
+        unsigned int occluded = 0;
+    };
+
+    // Coarse depth buffer the occluders are rasterized into on the CPU, to find objects hidden behind them
+    // before they are submitted. The screen is split into tiles: every triangle is binned into the tiles its
+    // screen box touches, and each tile clears and rasterizes its own triangles, so the tiles run on the
+    // job system without sharing a pixel. Depth is NDC z, 1 is the far plane. No OpenGL anywhere.
+    //
+    // A frame: begin(), addOccluder() for every occluder, rasterize(), then visible() for every candidate.
+    // Coverage is sampled at pixel centers, so the answers are exact up to the resolution of the buffer.
+    class OcclusionBuffer {
+    public:
+        // the size is rounded up to whole tiles
+        explicit OcclusionBuffer(unsigned int width = 256, unsigned int height = 144);
+
+        void resize(unsigned int width, unsigned int height);
+        // forgets the occluders of the last frame, the ones added next are seen through viewProjection
+        void begin(const glm::mat4 &viewProjection);
+        // back faces are culled, the mesh has to be closed (as OccluderBuilder makes them)
+        void addOccluder(const OccluderMesh &mesh, const glm::mat4 &model);
+        // without parallel every tile is rasterized on the calling thread
+        void rasterize(bool parallel = true);
+
+        // false when every pixel the world space box covers holds an occluder in front of the nearest
+        // point of the box. A box crossing the near plane or outside the screen is always visible,
+        // the frustum decides about those.
+        bool visible(const Aabb &box);
+
+        unsigned int width() const { return m_width; }
+        unsigned int height() const { return m_height; }
+        // row major, bottom row first
+        const float *depth() const { return m_depth.data(); }
+        const OcclusionCounters &counters() const { return m_counters; }
+
+        // the kernel that runs for a requested level: scalar or SSE (also used for AVX and AVX2)
+        static SimdLevel kernelLevel(SimdLevel requested);
+        SimdLevel simd = bestSimdLevel();
+
+        static constexpr unsigned int TileWidth = 32;   // a multiple of the SSE width
+        static constexpr unsigned int TileHeight = 16;
+
+        // a triangle after setup: edge functions and depth plane in pixels, and its pixel box
+        struct Triangle {
+            float edgeA[3], edgeB[3], edgeC[3];     // edge i is inside where a * x + b * y + c >= 0
+            float depthA, depthB, depthC;           // z = a * x + b * y + c
+            float minDepth, maxDepth;
+            int minX, minY, maxX, maxY;             // inclusive, clamped to the buffer
+        };
+
+    private:
+        unsigned int m_width = 0;
+        unsigned int m_height = 0;
+        unsigned int m_tilesX = 0;
+        unsigned int m_tilesY = 0;
+        std::vector<float> m_depth;
+        glm::mat4 m_viewProjection = glm::mat4(1.0f);
+        std::vector<Triangle> m_triangles;
+        std::vector<std::vector<uint32_t>> m_tileTriangles;
+        OcclusionCounters m_counters;
+
+        void setupTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c);
+        void rasterizeTile(unsigned int tile, SimdLevel level);
+    };
+}
+
+#endif //PROJECT_BASE_OCCLUSION_H
@@ -1,7 +1,11 @@
 #ifndef PROCESSMANAGER_H
 #define PROCESSMANAGER_H
 
+#include<cstddef>
+#include<functional>
+#include<map>
 #include<memory>
+#include<type_traits>
 #include<vector>
 
 namespace rg {
@@ -10,25 +14,40 @@ namespace rg {
         virtual ~ProcessBase() = default;
         virtual void update(float dt) = 0;
         virtual bool isDone() { return false; }
+        // read once, when the process is added
         virtual int priority() { return 0; }
     };
 
+    // Updates the processes once a frame, higher priorities first. The processes live in one bucket
+    // per priority, so a frame only walks the active processes: no sorting, and a finished process is
+    // swapped with the last one of its bucket and popped. Processes of the same priority run in no
+    // particular order.
     class ProcessController {
     public:
         virtual ~ProcessController() = default;
         template<typename T, typename ...Args>
         void pushProcess(Args &&...args);
 
+        // the process starts with the next update
         void pushProcess(std::unique_ptr<ProcessBase> p);
 
         void update(float dt);
+        // processes updated by the last update, and not finished then
+        size_t processCount() const { return m_process_count; }
         ProcessController() {
             m_next_frame_processes.reserve(1024);
-            m_current_frame_processes.reserve(1024);
         }
     private:
-        std::vector<std::unique_ptr<ProcessBase>> m_current_frame_processes;
+        using Bucket = std::vector<std::unique_ptr<ProcessBase>>;
+        std::map<int, Bucket, std::greater<int>> m_buckets;
         std::vector<std::unique_ptr<ProcessBase>> m_next_frame_processes;
+        size_t m_process_count = 0;
     };
+
+    template<typename T, typename ...Args>
+    void ProcessController::pushProcess(Args &&...args) {
+        static_assert(std::is_base_of<ProcessBase, T>::value);
+        m_next_frame_processes.push_back(std::make_unique<T>(std::forward<Args>(args)...));
+    }
 }
 #endif // PROCESSMANAGER_H
@@ -0,0 +1,230 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_RENDER_QUEUE_H
+#define PROJECT_BASE_RENDER_QUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <rg/frame_uniforms.h>
+
+namespace rg {
+    // Coarse order of a frame, the top bits of every sort key
+    enum class RenderPass : uint8_t {
+        Opaque,     // front to back, so the depth test rejects as much as possible early
+        Sky         // drawn last at the far plane, where only uncovered pixels pass
+    };
+
+    enum class CullMode : uint8_t {
+        Back,
+        Front,
+        None
+    };
+
+    enum class DepthTest : uint8_t {
+        Less,
+        LessEqual
+    };
+
+    enum class Primitive : uint8_t {
+        Triangles,
+        Lines
+    };
+
+    // 0 draws without indices
+    enum class IndexType : uint8_t {
+        None,
+        UnsignedShort,
+        UnsignedInt
+    };
+
+    struct TextureBinding {
+        unsigned int unit = 0;
+        unsigned int target = 0;    // GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP
+        unsigned int texture = 0;
+    };
+
+    // Everything one draw needs, so it can be submitted in any order. The per draw uniform values are
+    // kept by the queue (see RenderQueue::uniform).
+    struct DrawPacket {
+        static constexpr unsigned int MaxTextures = 4;
+
+        RenderPass pass = RenderPass::Opaque;
+        unsigned int program = 0;
+        unsigned int vertexArray = 0;       // 0 leaves the bound one, for draws that bind their own
+        TextureBinding textures[MaxTextures];
+        unsigned int textureCount = 0;      // the first texture is the material of the sort key
+        UniformBlockRange uniformBlock;     // bound when its buffer is not 0
+        CullMode cullMode = CullMode::Back;
+        DepthTest depthTest = DepthTest::Less;
+        float depth = 0.0f;                 // distance from the camera, for the order within a pass
+
+        Primitive primitive = Primitive::Triangles;
+        IndexType indexType = IndexType::None;
+        unsigned int count = 0;             // vertices or indices
+        size_t first = 0;                   // first vertex, or the byte offset of the first index
+        int baseVertex = 0;
+        unsigned int instances = 1;         // more than 1 draws instanced
+    };
+
+    struct RenderQueueCounters {
+        unsigned int packets = 0;
+        unsigned int commandBuffers = 0;    // that had packets
+        // binds the submitted order needed, and what the same packets would have needed in the order
+        // they were recorded
+        unsigned int programChanges = 0;
+        unsigned int textureChanges = 0;
+        unsigned int vertexArrayChanges = 0;
+        unsigned int unsortedProgramChanges = 0;
+        unsigned int unsortedTextureChanges = 0;
+        unsigned int unsortedVertexArrayChanges = 0;
+        unsigned int uniformsSkipped = 0;   // uniform values the program already had
+        double recordMilliseconds = 0.0;    // wall clock time of the record() calls
+        double sortMicroseconds = 0.0;
+    };
+
+    // Packets and their uniform values as one thread records them. Nothing in here touches OpenGL, so
+    // a command buffer can be filled on any thread; only one thread may use it at a time.
+    class CommandBuffer {
+    public:
+        void clear();
+
+        // per draw uniforms of the next packet added, set after its program is bound
+        void uniform(int location, int value);
+        void uniform(int location, float value);
+        void uniform(int location, const glm::vec3 &value);
+        void uniform(int location, const glm::mat4 &value);
+
+        void add(const DrawPacket &packet);
+        // a draw the packet cannot describe, e.g. one that binds its own buffers. draw runs on the thread
+        // submitting the queue, with the program, vertex array, textures and render state of the packet
+        // applied; its draw fields are unused.
+        void add(const DrawPacket &packet, std::function<void()> draw);
+
+        size_t size() const { return m_packets.size(); }
+
+        // distances past this all get the largest depth of the key, set by the queue the buffer is of
+        float maxDepth = 100.0f;
+
+    private:
+        friend class RenderQueue;
+
+        enum class UniformType : uint8_t {
+            Int,
+            Float,
+            Vec3,
+            Mat4
+        };
+
+        struct Uniform {
+            int location;
+            UniformType type;
+            uint32_t offset;    // into m_uniformData
+        };
+
+        struct Entry {
+            DrawPacket packet;
+            uint32_t firstUniform;
+            uint32_t uniformCount;
+            uint32_t callback;  // into m_callbacks, NoCallback for none
+        };
+
+        static constexpr uint32_t NoCallback = ~0u;
+
+        std::vector<Entry> m_packets;
+        std::vector<uint64_t> m_keys;
+        std::vector<Uniform> m_uniforms;
+        std::vector<uint32_t> m_uniformData;    // 32 bit words, floats and ints alike
+        uint32_t m_pendingUniforms = 0;         // the first uniform of the next packet
+        std::vector<std::function<void()>> m_callbacks;
+
+        void pushUniform(int location, UniformType type, const void *data, size_t words);
+        void addEntry(const DrawPacket &packet, uint32_t callback);
+    };
+
+    // Draws of a frame, collected from everything that wants to draw and submitted sorted, instead of
+    // a hand written sequence of binds and draws. Every packet gets a 64 bit sort key:
+    //
+    //     63   pass (4) | program (10) | material (16) | vertex array (10) | depth (24)   0
+    //
+    // The GL names are used as they are, they are small numbers handed out in order; a name that does
+    // not fit its bits only costs grouping, not correctness. The keys are radix sorted and the packets
+    // submitted in that order, so draws sharing a program, a texture and a vertex array follow each other
+    // and the binds between them are skipped by GLState.
+    //
+    // The packets are recorded into command buffers. The queue has one of its own for the thread owning
+    // the context (uniform() and add() below), record() fills further ones on the job system. submit()
+    // merges all of them, the result does not depend on which thread recorded what, and replays them on
+    // the thread owning the context, the only one submit() is valid on.
+    class RenderQueue {
+    public:
+        RenderQueue();
+
+        // forgets the packets of the last frame, in every command buffer
+        void clear();
+
+        // record into the command buffer of the calling thread
+        void uniform(int location, int value) { m_buffers[0].uniform(location, value); }
+        void uniform(int location, float value) { m_buffers[0].uniform(location, value); }
+        void uniform(int location, const glm::vec3 &value) { m_buffers[0].uniform(location, value); }
+        void uniform(int location, const glm::mat4 &value) { m_buffers[0].uniform(location, value); }
+        void add(const DrawPacket &packet) { m_buffers[0].add(packet); }
+        void add(const DrawPacket &packet, std::function<void()> draw) { m_buffers[0].add(packet, std::move(draw)); }
+
+        // runs fn(buffer, chunk) for every chunk in [0, chunks), each chunk with a command buffer of its
+        // own, on the job system and blocks until all are done. fn must not touch OpenGL. Without parallel
+        // every chunk runs on the calling thread, into the same buffers.
+        void record(size_t chunks, const std::function<void(CommandBuffer &, size_t)> &fn, bool parallel = true);
+
+        // merges and sorts the command buffers, and counts the changes of the sorted order. Done by
+        // submit(), this is only for looking at the order without a context.
+        void sort();
+        // sorts by key and issues every packet. Leaves back face culling and GL_LESS behind.
+        void submit();
+
+        size_t size() const;
+        const RenderQueueCounters &counters() const { return m_counters; }
+
+        // distances past this all get the largest depth of the key
+        float maxDepth = 100.0f;
+
+        static uint64_t makeKey(const DrawPacket &packet, float maxDepth);
+        // sorts the keys, stable, by 8 bit digits, skipping digits every key has the same value in. A few
+        // keys are insertion sorted instead.
+        // order is replaced by the indices of the keys in sorted order; scratch is reused storage.
+        static void radixSort(const std::vector<uint64_t> &keys, std::vector<uint32_t> &order, std::vector<uint32_t> &scratch);
+
+    private:
+        // a packet of the merged queue
+        struct Ref {
+            uint32_t buffer;
+            uint32_t entry;
+        };
+
+        // a uniform value the current program has, from whichever buffer set it
+        struct SetUniform {
+            int location;
+            CommandBuffer::UniformType type;
+            const uint32_t *data;
+        };
+
+        std::vector<CommandBuffer> m_buffers;   // the first one is for the thread owning the context
+        size_t m_usedBuffers = 1;               // the first buffer not handed out by record() yet
+        std::vector<uint64_t> m_keys;
+        std::vector<Ref> m_refs;
+        std::vector<uint32_t> m_order, m_scratch;
+        RenderQueueCounters m_counters;
+
+        const CommandBuffer::Entry &entry(const Ref &ref) const { return m_buffers[ref.buffer].m_packets[ref.entry]; }
+        void countChanges(const DrawPacket &previous, const DrawPacket &packet, bool sorted);
+        void setUniforms(const CommandBuffer &buffer, const CommandBuffer::Entry &entry, std::vector<SetUniform> &current);
+    };
+}
+
+#endif //PROJECT_BASE_RENDER_QUEUE_H
@@ -9,6 +9,7 @@
 #include <rg/process_controller.h>
 #include <rg/entity_controller.h>
 #include <rg/event_controller.h>
+#include <rg/job_system.h>
 namespace rg {
     class ServiceLocator {
     public:
@@ -16,6 +17,8 @@ namespace rg {
         ProcessController& getProcessController() { return m_ProcessController; }
         EntityController& getEntityController()  { return m_EntityController; }
         EventController& getEventController() { return m_EventController; }
+        // the thread that first calls Get() is the main thread of the job system
+        JobSystem& getJobSystem() { return m_JobSystem; }
         static ServiceLocator& Get() {
             static ServiceLocator serviceLocator;
             return  serviceLocator;
@@ -26,6 +29,7 @@ namespace rg {
         ProcessController m_ProcessController;
         EntityController m_EntityController;
         EventController m_EventController;
+        JobSystem m_JobSystem;
     };
 
 }
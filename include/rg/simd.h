@@ -0,0 +1,34 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_SIMD_H
+#define PROJECT_BASE_SIMD_H
+
+// SSE2 is part of x86-64, its kernels are compiled in whenever the compiler targets it.
+// The AVX kernels are compiled with a target attribute on the function alone and only called after
+// simdSupported() asked the CPU, so the rest of the program still runs on CPUs without AVX.
+#if defined(__SSE2__)
+#define RG_SIMD_SSE 1
+#endif
+#if defined(__x86_64__) && defined(__GNUC__)
+#define RG_SIMD_AVX 1
+#endif
+
+namespace rg {
+    // Instruction sets the SIMD kernels are written for. Every kernel also has a scalar version,
+    // a module without a kernel for the requested level uses the widest one it has below it.
+    enum class SimdLevel {
+        Scalar,
+        Sse,    // SSE2, 4 floats per instruction
+        Avx,    // 8 floats per instruction
+        Avx2    // AVX with 8 wide integer instructions
+    };
+
+    const char *simdLevelName(SimdLevel level);
+    // compiled in and supported by the CPU (and the OS) this runs on
+    bool simdSupported(SimdLevel level);
+    SimdLevel bestSimdLevel();
+}
+
+#endif //PROJECT_BASE_SIMD_H
@@ -0,0 +1,94 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_SNOW_PARTICLES_H
+#define PROJECT_BASE_SNOW_PARTICLES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include <rg/snow_simulation.h>
+#include <rg/uniform_table.h>
+
+namespace rg {
+    // The state of one flake, as the update shader reads and writes it
+    struct SnowParticle {
+        glm::vec4 positionAngle;    // xyz position, w rotation angle
+        glm::vec4 velocityLife;     // xyz velocity, w seconds until respawn
+    };
+
+    // Instance attribute location of the flake position and angle in the snowflake vertex shader.
+    // The quad itself is at locations 0 (position) and 1 (texture coordinates).
+    const unsigned int SNOWFLAKE_INSTANCE_ATTRIBUTE = 3;
+
+    // Snowfall simulated entirely on the GPU. The flake states live in two buffers: every update runs
+    // the update shader over one with the rasterizer disabled and captures the result into the other with
+    // transform feedback, so the CPU never touches a flake after the initial state. Drawing is a single
+    // instanced draw of a quad over the current buffer; the vertex shader culls flakes outside the frustum.
+    // A compute shader path needs GL 4.3, this uses transform feedback, which GL 3.3 has.
+    class SnowParticleSystem {
+    public:
+        SnowParticleSystem(const std::string &updateShaderPath, size_t count, const SnowParameters &parameters = SnowParameters());
+        ~SnowParticleSystem();
+        SnowParticleSystem(const SnowParticleSystem &) = delete;
+        SnowParticleSystem &operator=(const SnowParticleSystem &) = delete;
+
+        // reallocates the buffers for count flakes, scattered over the whole box
+        void resize(size_t count);
+        void update(float deltaTime, float time);
+        // expects the snowflake program to be in use and the flake texture bound
+        void draw();
+
+        size_t size() const { return m_count; }
+        // false when the update program did not build, update() does nothing then
+        bool valid() const { return m_updateProgram != 0; }
+        SnowParameters parameters;
+
+    private:
+        unsigned int m_updateProgram = 0;
+        UniformTable m_uniforms;
+        unsigned int m_quadBuffer = 0;
+        // ping-pong state: update reads m_state[m_current] and writes the other one
+        unsigned int m_state[2] = {};
+        unsigned int m_updateArray[2] = {};
+        unsigned int m_drawArray[2] = {};
+        unsigned int m_current = 0;
+        size_t m_count = 0;
+        uint32_t m_step = 0;
+
+        void createArrays();
+        void deleteArrays();
+    };
+
+    // The same snowfall simulated on the CPU, for when SnowParticleSystem is not valid or not wanted.
+    // Every update runs a SnowSimulation step on the job system, the workers write the flake positions
+    // straight into the mapped instance buffer, which is drawn exactly like the GPU one.
+    class CpuSnowParticleSystem {
+    public:
+        explicit CpuSnowParticleSystem(size_t count, const SnowParameters &parameters = SnowParameters());
+        ~CpuSnowParticleSystem();
+        CpuSnowParticleSystem(const CpuSnowParticleSystem &) = delete;
+        CpuSnowParticleSystem &operator=(const CpuSnowParticleSystem &) = delete;
+
+        void resize(size_t count);
+        void update(float deltaTime, float time);
+        // expects the snowflake program to be in use and the flake texture bound
+        void draw();
+
+        size_t size() const { return m_simulation.size(); }
+        SnowParameters parameters;
+        SnowSimulation &simulation() { return m_simulation; }
+
+    private:
+        SnowSimulation m_simulation;
+        unsigned int m_quadBuffer = 0;
+        unsigned int m_instanceBuffer = 0;   // one vec4 per flake, xyz position and angle
+        unsigned int m_drawArray = 0;
+    };
+}
+
+#endif //PROJECT_BASE_SNOW_PARTICLES_H
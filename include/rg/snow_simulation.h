@@ -0,0 +1,72 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_SNOW_SIMULATION_H
+#define PROJECT_BASE_SNOW_SIMULATION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <rg/simd.h>
+
+namespace rg {
+    struct SnowParameters {
+        // flakes respawn at the top of the box and die when they fall through its bottom
+        glm::vec3 boxMin = glm::vec3(-12.0f, -2.5f, -18.0f);
+        glm::vec3 boxMax = glm::vec3(12.0f, 10.0f, 6.0f);
+        glm::vec3 wind = glm::vec3(0.4f, 0.0f, 0.1f);
+        float gravity = 1.2f;
+        float drag = 1.5f;          // terminal fall speed is gravity / drag
+        float lifetime = 20.0f;     // seconds, at most; flakes are also respawned after it
+        // longest step simulated at once, a long frame (loading, a breakpoint) would otherwise
+        // throw every flake through the floor at once
+        float maxStep = 0.1f;
+    };
+
+    // The snowfall of snowflake_update.vs on the CPU, for when the GPU path is not available.
+    // Every flake attribute is its own array, so the kernels load 4 (SSE) or 8 (AVX) flakes of one
+    // attribute with a single instruction. Steps are split into chunks that run on the job system.
+    // No OpenGL here: the results go to whatever memory step() is given, e.g. a mapped buffer.
+    class SnowSimulation {
+    public:
+        explicit SnowSimulation(size_t count = 0, const SnowParameters &parameters = SnowParameters());
+
+        // count flakes scattered over the whole box, the same initial state as rg::SnowParticleSystem
+        void resize(size_t count);
+        // advances every flake by deltaTime and, when out is given, writes the xyz position and the
+        // angle of flake i to out[i]. Without parallel the whole step runs on the calling thread.
+        void step(float deltaTime, float time, glm::vec4 *out = nullptr, bool parallel = true);
+
+        size_t size() const { return m_count; }
+
+        // the kernel that runs for a requested level: scalar, SSE or AVX (also used for AVX2)
+        static SimdLevel kernelLevel(SimdLevel requested);
+
+        SnowParameters parameters;
+        SimdLevel simd = bestSimdLevel();
+
+        // flakes per job, a multiple of the widest kernel
+        static constexpr size_t ChunkSize = 8192;
+
+        // pointers into the attribute arrays, what the kernels work on
+        struct Lanes {
+            float *x, *y, *z, *angle;
+            float *velocityX, *velocityY, *velocityZ, *life;
+            // per flake constants: the flutter phase as its sine and cosine, and the spin speed
+            float *sinPhase, *cosPhase, *spin;
+        };
+
+    private:
+        std::vector<float> m_x, m_y, m_z, m_angle;
+        std::vector<float> m_velocityX, m_velocityY, m_velocityZ, m_life;
+        std::vector<float> m_sinPhase, m_cosPhase, m_spin;
+        size_t m_count = 0;
+        uint32_t m_step = 0;
+    };
+}
+
+#endif //PROJECT_BASE_SNOW_SIMULATION_H
@@ -0,0 +1,69 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_TEXTURE_COMPRESSION_H
+#define PROJECT_BASE_TEXTURE_COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace rg {
+    // Block compressed formats the CPU encoder produces. All of them work on 4x4 texel blocks.
+    enum class BlockFormat : uint32_t {
+        BC1,    // RGB, 8 bytes per block
+        BC3,    // RGBA, 16 bytes per block
+        BC4,    // single channel, 8 bytes per block
+        BC5     // two channels, 16 bytes per block. Used for tangent space normal maps: only x and y
+                // are stored, z has to be rebuilt in the shader as sqrt(1 - x*x - y*y)
+    };
+
+    // What a texture is sampled as. Decides the block format, so it has to come from where the texture
+    // is used (the material slot), the contents alone can not tell a normal map from a pale blue sky.
+    enum class TextureUsage : uint32_t {
+        Color,      // diffuse, specular, height, ...
+        NormalMap,
+        CubeFace    // compressed like Color, but only level 0: the skybox is never minified
+    };
+
+    size_t blockBytes(BlockFormat format);
+    // the GL internal format enum of the block format (also what a KTX file stores)
+    uint32_t glInternalFormat(BlockFormat format);
+    const char *blockFormatName(BlockFormat format);
+
+    // A block compressed texture with its mip chain (or just level 0), level 0 first.
+    struct CompressedImage {
+        BlockFormat format = BlockFormat::BC1;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<std::vector<unsigned char>> levels;
+
+        size_t byteSize() const;
+    };
+
+    // BC4 for one channel, BC5 for normal maps, otherwise BC3 when some texel is not fully opaque and
+    // BC1 when none is. Returns false for layouts the encoder does not handle (two channels).
+    bool chooseBlockFormat(const unsigned char *pixels, int width, int height, int components, TextureUsage usage,
+                           BlockFormat &format);
+
+    // Generates the mip chain with a box filter and encodes every level, without mipmaps only level 0
+    // is encoded. The block rows of a level are encoded in parallel on the job system.
+    void compressImage(const unsigned char *pixels, int width, int height, int components, BlockFormat format,
+                       bool mipmaps, CompressedImage &image);
+
+    // Single block encoders. rgba holds the 16 texels of the block in row order.
+    void encodeBC1Block(const unsigned char rgba[64], unsigned char out[8]);
+    void encodeBC4Block(const unsigned char values[16], unsigned char out[8]);
+
+    // Cooked textures are KTX 1.1 files next to the source image. The hash of the source file
+    // contents is stored in the key/value data, so a stale file is never used.
+    // The cooked levels are the image as stb_image decoded it, i.e. after its vertical flip.
+    std::string ktxPathFor(const std::string &sourcePath);
+    bool writeKtx(const std::string &path, const CompressedImage &image, uint64_t sourceHash);
+    // returns false when the file is missing, malformed or was cooked from different source contents
+    bool readKtx(const std::string &path, uint64_t sourceHash, CompressedImage &image);
+}
+
+#endif //PROJECT_BASE_TEXTURE_COMPRESSION_H
@@ -0,0 +1,106 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_TEXTURE_LOADER_H
+#define PROJECT_BASE_TEXTURE_LOADER_H
+
+#include <rg/texture_compression.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+    // Raw (still encoded) contents of an image file together with the hash of those contents.
+    struct EncodedImage {
+        std::string path;
+        std::vector<unsigned char> bytes;
+        uint64_t contentHash = 0;
+        double readMs = 0.0;
+        bool ok = false;
+    };
+
+    // Pixels decoded by stb_image, still in CPU memory. Safe to produce on any thread.
+    // With texture compression enabled the image holds the block compressed mip chain instead of pixels.
+    struct DecodedImage {
+        unsigned char *pixels = nullptr;
+        CompressedImage compressed;
+        int width = 0;
+        int height = 0;
+        int components = 0;
+
+        bool empty() const { return !pixels && compressed.levels.empty(); }
+        // bytes the upload moves to the GPU
+        size_t byteSize() const;
+
+        DecodedImage() = default;
+        ~DecodedImage();
+        DecodedImage(DecodedImage &&other) noexcept;
+        DecodedImage &operator=(DecodedImage &&other) noexcept;
+        DecodedImage(const DecodedImage &) = delete;
+        DecodedImage &operator=(const DecodedImage &) = delete;
+    };
+
+    struct TextureLoadTiming {
+        std::string path;
+        int width = 0;
+        int height = 0;
+        double readMs = 0.0;
+        double decodeMs = 0.0;
+        double uploadMs = 0.0;
+        std::string format;     // what was uploaded, e.g. RGB8 or BC1
+        bool cooked = false;    // came from a cooked KTX file, nothing was decoded
+        size_t gpuBytes = 0;
+        bool failed = false;
+    };
+
+    // Block compression of loaded textures. Off until detectTextureCompressionSupport() found the
+    // required extension; decoding then cooks each image into a KTX file next to it (once) and
+    // later loads only read that file.
+    bool detectTextureCompressionSupport(); // GL thread only
+    void setTextureCompressionEnabled(bool enabled);
+    bool textureCompressionEnabled();
+
+    // identifies what decoding contents for a usage produces: the key of cooked files and of cached textures
+    uint64_t cookHashFor(uint64_t contentHash, TextureUsage usage);
+
+    bool readEncodedImage(const std::string &path, EncodedImage &image);
+    // when compression is enabled, usage picks the block format and cooked is set if the image came
+    // from an up to date KTX file
+    bool decodeImage(const EncodedImage &encoded, DecodedImage &image, TextureUsage usage = TextureUsage::Color,
+                     bool *cooked = nullptr);
+    // Creates a mipmapped, repeating 2D texture. Must be called on the thread that owns the GL context.
+    // Compressed images upload their precomputed mips, otherwise the mips are generated.
+    unsigned int uploadTexture(const DecodedImage &image);
+    // Creates a clamped cubemap without mips from six faces in +X, -X, +Y, -Y, +Z, -Z order. The faces
+    // must all have the same format (TextureLoader::uploadCubemap makes sure of that). GL thread only.
+    unsigned int uploadCubemap(const std::vector<DecodedImage> &faces);
+
+    // Loads textures in batches: file reads and stb decodes (or KTX loads) are fanned out over the
+    // job system while the calling (GL) thread only does the glTexImage2D part.
+    class TextureLoader {
+    public:
+        // returns the texture ids in the same order as the paths. A texture that failed to
+        // decode still gets a valid (empty) texture object, like TextureFromFile does.
+        // usages go with the paths by index, images without one are color textures.
+        std::vector<unsigned int> load(const std::vector<std::string> &paths,
+                                       const std::vector<TextureUsage> &usages = {});
+
+        // the separate stages, so a cache can look at the content hashes before paying for decoding
+        std::vector<EncodedImage> read(const std::vector<std::string> &paths);
+        std::vector<DecodedImage> decode(const std::vector<EncodedImage> &images,
+                                         const std::vector<TextureUsage> &usages = {});
+        std::vector<unsigned int> upload2D(const std::vector<EncodedImage> &images,
+                                           const std::vector<TextureUsage> &usages = {});
+        unsigned int uploadCubemap(const std::vector<EncodedImage> &faces);
+
+        const std::vector<TextureLoadTiming> &timings() const { return m_timings; }
+        void printTimings(std::ostream &out) const;
+    private:
+        std::vector<TextureLoadTiming> m_timings;
+    };
+}
+
+#endif //PROJECT_BASE_TEXTURE_LOADER_H
@@ -0,0 +1,101 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_TEXTURE_REGISTRY_H
+#define PROJECT_BASE_TEXTURE_REGISTRY_H
+
+#include <rg/texture_compression.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rg {
+    struct EncodedImage;
+    struct DecodedImage;
+
+    // Shared reference to a texture owned by the TextureRegistry. Copying the handle adds a
+    // reference, destroying it drops one.
+    class TextureHandle {
+        friend class TextureRegistry;
+    public:
+        TextureHandle() = default;
+        ~TextureHandle();
+        TextureHandle(const TextureHandle &other);
+        TextureHandle(TextureHandle &&other) noexcept;
+        TextureHandle &operator=(const TextureHandle &other);
+        TextureHandle &operator=(TextureHandle &&other) noexcept;
+
+        // OpenGL texture name, 0 for an empty handle
+        unsigned int id() const;
+        bool valid() const { return m_slot != InvalidSlot; }
+    private:
+        static constexpr uint32_t InvalidSlot = UINT32_MAX;
+        explicit TextureHandle(uint32_t slot);
+        uint32_t m_slot = InvalidSlot;
+    };
+
+    // Process-wide texture cache. A texture is looked up by its canonical path first and, on a
+    // miss, by the hash of the file contents, so every distinct image is decoded and uploaded once
+    // no matter how many models (or paths) refer to it. Both lookups include the usage, an image
+    // used as a normal map and as a color texture is compressed differently and cached twice.
+    //
+    // Textures whose last handle went away stay resident until purgeUnused() is called from the GL
+    // thread; that way a model reloaded a moment later still hits the cache, and nothing touches
+    // OpenGL from a destructor that may run after the context is gone.
+    class TextureRegistry {
+        friend class TextureHandle;
+    public:
+        static TextureRegistry &Get() {
+            static TextureRegistry textureRegistry;
+            return textureRegistry;
+        }
+
+        TextureHandle acquire(const std::string &path, TextureUsage usage = TextureUsage::Color);
+        // misses in a batch are read and decoded in parallel. usages go with the paths by index,
+        // paths without one are color textures.
+        std::vector<TextureHandle> acquire(const std::vector<std::string> &paths,
+                                           const std::vector<TextureUsage> &usages = {});
+        TextureHandle acquireCubemap(const std::vector<std::string> &faces);
+        // for images that were already read and decoded elsewhere (e.g. on a loading thread), for the
+        // usage they were decoded for; the pixels are only uploaded if neither the path nor the content
+        // is cached yet
+        TextureHandle adopt(const EncodedImage &encoded, const DecodedImage &decoded, TextureUsage usage);
+
+        // deletes all textures nobody holds a handle to anymore. GL thread only.
+        void purgeUnused();
+
+        size_t textureCount() const { return m_entries.size() - m_freeSlots.size(); }
+        size_t hits() const { return m_hits; }
+        size_t misses() const { return m_misses; }
+
+        TextureRegistry(const TextureRegistry &) = delete;
+        TextureRegistry &operator=(const TextureRegistry &) = delete;
+    private:
+        TextureRegistry() = default;
+
+        struct Entry {
+            unsigned int id = 0;
+            uint32_t refCount = 0;
+            uint64_t contentHash = 0;      // the key in m_byContent, content and usage
+            bool alive = false;
+            std::vector<std::string> paths;
+        };
+
+        uint32_t createEntry(unsigned int id, uint64_t contentHash);
+        void addPath(uint32_t slot, const std::string &canonicalPath);
+        void addRef(uint32_t slot) { ++m_entries[slot].refCount; }
+        void release(uint32_t slot) { --m_entries[slot].refCount; }
+
+        std::vector<Entry> m_entries;
+        std::vector<uint32_t> m_freeSlots;
+        std::unordered_map<std::string, uint32_t> m_byPath;
+        std::unordered_map<uint64_t, uint32_t> m_byContent;
+        size_t m_hits = 0;
+        size_t m_misses = 0;
+    };
+}
+
+#endif //PROJECT_BASE_TEXTURE_REGISTRY_H
@@ -0,0 +1,65 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_UNIFORM_TABLE_H
+#define PROJECT_BASE_UNIFORM_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rg {
+    // 64-bit FNV-1a, the same hash as hashBytes, but usable in constant expressions
+    constexpr uint64_t hashUniformName(std::string_view name) {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : name) {
+            hash ^= (unsigned char) c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // A uniform name together with its hash. String literals are hashed at compile time, so
+    // shader.setMat4("view", view) does no hashing at run time; names built at run time
+    // (e.g. "pointLights[" + index + "].ambient") are hashed when they are converted.
+    struct UniformName {
+        uint64_t hash;
+        const char *name;
+
+        template<size_t N>
+        consteval UniformName(const char (&literal)[N])
+                : hash(hashUniformName(std::string_view(literal, N - 1))), name(literal) {}
+
+        UniformName(const std::string &runtimeName)
+                : hash(hashUniformName(runtimeName)), name(nullptr) {}
+    };
+
+    // Flat table of the uniform locations of one program, filled once after linking.
+    // Lookups are a binary search over the sorted hashes, no strings and no GL calls.
+    class UniformTable {
+    public:
+        // enumerates the active uniforms of a linked program with glGetActiveUniform.
+        // Every element of an array is registered, and the array name without [0] as well.
+        void reflect(unsigned int program);
+
+        void add(std::string_view name, int location);
+        // the location of the uniform, -1 (ignored by glUniform*) when the program does not have it
+        int find(uint64_t hash) const;
+
+        size_t size() const { return m_entries.size(); }
+        void clear() { m_entries.clear(); }
+
+    private:
+        struct Entry {
+            uint64_t hash;
+            int location;
+        };
+        // sorted by hash
+        std::vector<Entry> m_entries;
+    };
+}
+
+#endif //PROJECT_BASE_UNIFORM_TABLE_H
@@ -0,0 +1,22 @@
+//
+// Created by matf-rg on 17.10.26..
+//
+
+#ifndef PROJECT_BASE_VERTEX_PACKING_H
+#define PROJECT_BASE_VERTEX_PACKING_H
+
+#include <cstdint>
+
+namespace rg {
+    // Packs a vector with components in [-1, 1] into the GL_INT_2_10_10_10_REV layout
+    // (x in the lowest 10 bits, w in the highest 2). w only holds -1, 0 or 1.
+    uint32_t packSnorm1010102(float x, float y, float z, float w);
+
+    // IEEE 754 binary16, round to nearest even; used for GL_HALF_FLOAT attributes
+    uint16_t floatToHalf(float value);
+
+    // maps [0, 1] to the full range of an unsigned short, for normalized GL_UNSIGNED_SHORT attributes
+    uint16_t quantizeUnorm16(float value);
+}
+
+#endif //PROJECT_BASE_VERTEX_PACKING_H
@@ -1,15 +1,20 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoords;
+layout (location = 3) in mat4 aInstanceModel; // rg::InstanceBuffer, one per instance
 
 out vec2 TexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// per frame camera, shared by all programs (rg::FrameCamera)
+layout (std140) uniform FrameCamera {
+    mat4 projection;
+    mat4 view;
+    mat4 skyboxView;
+    vec3 viewPosition;
+};
 
 void main()
 {
     TexCoords = aTexCoords;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * aInstanceModel * vec4(aPos, 1.0);
 }
@@ -2,38 +2,36 @@
 layout (location = 0) out vec4 FragColor;
 layout (location = 1) out vec4 BrightColor;
 
+// the light structs are ordered so every scalar fills the std140 padding after a vec3,
+// they have to stay in sync with rg::FrameDirLight, rg::FramePointLight and rg::FrameSpotLight
 struct PointLight {
     vec3 position;
-
     float constant;
-    float linear;
-    float quadratic;
-
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
 };
 
 struct DirLight {
+    vec3 direction;
     vec3 ambient;
     vec3 diffuse;
     vec3 specular;
-    vec3 direction;
 };
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
     vec3 ambient;
+    float constant;
     vec3 diffuse;
+    float linear;
     vec3 specular;
+    float quadratic;
 };
 
 struct Material {
@@ -49,10 +47,21 @@ in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
 
-uniform vec3 viewPosition;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
+// per frame camera, shared by all programs (rg::FrameCamera)
+layout (std140) uniform FrameCamera {
+    mat4 projection;
+    mat4 view;
+    mat4 skyboxView;
+    vec3 viewPosition;
+};
+
+// per frame lights (rg::FrameLights)
+layout (std140) uniform FrameLights {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+};
+
 uniform Material material;
 uniform sampler2D diffuseTexture;
 uniform bool blinn;
@@ -8,8 +8,13 @@ out vec3 Normal;
 out vec2 TexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// per frame camera, shared by all programs (rg::FrameCamera)
+layout (std140) uniform FrameCamera {
+    mat4 projection;
+    mat4 view;
+    mat4 skyboxView;
+    vec3 viewPosition;
+};
 
 void main()
 {
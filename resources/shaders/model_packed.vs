@@ -0,0 +1,32 @@
+#version 330 core
+// vertex shader for the packed vertex formats (VertexFormat::Packed / PackedQuantized), also draws VertexFormat::Full
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+
+uniform mat4 model;
+// per frame camera, shared by all programs (rg::FrameCamera)
+layout (std140) uniform FrameCamera {
+    mat4 projection;
+    mat4 view;
+    mat4 skyboxView;
+    vec3 viewPosition;
+};
+
+// dequantizes 16 bit positions; offset 0 and scale 1 for unquantized meshes
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+void main()
+{
+    vec3 position = positionOffset + aPos * positionScale;
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = mat3(transpose(inverse(model))) * aNormal;
+    TexCoords = aTexCoords;
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -3,12 +3,17 @@ layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+// per frame camera, shared by all programs (rg::FrameCamera)
+layout (std140) uniform FrameCamera {
+    mat4 projection;
+    mat4 view;
+    mat4 skyboxView;
+    vec3 viewPosition;
+};
 
 void main()
 {
  TexCoords = aPos;
- vec4 pos = projection * view * vec4(aPos, 1.0);
+ vec4 pos = projection * skyboxView * vec4(aPos, 1.0);
  gl_Position = pos.xyww;
 }
\ No newline at end of file
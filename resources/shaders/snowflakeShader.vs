@@ -1,15 +1,39 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoords;
+layout (location = 3) in vec4 aPositionAngle; // per flake, rg::SnowParticleSystem: xyz position, w rotation angle
 
 out vec2 TexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// per frame camera, shared by all programs (rg::FrameCamera)
+layout (std140) uniform FrameCamera {
+    mat4 projection;
+    mat4 view;
+    mat4 skyboxView;
+    vec3 viewPosition;
+};
+
+uniform float flakeSize;
+uniform float cullDistance;
 
 void main()
 {
     TexCoords = aTexCoords;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+
+    // flakes outside the view frustum or past the cull distance collapse into a point outside the clip
+    // volume, so their quads produce no fragments
+    vec4 clipCenter = projection * view * vec4(aPositionAngle.xyz, 1.0);
+    float margin = flakeSize * max(projection[0][0], projection[1][1]);
+    if (clipCenter.w <= 0.0 || clipCenter.w > cullDistance ||
+        any(greaterThan(abs(clipCenter.xy), vec2(clipCenter.w + margin))))
+    {
+        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+        return;
+    }
+
+    // the quad spins around the vertical axis while it falls
+    float c = cos(aPositionAngle.w);
+    float s = sin(aPositionAngle.w);
+    vec3 corner = vec3(aPos.x * c, aPos.y, aPos.x * s) * flakeSize;
+    gl_Position = projection * view * vec4(aPositionAngle.xyz + corner, 1.0);
+}
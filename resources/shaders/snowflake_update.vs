@@ -0,0 +1,69 @@
+#version 330 core
+// one simulation step of the snowfall (rg::SnowParticleSystem). Runs with GL_RASTERIZER_DISCARD,
+// the next state of every flake is captured with transform feedback.
+layout (location = 0) in vec4 aPositionAngle;   // xyz position, w rotation angle
+layout (location = 1) in vec4 aVelocityLife;    // xyz velocity, w seconds until respawn
+
+out vec4 outPositionAngle;
+out vec4 outVelocityLife;
+
+uniform float deltaTime;
+uniform float time;
+uniform uint seed;          // changes every step, so respawned flakes do not repeat their positions
+
+uniform vec3 boxMin;        // flakes respawn at the top of the box and die below its bottom
+uniform vec3 boxMax;
+uniform vec3 wind;
+uniform float gravity;
+uniform float drag;         // terminal fall speed is gravity / drag
+uniform float lifetime;
+
+uint hash(uint x)
+{
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return x;
+}
+
+// uniform in [0, 1)
+float random(inout uint state)
+{
+    state = hash(state);
+    return float(state >> 8u) * (1.0 / 16777216.0);
+}
+
+void main()
+{
+    vec3 position = aPositionAngle.xyz;
+    float angle = aPositionAngle.w;
+    vec3 velocity = aVelocityLife.xyz;
+    float life = aVelocityLife.w - deltaTime;
+
+    // every flake flutters with its own phase around the wind
+    uint flake = hash(uint(gl_VertexID));
+    float phase = float(flake & 1023u) * (6.2831853 / 1024.0);
+    vec3 air = wind + 0.6 * vec3(sin(time * 1.3 + phase), 0.0, cos(time * 1.7 + phase));
+
+    // drag pulls the flake towards the air velocity, gravity is balanced by it at terminal speed
+    velocity += (air - velocity) * min(drag * deltaTime, 1.0);
+    velocity.y -= gravity * deltaTime;
+    position += velocity * deltaTime;
+    angle += deltaTime * (0.5 + phase * 0.3);
+
+    if (life <= 0.0 || position.y < boxMin.y)
+    {
+        uint state = flake ^ seed;
+        position = vec3(mix(boxMin.x, boxMax.x, random(state)), boxMax.y, mix(boxMin.z, boxMax.z, random(state)));
+        velocity = vec3(air.x, -gravity / drag, air.z);
+        life = lifetime * (0.5 + 0.5 * random(state));
+    }
+    // the wind would blow the whole field out of the box, flakes leaving it come back on the other side
+    vec3 size = boxMax - boxMin;
+    position.xz = boxMin.xz + mod(position.xz - boxMin.xz, size.xz);
+
+    outPositionAngle = vec4(position, angle);
+    outVelocityLife = vec4(velocity, life);
+}
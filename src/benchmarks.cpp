@@ -0,0 +1,753 @@
+#include "rg/benchmarks.h"
+#include "rg/bvh.h"
+#include "rg/culling.h"
+#include "rg/job_system.h"
+#include "rg/occlusion.h"
+#include "rg/process_controller.h"
+#include "rg/render_queue.h"
+#include "rg/service_locator.h"
+#include "rg/snow_simulation.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <initializer_list>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace rg {
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // runs fn at least minRuns times and for at least minSeconds, returns the milliseconds per run
+    template<typename Function>
+    double measure(Function &&fn, int minRuns = 5, double minSeconds = 0.25) {
+        fn();   // warm up caches and the thread pool
+        int runs = 0;
+        Clock::time_point start = Clock::now();
+        double elapsed = 0.0;
+        do {
+            fn();
+            ++runs;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (runs < minRuns || elapsed < minSeconds);
+        return elapsed * 1000.0 / runs;
+    }
+
+    // snowfall steps in particles per millisecond, every kernel on one thread and the best one on the pool
+    int benchmarkParticles() {
+        const size_t counts[] = {10000, 100000, 1000000};
+        const SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::Sse, SimdLevel::Avx};
+        const float deltaTime = 1.0f / 60.0f;
+
+        std::cout << "snowfall step, particles per ms (" << ServiceLocator::Get().getJobSystem().threadCount() << " worker threads)\n";
+        std::cout << std::setw(10) << "particles";
+        for (SimdLevel level : levels) {
+            std::cout << std::setw(12) << simdLevelName(level);
+        }
+        std::cout << std::setw(12) << simdLevelName(SnowSimulation::kernelLevel(bestSimdLevel())) << "+mt" << '\n';
+
+        for (size_t count : counts) {
+            SnowSimulation simulation(count);
+            // stands in for the mapped instance buffer
+            std::vector<glm::vec4> flakes(count);
+            float time = 0.0f;
+            auto rate = [&](SimdLevel level, bool parallel) {
+                simulation.simd = level;
+                double milliseconds = measure([&] {
+                    time += deltaTime;
+                    simulation.step(deltaTime, time, flakes.data(), parallel);
+                });
+                return count / milliseconds;
+            };
+
+            std::cout << std::setw(10) << count << std::fixed << std::setprecision(0);
+            for (SimdLevel level : levels) {
+                if (simdSupported(level))
+                    std::cout << std::setw(12) << rate(level, false);
+                else
+                    std::cout << std::setw(12) << "-";
+            }
+            std::cout << std::setw(15) << rate(bestSimdLevel(), true) << '\n';
+            std::cout.unsetf(std::ios::fixed);
+        }
+        return 0;
+    }
+
+    // frustum culling in objects per microsecond: the per object Frustum::intersects loop against the
+    // CullingBatch kernels, over boxes scattered around a camera that sees about a tenth of them
+    int benchmarkCull() {
+        const size_t counts[] = {100000, 1000000};
+        const SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::Sse, SimdLevel::Avx2};
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 2.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        Frustum frustum = Frustum::fromMatrix(projection * view);
+
+        std::cout << "frustum culling, objects per us\n";
+        std::cout << std::setw(10) << "objects" << std::setw(10) << "visible" << std::setw(12) << "reference";
+        for (SimdLevel level : levels) {
+            std::cout << std::setw(12) << simdLevelName(level);
+        }
+        std::cout << '\n';
+
+        for (size_t count : counts) {
+            std::mt19937 generator(1234);
+            std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+            std::uniform_real_distribution<float> size(0.1f, 1.0f);
+            std::vector<Aabb> boxes(count);
+            CullingBatch batch;
+            batch.reserve(count);
+            for (Aabb &box : boxes) {
+                glm::vec3 center(position(generator), position(generator) * 0.1f, position(generator));
+                glm::vec3 extents(size(generator), size(generator), size(generator));
+                box.min = center - extents;
+                box.max = center + extents;
+                batch.add(box);
+            }
+
+            std::vector<uint32_t> visible;
+            visible.reserve(count + CullingBatch::MaxLanes);
+            double reference = measure([&] {
+                visible.clear();
+                for (size_t i = 0; i < boxes.size(); ++i) {
+                    if (frustum.intersects(boxes[i]))
+                        visible.push_back((uint32_t) i);
+                }
+            });
+            size_t expected = visible.size();
+
+            std::cout << std::setw(10) << count << std::setw(10) << expected << std::fixed << std::setprecision(1)
+                      << std::setw(12) << count / (reference * 1000.0);
+            int result = 0;
+            for (SimdLevel level : levels) {
+                if (!simdSupported(level)) {
+                    std::cout << std::setw(12) << "-";
+                    continue;
+                }
+                double milliseconds = measure([&] { batch.cull(frustum, visible, level); });
+                std::cout << std::setw(12) << count / (milliseconds * 1000.0);
+                if (visible.size() != expected) {
+                    std::cout << " (ERROR::BENCHMARK::CULL_MISMATCH " << visible.size() << ")";
+                    result = 1;
+                }
+            }
+            std::cout << '\n';
+            std::cout.unsetf(std::ios::fixed);
+            if (result)
+                return result;
+        }
+        return 0;
+    }
+
+    // the frustum of benchmarkCull against the scene BVH, and what building and refitting it costs
+    int benchmarkBvh() {
+        const size_t counts[] = {10000, 100000, 1000000};
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 2.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        Frustum frustum = Frustum::fromMatrix(projection * view);
+        Ray ray{glm::vec3(0.0f, 0.5f, 0.0f), glm::normalize(glm::vec3(0.3f, 0.0f, -1.0f))};
+
+        std::cout << "scene BVH, milliseconds\n";
+        std::cout << std::setw(10) << "objects" << std::setw(10) << "visible" << std::setw(10) << "build"
+                  << std::setw(10) << "refit" << std::setw(10) << "flat" << std::setw(10) << "query"
+                  << std::setw(10) << "raycast" << '\n';
+        for (size_t count : counts) {
+            std::mt19937 generator(1234);
+            std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+            std::uniform_real_distribution<float> size(0.1f, 1.0f);
+            std::uniform_real_distribution<float> step(-0.1f, 0.1f);
+            std::vector<Aabb> boxes(count);
+            CullingBatch batch;
+            batch.reserve(count);
+            for (Aabb &box : boxes) {
+                glm::vec3 center(position(generator), position(generator) * 0.1f, position(generator));
+                glm::vec3 extents(size(generator), size(generator), size(generator));
+                box.min = center - extents;
+                box.max = center + extents;
+                batch.add(box);
+            }
+
+            Bvh bvh;
+            double build = measure([&] { bvh.build(boxes); });
+            // a tenth of the objects moves a little every frame
+            std::vector<glm::vec3> steps(count / 10);
+            for (glm::vec3 &offset : steps) {
+                offset = glm::vec3(step(generator), 0.0f, step(generator));
+            }
+            double refit = measure([&] {
+                for (size_t i = 0; i < steps.size(); ++i) {
+                    Aabb box = bvh.box((uint32_t) (i * 10));
+                    box.min += steps[i];
+                    box.max += steps[i];
+                    bvh.update((uint32_t) (i * 10), box);
+                }
+                bvh.refit();
+            });
+            batch.clear();
+            for (size_t i = 0; i < count; ++i) {
+                batch.add(bvh.box((uint32_t) i));
+            }
+
+            std::vector<uint32_t> visible;
+            visible.reserve(count + CullingBatch::MaxLanes);
+            double flat = measure([&] { batch.cull(frustum, visible); });
+            size_t expected = visible.size();
+            double query = measure([&] { bvh.query(frustum, visible); });
+            BvhHit hit;
+            double raycast = measure([&] { bvh.raycast(ray, hit); });
+
+            std::cout << std::setw(10) << count << std::setw(10) << expected << std::fixed << std::setprecision(3)
+                      << std::setw(10) << build << std::setw(10) << refit << std::setw(10) << flat
+                      << std::setw(10) << query << std::setw(10) << raycast << '\n';
+            std::cout.unsetf(std::ios::fixed);
+            if (visible.size() != expected) {
+                std::cout << "ERROR::BENCHMARK::BVH_MISMATCH " << visible.size() << " visible" << std::endl;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    // the 12 triangles of a box, counter-clockwise seen from outside
+    std::vector<glm::vec3> boxTriangles(const Aabb &box) {
+        std::vector<glm::vec3> triangles;
+        const int faces[6][4] = {{0, 4, 6, 2}, {1, 3, 7, 5}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 2, 3, 1}, {4, 5, 7, 6}};
+        for (const int *face : faces) {
+            glm::vec3 corners[4];
+            for (int i = 0; i < 4; ++i) {
+                corners[i] = glm::vec3((face[i] & 1) ? box.max.x : box.min.x, (face[i] & 2) ? box.max.y : box.min.y,
+                                       (face[i] & 4) ? box.max.z : box.min.z);
+            }
+            for (int i : {0, 1, 2, 0, 2, 3}) {
+                triangles.push_back(corners[i]);
+            }
+        }
+        return triangles;
+    }
+
+    // a wall in front of the camera and a field of cubes behind it are the occluders, a field of boxes
+    // all over the view the candidates. Validates the answers: every kernel, serial and on the pool,
+    // has to agree, boxes certainly behind the wall have to be hidden and boxes in front of every
+    // occluder visible. Runs without a GPU.
+    int benchmarkOcclusion() {
+        const size_t occluderCount = 1000;
+        const size_t candidateCount = 100000;
+        const SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::Sse};
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+        glm::mat4 viewProjection = projection * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+        Aabb wall;
+        wall.min = glm::vec3(-8.0f, -4.0f, -23.0f);
+        wall.max = glm::vec3(8.0f, 4.0f, -20.0f);
+        std::vector<glm::vec3> wallTriangles = boxTriangles(wall);
+        OccluderBuilder wallBuilder;
+        wallBuilder.addTriangles(wallTriangles.data(), wallTriangles.size());
+        OccluderMesh wallOccluder = wallBuilder.build();
+        Aabb cube;
+        cube.min = glm::vec3(-0.5f);
+        cube.max = glm::vec3(0.5f);
+        std::vector<glm::vec3> cubeTriangles = boxTriangles(cube);
+        OccluderBuilder cubeBuilder;
+        cubeBuilder.addTriangles(cubeTriangles.data(), cubeTriangles.size());
+        OccluderMesh cubeOccluder = cubeBuilder.build();
+        // the proxy of a box is the box inside it, a rectangle per side
+        if (wallOccluder.triangleCount() != 12 || cubeOccluder.triangleCount() != 12) {
+            std::cout << "ERROR::BENCHMARK::OCCLUDER_PROXY " << wallOccluder.triangleCount() << " and "
+                      << cubeOccluder.triangleCount() << " triangles for boxes" << std::endl;
+            return 1;
+        }
+        Aabb wallInside;
+        for (const glm::vec3 &vertex : wallOccluder.vertices) {
+            wallInside.extend(vertex);
+        }
+        float wallFront = wallInside.max.z;
+
+        std::mt19937 generator(1234);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<glm::mat4> occluders;
+        for (size_t i = 0; i < occluderCount; ++i) {
+            glm::vec3 position(unit(generator) * 80.0f - 40.0f, unit(generator) * 30.0f - 15.0f, -25.0f - unit(generator) * 50.0f);
+            occluders.push_back(glm::translate(glm::mat4(1.0f), position));
+        }
+        std::vector<Aabb> candidates(candidateCount);
+        for (Aabb &box : candidates) {
+            glm::vec3 center(unit(generator) * 80.0f - 40.0f, unit(generator) * 40.0f - 20.0f, -5.0f - unit(generator) * 70.0f);
+            glm::vec3 extents = glm::vec3(unit(generator), unit(generator), unit(generator)) * 0.5f + glm::vec3(0.05f);
+            box.min = center - extents;
+            box.max = center + extents;
+        }
+
+        OcclusionBuffer buffer;
+        auto render = [&](bool parallel) {
+            buffer.begin(viewProjection);
+            buffer.addOccluder(wallOccluder, glm::mat4(1.0f));
+            for (const glm::mat4 &model : occluders) {
+                buffer.addOccluder(cubeOccluder, model);
+            }
+            buffer.rasterize(parallel);
+        };
+        std::vector<char> reference, result(candidateCount);
+        auto testAll = [&] {
+            for (size_t i = 0; i < candidateCount; ++i) {
+                result[i] = buffer.visible(candidates[i]);
+            }
+        };
+
+        std::cout << "occlusion culling, " << buffer.width() << "x" << buffer.height() << " buffer, " << occluderCount + 1
+                  << " occluders, " << candidateCount << " boxes (" << ServiceLocator::Get().getJobSystem().threadCount() << " worker threads)\n";
+        std::cout << std::setw(10) << "kernel" << std::setw(16) << "rasterize ms" << std::setw(16) << "rasterize+mt ms"
+                  << std::setw(14) << "boxes per us" << std::setw(10) << "hidden" << '\n';
+        for (SimdLevel level : levels) {
+            if (!simdSupported(level))
+                continue;
+            buffer.simd = level;
+            double serial = measure([&] { render(false); });
+            testAll();
+            std::vector<char> serialResult = result;
+            double parallel = measure([&] { render(true); });
+            double test = measure(testAll);
+            size_t hidden = std::count(result.begin(), result.end(), 0);
+            std::cout << std::setw(10) << simdLevelName(level) << std::fixed << std::setprecision(3) << std::setw(16) << serial
+                      << std::setw(16) << parallel << std::setprecision(1) << std::setw(14) << candidateCount / (test * 1000.0)
+                      << std::setw(10) << hidden << '\n';
+            std::cout.unsetf(std::ios::fixed);
+            if (serialResult != result || (!reference.empty() && reference != result)) {
+                std::cout << "ERROR::BENCHMARK::OCCLUSION_MISMATCH " << simdLevelName(level) << std::endl;
+                return 1;
+            }
+            reference = result;
+        }
+
+        // checked against the geometry: a box is certainly behind the wall when it is behind the front of its
+        // proxy and seen from the camera, a pixel inside its edges; certainly visible when it is in front of
+        // every occluder
+        float pixel = 2.0f * std::tan(glm::radians(45.0f) * 0.5f) * -wallFront / buffer.height();
+        size_t behind = 0, inFront = 0, errors = 0;
+        for (size_t i = 0; i < candidateCount; ++i) {
+            const Aabb &box = candidates[i];
+            if (box.min.z > wall.max.z) {
+                ++inFront;
+                errors += !reference[i];
+                continue;
+            }
+            if (box.max.z >= wallFront)
+                continue;
+            bool shadowed = true;
+            for (int corner = 0; corner < 8 && shadowed; ++corner) {
+                glm::vec3 p((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y, (corner & 4) ? box.max.z : box.min.z);
+                // where the ray from the camera through the corner crosses the front of the wall
+                glm::vec3 onWall = p * (wallFront / p.z);
+                shadowed = onWall.x > wallInside.min.x + pixel && onWall.x < wallInside.max.x - pixel &&
+                           onWall.y > wallInside.min.y + pixel && onWall.y < wallInside.max.y - pixel;
+            }
+            if (shadowed) {
+                ++behind;
+                errors += reference[i];
+            }
+        }
+        std::cout << behind << " boxes certainly hidden, " << inFront << " certainly visible, " << errors << " wrong\n";
+        if (errors) {
+            std::cout << "ERROR::BENCHMARK::OCCLUSION_WRONG " << errors << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // sorting the keys of render queue packets, the radix sort against std::stable_sort. The packets are
+    // spread over a few programs, textures and vertex arrays, like the draws of a scene. Validates that
+    // both orders are the same and counts the program and texture changes with and without sorting.
+    // Runs without a GPU, only the keys are built.
+    int benchmarkQueue() {
+        const size_t counts[] = {10, 1000, 10000, 100000};
+        std::cout << "render queue sort, microseconds\n";
+        std::cout << std::setw(10) << "packets" << std::setw(10) << "radix" << std::setw(10) << "std"
+                  << std::setw(20) << "programs" << std::setw(20) << "textures" << '\n';
+        for (size_t count : counts) {
+            std::mt19937 generator(1234);
+            std::uniform_int_distribution<unsigned int> program(1, 8);
+            std::uniform_int_distribution<unsigned int> texture(1, 64);
+            std::uniform_int_distribution<unsigned int> vertexArray(1, 32);
+            std::uniform_real_distribution<float> depth(0.0f, 120.0f);
+            std::vector<DrawPacket> packets(count);
+            std::vector<uint64_t> keys(count);
+            for (size_t i = 0; i < count; ++i) {
+                DrawPacket &packet = packets[i];
+                packet.pass = i % 50 == 0 ? RenderPass::Sky : RenderPass::Opaque;
+                packet.program = program(generator);
+                packet.vertexArray = vertexArray(generator);
+                packet.textures[0] = {0, 0x0DE1, texture(generator)};
+                packet.textureCount = 1;
+                packet.depth = depth(generator);
+                keys[i] = RenderQueue::makeKey(packet, 100.0f);
+            }
+
+            std::vector<uint32_t> order, scratch;
+            double radix = measure([&] { RenderQueue::radixSort(keys, order, scratch); }) * 1000.0;
+            std::vector<uint32_t> expected(count);
+            double standard = measure([&] {
+                for (size_t i = 0; i < count; ++i) {
+                    expected[i] = (uint32_t) i;
+                }
+                std::stable_sort(expected.begin(), expected.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+            }) * 1000.0;
+
+            auto changes = [&](const std::vector<uint32_t> &sequence, bool textures) {
+                unsigned int changes = 0;
+                for (size_t i = 0; i < sequence.size(); ++i) {
+                    const DrawPacket &packet = packets[sequence[i]];
+                    changes += !i || (textures ? packets[sequence[i - 1]].textures[0].texture != packet.textures[0].texture
+                                               : packets[sequence[i - 1]].program != packet.program);
+                }
+                return changes;
+            };
+            std::vector<uint32_t> unsorted(count);
+            for (size_t i = 0; i < count; ++i) {
+                unsorted[i] = (uint32_t) i;
+            }
+            std::cout << std::setw(10) << count << std::fixed << std::setprecision(1) << std::setw(10) << radix
+                      << std::setw(10) << standard << std::setw(10) << changes(order, false) << std::setw(10)
+                      << changes(unsorted, false) << std::setw(10) << changes(order, true) << std::setw(10)
+                      << changes(unsorted, true) << '\n';
+            std::cout.unsetf(std::ios::fixed);
+            if (order != expected) {
+                std::cout << "ERROR::BENCHMARK::QUEUE_ORDER " << count << " packets" << std::endl;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    // recording the draws of a scene of many objects of a few meshes each, like Model::Submit does:
+    // model matrix, frustum test of the object and of its meshes in model space, a packet and its
+    // uniforms per visible mesh. Recorded on the calling thread and in chunks on the pool, which has
+    // to give the same queue. Runs without a GPU, the queue is sorted but not submitted.
+    int benchmarkRecord() {
+        const size_t counts[] = {1000, 10000, 100000};
+        const size_t meshesPerObject = 4;
+        const size_t chunks = 64;
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 2.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 viewProjection = projection * view;
+        Frustum frustum = Frustum::fromMatrix(viewProjection);
+        Aabb meshBoxes[meshesPerObject];
+        for (size_t i = 0; i < meshesPerObject; ++i) {
+            meshBoxes[i].min = glm::vec3(-0.5f, (float) i * 0.5f, -0.5f);
+            meshBoxes[i].max = glm::vec3(0.5f, (float) i * 0.5f + 0.5f, 0.5f);
+        }
+        Aabb objectBox;
+        objectBox.min = meshBoxes[0].min;
+        objectBox.max = meshBoxes[meshesPerObject - 1].max;
+
+        std::cout << "render queue recording, " << ServiceLocator::Get().getJobSystem().threadCount() << " threads, milliseconds\n";
+        std::cout << std::setw(10) << "objects" << std::setw(10) << "packets" << std::setw(10) << "serial"
+                  << std::setw(10) << "parallel" << std::setw(10) << "sort" << '\n';
+        for (size_t count : counts) {
+            std::mt19937 generator(1234);
+            std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+            std::uniform_real_distribution<float> angle(0.0f, 6.28f);
+            std::uniform_int_distribution<unsigned int> program(1, 4);
+            std::uniform_int_distribution<unsigned int> texture(1, 32);
+            std::vector<glm::vec3> positions(count);
+            std::vector<float> angles(count);
+            std::vector<unsigned int> programs(count), textures(count);
+            for (size_t i = 0; i < count; ++i) {
+                positions[i] = glm::vec3(position(generator), position(generator) * 0.05f, position(generator));
+                angles[i] = angle(generator);
+                programs[i] = program(generator);
+                textures[i] = texture(generator);
+            }
+
+            auto recordChunk = [&](CommandBuffer &commands, size_t chunk) {
+                size_t begin = count * chunk / chunks;
+                size_t end = count * (chunk + 1) / chunks;
+                for (size_t i = begin; i < end; ++i) {
+                    glm::mat4 model = glm::translate(glm::mat4(1.0f), positions[i]);
+                    model = glm::rotate(model, angles[i], glm::vec3(0.0f, 1.0f, 0.0f));
+                    Aabb box = objectBox.transformed(model);
+                    if (!frustum.intersects(box))
+                        continue;
+                    Frustum local = Frustum::fromMatrix(viewProjection * model);
+                    DrawPacket packet;
+                    packet.program = programs[i];
+                    packet.vertexArray = programs[i];
+                    packet.textures[0] = {0, 0x0DE1, textures[i]};
+                    packet.textureCount = 1;
+                    packet.depth = glm::length(box.center() - glm::vec3(0.0f, 2.0f, 0.0f));
+                    for (size_t mesh = 0; mesh < meshesPerObject; ++mesh) {
+                        if (!local.intersects(meshBoxes[mesh]))
+                            continue;
+                        commands.uniform(0, model);
+                        commands.uniform(1, glm::vec3(0.0f));
+                        commands.uniform(2, glm::vec3(1.0f));
+                        packet.count = 36;
+                        packet.first = mesh * 36 * sizeof(uint16_t);
+                        commands.add(packet);
+                    }
+                }
+            };
+
+            RenderQueue serialQueue, parallelQueue;
+            double serial = measure([&] {
+                serialQueue.clear();
+                serialQueue.record(chunks, recordChunk, false);
+            });
+            double parallel = measure([&] {
+                parallelQueue.clear();
+                parallelQueue.record(chunks, recordChunk);
+            });
+            double sort = measure([&] { parallelQueue.sort(); });
+            serialQueue.sort();
+
+            const RenderQueueCounters &expected = serialQueue.counters();
+            const RenderQueueCounters &counters = parallelQueue.counters();
+            std::cout << std::setw(10) << count << std::setw(10) << counters.packets << std::fixed << std::setprecision(3)
+                      << std::setw(10) << serial << std::setw(10) << parallel << std::setw(10) << sort << '\n';
+            std::cout.unsetf(std::ios::fixed);
+            if (counters.packets != expected.packets || counters.programChanges != expected.programChanges ||
+                counters.textureChanges != expected.textureChanges || counters.vertexArrayChanges != expected.vertexArrayChanges ||
+                counters.unsortedProgramChanges != expected.unsortedProgramChanges) {
+                std::cout << "ERROR::BENCHMARK::RECORD_MISMATCH " << counters.packets << " packets" << std::endl;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    // some arithmetic that takes a few microseconds, standing in for the work of one job
+    uint64_t jobWork(uint64_t seed) {
+        uint64_t value = seed;
+        for (int i = 0; i < 2000; ++i) {
+            value = value * 6364136223846793005ull + 1442695040888963407ull;
+            value ^= value >> 29;
+        }
+        return value;
+    }
+
+    // splits [begin, end) in halves down to single leaves, every half a job of its own that waits for its
+    // children, so the workers have to steal to get anything to do
+    void forkJoin(JobSystem &jobs, uint64_t begin, uint64_t end, std::atomic<uint64_t> &sum) {
+        if (end - begin == 1) {
+            sum.fetch_add(jobWork(begin), std::memory_order_relaxed);
+            return;
+        }
+        uint64_t middle = begin + (end - begin) / 2;
+        JobCounter children;
+        jobs.run([&] { forkJoin(jobs, begin, middle, sum); }, &children);
+        forkJoin(jobs, middle, end, sum);
+        jobs.wait(children);
+    }
+
+    // the job system with 1 to N cores (the main thread and N - 1 workers): a parallel for, a recursive
+    // fork and join, and two stages of jobs where the second starts after the first, ending in a job on
+    // the main thread. Validates that every run computes the same and that main thread jobs run there.
+    int benchmarkJobs() {
+        const size_t items = 4096;
+        unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<unsigned int> coreCounts;
+        for (unsigned int count = 1; count < cores; count *= 2) {
+            coreCounts.push_back(count);
+        }
+        coreCounts.push_back(cores);
+
+        uint64_t expected = 0;
+        for (size_t i = 0; i < items; ++i) {
+            expected += jobWork(i);
+        }
+
+        std::cout << "job system, " << items << " jobs, milliseconds (speedup)\n";
+        std::cout << std::setw(10) << "cores" << std::setw(18) << "parallel for" << std::setw(18) << "fork join"
+                  << std::setw(18) << "two stages" << std::setw(10) << "stolen" << '\n';
+        double single[3] = {};
+        for (unsigned int count : coreCounts) {
+            JobSystem jobs(count - 1);
+            std::vector<uint64_t> results(items);
+            double parallelFor = measure([&] {
+                jobs.parallelFor(items, [&](size_t i) { results[i] = jobWork(i); });
+            });
+            uint64_t parallelSum = 0;
+            for (uint64_t result : results) {
+                parallelSum += result;
+            }
+
+            std::atomic<uint64_t> forkJoinSum{0};
+            double forkJoinTime = measure([&] {
+                forkJoinSum = 0;
+                JobCounter root;
+                jobs.run([&] { forkJoin(jobs, 0, items, forkJoinSum); }, &root);
+                jobs.wait(root);
+            });
+
+            std::atomic<uint64_t> stagesSum{0};
+            bool onMainThread = true;
+            double stages = measure([&] {
+                JobCounter first, second, last;
+                std::fill(results.begin(), results.end(), 0);
+                for (size_t chunk = 0; chunk < 64; ++chunk) {
+                    jobs.run([&, chunk] {
+                        for (size_t i = chunk * items / 64; i < (chunk + 1) * items / 64; ++i) {
+                            results[i] = jobWork(i);
+                        }
+                    }, &first);
+                }
+                stagesSum = 0;
+                for (size_t chunk = 0; chunk < 64; ++chunk) {
+                    jobs.runAfter(first, [&, chunk] {
+                        uint64_t sum = 0;
+                        for (size_t i = chunk * items / 64; i < (chunk + 1) * items / 64; ++i) {
+                            sum += results[i];
+                        }
+                        stagesSum += sum;
+                    }, &second);
+                }
+                jobs.runAfter(second, [&] { onMainThread &= jobs.isMainThread(); }, &last, JobAffinity::MainThread);
+                jobs.wait(last);
+            });
+
+            double times[3] = {parallelFor, forkJoinTime, stages};
+            std::cout << std::setw(10) << count << std::fixed;
+            for (int i = 0; i < 3; ++i) {
+                if (count == 1)
+                    single[i] = times[i];
+                std::cout << std::setprecision(3) << std::setw(10) << times[i] << " (" << std::setprecision(1)
+                          << std::setw(4) << single[i] / times[i] << ")";
+            }
+            std::cout << std::setw(10) << jobs.counters().stolen << '\n';
+            std::cout.unsetf(std::ios::fixed);
+            if (parallelSum != expected || forkJoinSum != expected || stagesSum != expected) {
+                std::cout << "ERROR::BENCHMARK::JOBS_MISMATCH " << count << " cores" << std::endl;
+                return 1;
+            }
+            if (!onMainThread) {
+                std::cout << "ERROR::BENCHMARK::JOBS_NOT_ON_MAIN_THREAD " << count << " cores" << std::endl;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    // a process that lives for a number of frames, its update is a few instructions
+    class BenchmarkProcess : public ProcessBase {
+    public:
+        BenchmarkProcess(int priority, unsigned int frames, uint64_t &updates)
+                : m_priority(priority), m_frames(frames), m_updates(updates) {}
+        void update(float dt) override {
+            ++m_updates;
+            --m_frames;
+        }
+        bool isDone() override { return m_frames == 0; }
+        int priority() override { return m_priority; }
+
+    private:
+        int m_priority;
+        unsigned int m_frames;
+        uint64_t &m_updates;
+    };
+
+    // what ProcessController::update did before the priority buckets
+    class SortedProcessList {
+    public:
+        void push(std::unique_ptr<ProcessBase> process) { m_next.push_back(std::move(process)); }
+        void update(float dt) {
+            m_current.erase(std::remove_if(m_current.begin(), m_current.end(), [](auto &p) { return p->isDone(); }),
+                            m_current.end());
+            std::move(m_next.begin(), m_next.end(), std::back_inserter(m_current));
+            m_next.clear();
+            std::stable_sort(m_current.begin(), m_current.end(),
+                             [](auto &p1, auto &p2) { return p1->priority() > p2->priority(); });
+            for (auto &p : m_current) {
+                p->update(dt);
+            }
+        }
+
+    private:
+        std::vector<std::unique_ptr<ProcessBase>> m_current, m_next;
+    };
+
+    // frames of a steady population of processes with 8 priorities, a few percent of which finish and
+    // are replaced every frame: the old sorted list against the priority buckets. Both have to do the
+    // same number of updates.
+    int benchmarkProcesses() {
+        const size_t counts[] = {10000, 30000, 100000};
+        const int frames = 20;
+        std::cout << "process controller, milliseconds per frame\n";
+        std::cout << std::setw(10) << "processes" << std::setw(10) << "sorted" << std::setw(10) << "buckets" << '\n';
+        for (size_t count : counts) {
+            uint64_t sortedUpdates = 0, bucketUpdates = 0;
+            auto run = [&](auto &&push, auto &&update, uint64_t &updates) {
+                std::mt19937 generator(1234);
+                std::uniform_int_distribution<int> priority(0, 7);
+                std::uniform_int_distribution<unsigned int> lifetime(1, 40);
+                // processes are born so that about as many finish as start every frame
+                auto spawn = [&](size_t processes) {
+                    for (size_t i = 0; i < processes; ++i) {
+                        push(std::make_unique<BenchmarkProcess>(priority(generator), lifetime(generator), updates));
+                    }
+                };
+                spawn(count);
+                update();
+                Clock::time_point start = Clock::now();
+                for (int frame = 0; frame < frames; ++frame) {
+                    spawn(count / 20);
+                    update();
+                }
+                return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+            };
+
+            SortedProcessList sorted;
+            double sortedTime = run([&](std::unique_ptr<ProcessBase> p) { sorted.push(std::move(p)); },
+                                    [&] { sorted.update(0.016f); }, sortedUpdates);
+            ProcessController controller;
+            double bucketTime = run([&](std::unique_ptr<ProcessBase> p) { controller.pushProcess(std::move(p)); },
+                                    [&] { controller.update(0.016f); }, bucketUpdates);
+
+            std::cout << std::setw(10) << count << std::fixed << std::setprecision(3) << std::setw(10) << sortedTime
+                      << std::setw(10) << bucketTime << '\n';
+            std::cout.unsetf(std::ios::fixed);
+            if (sortedUpdates != bucketUpdates) {
+                std::cout << "ERROR::BENCHMARK::PROCESSES_MISMATCH " << sortedUpdates << " and " << bucketUpdates
+                          << " updates" << std::endl;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    struct Benchmark {
+        const char *name;
+        int (*run)();
+    };
+
+    const Benchmark Benchmarks[] = {
+            {"particles", benchmarkParticles},
+            {"cull", benchmarkCull},
+            {"bvh", benchmarkBvh},
+            {"occlusion", benchmarkOcclusion},
+            {"queue", benchmarkQueue},
+            {"record", benchmarkRecord},
+            {"jobs", benchmarkJobs},
+            {"processes", benchmarkProcesses},
+    };
+}
+
+int runBenchmark(const std::string &name) {
+    for (const Benchmark &benchmark : Benchmarks) {
+        if (name == benchmark.name)
+            return benchmark.run();
+    }
+    std::cout << "ERROR::BENCHMARK::UNKNOWN " << name << "\navailable:";
+    for (const Benchmark &benchmark : Benchmarks) {
+        std::cout << ' ' << benchmark.name;
+    }
+    std::cout << std::endl;
+    return 1;
+}
+
+};
@@ -0,0 +1,165 @@
+#include "rg/bounds.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace rg {
+
+Aabb Aabb::transformed(const glm::mat4 &transform) const {
+    if (empty())
+        return *this;
+    // the center moves with the transform, the extents become the sum of the absolute
+    // contributions of every axis (Arvo)
+    glm::vec3 center = glm::vec3(transform * glm::vec4(this->center(), 1.0f));
+    glm::vec3 extents = this->extents();
+    glm::vec3 newExtents(0.0f);
+    for (int axis = 0; axis < 3; ++axis) {
+        newExtents += glm::abs(glm::vec3(transform[axis])) * extents[axis];
+    }
+    Aabb box;
+    box.min = center - newExtents;
+    box.max = center + newExtents;
+    return box;
+}
+
+BoundingSphere BoundingSphere::transformed(const glm::mat4 &transform) const {
+    if (empty())
+        return *this;
+    float scale = std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])),
+                            glm::length(glm::vec3(transform[2]))});
+    BoundingSphere sphere;
+    sphere.center = glm::vec3(transform * glm::vec4(center, 1.0f));
+    sphere.radius = radius * scale;
+    return sphere;
+}
+
+Bounds Bounds::transformed(const glm::mat4 &transform) const {
+    Bounds bounds;
+    bounds.box = box.transformed(transform);
+    bounds.sphere = sphere.transformed(transform);
+    return bounds;
+}
+
+void Bounds::extend(const Bounds &other) {
+    if (other.empty())
+        return;
+    if (empty()) {
+        *this = other;
+        return;
+    }
+    box.extend(other.box);
+
+    glm::vec3 offset = other.sphere.center - sphere.center;
+    float distance = glm::length(offset);
+    if (distance + other.sphere.radius <= sphere.radius)
+        return;
+    if (distance + sphere.radius <= other.sphere.radius) {
+        sphere = other.sphere;
+        return;
+    }
+    // the smallest sphere around both spheres
+    float radius = (distance + sphere.radius + other.sphere.radius) * 0.5f;
+    sphere.center += offset * ((radius - sphere.radius) / distance);
+    sphere.radius = radius;
+}
+
+Bounds computeBounds(const glm::vec3 *points, size_t count, size_t stride) {
+    Bounds bounds;
+    auto point = [points, stride](size_t i) -> const glm::vec3 & {
+        return *reinterpret_cast<const glm::vec3 *>(reinterpret_cast<const unsigned char *>(points) + i * stride);
+    };
+    for (size_t i = 0; i < count; ++i) {
+        bounds.box.extend(point(i));
+    }
+    if (count == 0)
+        return bounds;
+    // centered on the box, which is tighter than the sphere through its corners for most meshes
+    bounds.sphere.center = bounds.box.center();
+    float radiusSquared = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        glm::vec3 offset = point(i) - bounds.sphere.center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    bounds.sphere.radius = std::sqrt(radiusSquared);
+    return bounds;
+}
+
+Bounds computeBounds(const Aabb &box) {
+    Bounds bounds;
+    if (box.empty())
+        return bounds;
+    bounds.box = box;
+    bounds.sphere.center = box.center();
+    bounds.sphere.radius = glm::length(box.extents());
+    return bounds;
+}
+
+bool intersects(const Ray &ray, const Aabb &box, float maxDistance, float &distance) {
+    if (box.empty())
+        return false;
+    float enter = 0.0f;
+    float exit = maxDistance;
+    for (int axis = 0; axis < 3; ++axis) {
+        // a zero direction gives infinities, which the comparisons below handle
+        float inverse = 1.0f / ray.direction[axis];
+        float near = (box.min[axis] - ray.origin[axis]) * inverse;
+        float far = (box.max[axis] - ray.origin[axis]) * inverse;
+        if (near > far)
+            std::swap(near, far);
+        enter = std::max(enter, near);
+        exit = std::min(exit, far);
+        if (enter > exit)
+            return false;
+    }
+    distance = enter;
+    return true;
+}
+
+Frustum Frustum::fromMatrix(const glm::mat4 &matrix) {
+    // Gribb and Hartmann: a point is inside when -w <= x, y, z <= w after the transform, every
+    // plane is the last row of the matrix plus or minus one of the others. glm is column major.
+    auto row = [&matrix](int i) {
+        return glm::vec4(matrix[0][i], matrix[1][i], matrix[2][i], matrix[3][i]);
+    };
+    Frustum frustum;
+    frustum.planes[0] = row(3) + row(0);
+    frustum.planes[1] = row(3) - row(0);
+    frustum.planes[2] = row(3) + row(1);
+    frustum.planes[3] = row(3) - row(1);
+    frustum.planes[4] = row(3) + row(2);
+    frustum.planes[5] = row(3) - row(2);
+    for (glm::vec4 &plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+bool Frustum::intersects(const BoundingSphere &sphere) const {
+    for (const glm::vec4 &plane : planes) {
+        if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+            return false;
+    }
+    return true;
+}
+
+bool Frustum::intersects(const Aabb &box) const {
+    glm::vec3 center = box.center();
+    glm::vec3 extents = box.extents();
+    for (const glm::vec4 &plane : planes) {
+        // distance of the center, and how far the box reaches towards the plane
+        float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+        float reach = glm::dot(glm::abs(glm::vec3(plane)), extents);
+        if (distance + reach < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+bool Frustum::intersects(const Bounds &bounds) const {
+    if (bounds.empty())
+        return true;
+    return intersects(bounds.sphere) && intersects(bounds.box);
+}
+
+};
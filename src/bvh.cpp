@@ -0,0 +1,319 @@
+#include "rg/bvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <utility>
+
+namespace rg {
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // half the surface area, the constant factor does not matter to the heuristic
+    float halfArea(const Aabb &box) {
+        if (box.empty())
+            return 0.0f;
+        glm::vec3 size = box.max - box.min;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+
+    bool sameBox(const Aabb &a, const Aabb &b) {
+        return a.min == b.min && a.max == b.max;
+    }
+
+    // -1 entirely outside the plane, 1 entirely inside, 0 crossing it
+    int classify(const glm::vec4 &plane, const Aabb &box) {
+        if (box.empty())
+            return -1;
+        float distance = glm::dot(glm::vec3(plane), box.center()) + plane.w;
+        float reach = glm::dot(glm::abs(glm::vec3(plane)), box.extents());
+        if (distance + reach < 0.0f)
+            return -1;
+        return distance - reach >= 0.0f ? 1 : 0;
+    }
+}
+
+void Bvh::build(const std::vector<Aabb> &boxes) {
+    Clock::time_point start = Clock::now();
+    clear();
+    m_boxes = boxes;
+    m_objects.resize(boxes.size());
+    std::iota(m_objects.begin(), m_objects.end(), 0u);
+    m_leafOf.assign(boxes.size(), 0);
+    m_centroids.resize(boxes.size());
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        // an empty box has no center, it goes wherever the origin goes until it gets one
+        m_centroids[i] = boxes[i].empty() ? glm::vec3(0.0f) : boxes[i].center();
+    }
+    if (!boxes.empty()) {
+        m_nodes.reserve(2 * boxes.size());
+        Node root;
+        root.objectEnd = (uint32_t) boxes.size();
+        m_nodes.push_back(root);
+        split(0);
+    }
+    m_centroids.clear();
+    m_counters.buildMilliseconds = millisecondsSince(start);
+    ++m_counters.builds;
+}
+
+void Bvh::clear() {
+    m_boxes.clear();
+    m_objects.clear();
+    m_leafOf.clear();
+    m_nodes.clear();
+    m_dirtyLeaves.clear();
+}
+
+void Bvh::split(uint32_t nodeIndex) {
+    // m_nodes grows below, so the node is looked up by index instead of being held by reference
+    uint32_t begin = m_nodes[nodeIndex].objectBegin;
+    uint32_t end = m_nodes[nodeIndex].objectEnd;
+    uint32_t count = end - begin;
+    Aabb box, centroids;
+    for (uint32_t i = begin; i < end; ++i) {
+        box.extend(m_boxes[m_objects[i]]);
+        centroids.extend(m_centroids[m_objects[i]]);
+    }
+    m_nodes[nodeIndex].box = box;
+
+    auto makeLeaf = [&] {
+        for (uint32_t i = begin; i < end; ++i) {
+            m_leafOf[m_objects[i]] = nodeIndex;
+        }
+    };
+    if (count <= MaxLeafSize) {
+        makeLeaf();
+        return;
+    }
+
+    glm::vec3 centroidSize = centroids.max - centroids.min;
+    int axis = 0;
+    if (centroidSize.y > centroidSize[axis])
+        axis = 1;
+    if (centroidSize.z > centroidSize[axis])
+        axis = 2;
+
+    uint32_t middle = begin + count / 2;
+    if (centroidSize[axis] > 0.0f) {
+        // sort the centroids into bins along the axis and sweep the bins from both sides for the cheapest split
+        struct Bin {
+            Aabb box;
+            uint32_t count = 0;
+        };
+        Bin bins[SahBins];
+        float scale = SahBins / centroidSize[axis];
+        auto binOf = [&](uint32_t object) {
+            return std::min(SahBins - 1, (unsigned int) ((m_centroids[object][axis] - centroids.min[axis]) * scale));
+        };
+        for (uint32_t i = begin; i < end; ++i) {
+            Bin &bin = bins[binOf(m_objects[i])];
+            bin.box.extend(m_boxes[m_objects[i]]);
+            ++bin.count;
+        }
+
+        float rightCost[SahBins];
+        Aabb right;
+        uint32_t rightCount = 0;
+        for (unsigned int i = SahBins - 1; i > 0; --i) {
+            right.extend(bins[i].box);
+            rightCount += bins[i].count;
+            rightCost[i] = halfArea(right) * rightCount;
+        }
+        Aabb left;
+        uint32_t leftCount = 0;
+        float bestCost = 0.0f;
+        unsigned int bestSplit = 0;     // the first bin on the right side
+        for (unsigned int i = 1; i < SahBins; ++i) {
+            left.extend(bins[i - 1].box);
+            leftCount += bins[i - 1].count;
+            float cost = halfArea(left) * leftCount + rightCost[i];
+            if (leftCount && leftCount < count && (bestSplit == 0 || cost < bestCost)) {
+                bestCost = cost;
+                bestSplit = i;
+            }
+        }
+
+        // a leaf costs testing every object, a split one traversal step plus the expected tests of the children
+        float leafCost = halfArea(box) * count;
+        float splitCost = halfArea(box) + bestCost;
+        if (bestSplit && splitCost >= leafCost && count <= 4 * MaxLeafSize) {
+            makeLeaf();
+            return;
+        }
+        if (bestSplit) {
+            middle = (uint32_t) (std::partition(m_objects.begin() + begin, m_objects.begin() + end,
+                                                [&](uint32_t object) { return binOf(object) < bestSplit; }) - m_objects.begin());
+        }
+    }
+    // all centroids in one spot (or in one bin): split in the middle, any split is as good as another
+    if (middle == begin || middle == end)
+        middle = begin + count / 2;
+
+    uint32_t leftIndex = (uint32_t) m_nodes.size();
+    Node child;
+    child.parent = nodeIndex;
+    child.objectBegin = begin;
+    child.objectEnd = middle;
+    m_nodes.push_back(child);
+    child.objectBegin = middle;
+    child.objectEnd = end;
+    m_nodes.push_back(child);
+    m_nodes[nodeIndex].left = leftIndex;
+    split(leftIndex);
+    split(leftIndex + 1);
+}
+
+void Bvh::update(uint32_t object, const Aabb &box) {
+    if (sameBox(m_boxes[object], box))
+        return;
+    m_boxes[object] = box;
+    m_dirtyLeaves.push_back(m_leafOf[object]);
+}
+
+void Bvh::refit() {
+    Clock::time_point start = Clock::now();
+    unsigned int recomputed = 0;
+    if (m_dirtyLeaves.size() * 4 > m_nodes.size()) {
+        // with this much moving, one pass over all nodes beats walking up from every leaf.
+        // children come after their parents, so going backwards sees them first.
+        for (size_t i = m_nodes.size(); i-- > 0;) {
+            Node &node = m_nodes[i];
+            node.box = Aabb();
+            if (node.left) {
+                node.box.extend(m_nodes[node.left].box);
+                node.box.extend(m_nodes[node.left + 1].box);
+            } else {
+                for (uint32_t object = node.objectBegin; object < node.objectEnd; ++object) {
+                    node.box.extend(m_boxes[m_objects[object]]);
+                }
+            }
+        }
+        recomputed = m_nodes.size();
+        m_dirtyLeaves.clear();
+    }
+    for (uint32_t leaf : m_dirtyLeaves) {
+        Node &node = m_nodes[leaf];
+        Aabb box;
+        for (uint32_t i = node.objectBegin; i < node.objectEnd; ++i) {
+            box.extend(m_boxes[m_objects[i]]);
+        }
+        ++recomputed;
+        if (sameBox(box, node.box))
+            continue;
+        node.box = box;
+        // up to the root, or to the first node the change does not reach
+        for (uint32_t child = leaf; child != 0;) {
+            Node &parent = m_nodes[m_nodes[child].parent];
+            Aabb parentBox = m_nodes[parent.left].box;
+            parentBox.extend(m_nodes[parent.left + 1].box);
+            ++recomputed;
+            if (sameBox(parentBox, parent.box))
+                break;
+            parent.box = parentBox;
+            child = m_nodes[child].parent;
+        }
+    }
+    m_dirtyLeaves.clear();
+    m_counters.refitMilliseconds = millisecondsSince(start);
+    m_counters.refitNodes = recomputed;
+    ++m_counters.refits;
+}
+
+void Bvh::query(const Frustum &frustum, std::vector<uint32_t> &visible) {
+    visible.clear();
+    m_counters.nodesVisited = 0;
+    m_counters.objectsTested = 0;
+    if (m_nodes.empty())
+        return;
+    m_candidateBoxes.clear();
+    m_candidates.clear();
+    queryNode(0, frustum, (1u << 6) - 1, visible);
+    m_counters.objectsTested = m_candidates.size();
+    m_candidateBoxes.cull(frustum, m_candidatesVisible);
+    for (uint32_t candidate : m_candidatesVisible)
+        visible.push_back(m_candidates[candidate]);
+}
+
+void Bvh::queryNode(uint32_t nodeIndex, const Frustum &frustum, unsigned int planeMask, std::vector<uint32_t> &visible) {
+    ++m_counters.nodesVisited;
+    const Node &node = m_nodes[nodeIndex];
+    // planes the parent was entirely inside of are not in the mask, the children are inside them as well
+    for (int plane = 0; plane < 6; ++plane) {
+        if (!(planeMask & (1u << plane)))
+            continue;
+        int side = classify(frustum.planes[plane], node.box);
+        if (side < 0)
+            return;
+        if (side > 0)
+            planeMask &= ~(1u << plane);
+    }
+    if (planeMask == 0) {
+        for (uint32_t i = node.objectBegin; i < node.objectEnd; ++i) {
+            if (!m_boxes[m_objects[i]].empty())
+                visible.push_back(m_objects[i]);
+        }
+        return;
+    }
+    if (node.left) {
+        queryNode(node.left, frustum, planeMask, visible);
+        queryNode(node.left + 1, frustum, planeMask, visible);
+        return;
+    }
+    // a leaf holds only a few objects, they are tested together with those of the other leaves
+    for (uint32_t i = node.objectBegin; i < node.objectEnd; ++i) {
+        const Aabb &box = m_boxes[m_objects[i]];
+        if (box.empty())
+            continue;
+        m_candidateBoxes.add(box);
+        m_candidates.push_back(m_objects[i]);
+    }
+}
+
+bool Bvh::raycast(const Ray &ray, BvhHit &hit, float maxDistance) const {
+    float distance;
+    if (m_nodes.empty() || !intersects(ray, m_nodes[0].box, maxDistance, distance))
+        return false;
+    bool found = false;
+    // nodes still to visit with the distance the ray enters them, the nearer child is visited first
+    std::vector<std::pair<uint32_t, float>> stack;
+    stack.emplace_back(0, distance);
+    while (!stack.empty()) {
+        auto [nodeIndex, entry] = stack.back();
+        stack.pop_back();
+        if (entry > maxDistance)
+            continue;
+        const Node &node = m_nodes[nodeIndex];
+        if (!node.left) {
+            for (uint32_t i = node.objectBegin; i < node.objectEnd; ++i) {
+                if (intersects(ray, m_boxes[m_objects[i]], maxDistance, distance)) {
+                    maxDistance = distance;
+                    hit.object = m_objects[i];
+                    hit.distance = distance;
+                    found = true;
+                }
+            }
+            continue;
+        }
+        float leftDistance, rightDistance;
+        bool left = intersects(ray, m_nodes[node.left].box, maxDistance, leftDistance);
+        bool right = intersects(ray, m_nodes[node.left + 1].box, maxDistance, rightDistance);
+        if (left && right && leftDistance < rightDistance) {
+            stack.emplace_back(node.left + 1, rightDistance);
+            stack.emplace_back(node.left, leftDistance);
+        } else {
+            if (left)
+                stack.emplace_back(node.left, leftDistance);
+            if (right)
+                stack.emplace_back(node.left + 1, rightDistance);
+        }
+    }
+    return found;
+}
+
+};
@@ -0,0 +1,199 @@
+#include "rg/culling.h"
+
+#include <cmath>
+
+#ifdef RG_SIMD_SSE
+#include <xmmintrin.h>
+#endif
+#ifdef RG_SIMD_AVX
+#include <immintrin.h>
+#endif
+
+namespace rg {
+
+namespace {
+    struct BoxLanes {
+        const float *centerX, *centerY, *centerZ;
+        const float *extentX, *extentY, *extentZ;
+    };
+
+    // the planes split into their components, with the absolute values of the normals precomputed
+    struct PlaneLanes {
+        float x[6], y[6], z[6], w[6];
+        float absX[6], absY[6], absZ[6];
+    };
+
+    using KernelFunction = size_t (*)(const BoxLanes &, size_t, size_t, const PlaneLanes &, uint32_t *);
+
+    // every box is tested against all planes without early out, the visible flag is accumulated with &
+    size_t cullScalar(const BoxLanes &b, size_t begin, size_t end, const PlaneLanes &p, uint32_t *visible) {
+        size_t count = 0;
+        for (size_t i = begin; i < end; ++i) {
+            bool inside = true;
+            for (int plane = 0; plane < 6; ++plane) {
+                float distance = p.x[plane] * b.centerX[i] + p.y[plane] * b.centerY[i] + p.z[plane] * b.centerZ[i] + p.w[plane];
+                float reach = p.absX[plane] * b.extentX[i] + p.absY[plane] * b.extentY[i] + p.absZ[plane] * b.extentZ[i];
+                inside &= distance + reach >= 0.0f;
+            }
+            // written either way, the index only stays when the count moves past it
+            visible[count] = (uint32_t) i;
+            count += inside;
+        }
+        return count;
+    }
+
+#ifdef RG_SIMD_SSE
+    size_t cullSse(const BoxLanes &b, size_t begin, size_t end, const PlaneLanes &p, uint32_t *visible) {
+        size_t count = 0;
+        size_t i = begin;
+        const __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= end; i += 4) {
+            __m128 centerX = _mm_loadu_ps(b.centerX + i), centerY = _mm_loadu_ps(b.centerY + i), centerZ = _mm_loadu_ps(b.centerZ + i);
+            __m128 extentX = _mm_loadu_ps(b.extentX + i), extentY = _mm_loadu_ps(b.extentY + i), extentZ = _mm_loadu_ps(b.extentZ + i);
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int plane = 0; plane < 6; ++plane) {
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x[plane]), centerX),
+                                                        _mm_mul_ps(_mm_set1_ps(p.y[plane]), centerY)),
+                                             _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.z[plane]), centerZ), _mm_set1_ps(p.w[plane])));
+                __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.absX[plane]), extentX),
+                                                     _mm_mul_ps(_mm_set1_ps(p.absY[plane]), extentY)),
+                                          _mm_mul_ps(_mm_set1_ps(p.absZ[plane]), extentZ));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), zero));
+            }
+            int mask = _mm_movemask_ps(inside);
+            // SSE2 has no byte shuffle to pack the lanes, the 4 stores are branch free instead
+            for (int lane = 0; lane < 4; ++lane) {
+                visible[count] = (uint32_t) (i + lane);
+                count += (mask >> lane) & 1;
+            }
+        }
+        return count + cullScalar(b, i, end, p, visible + count);
+    }
+#endif
+
+#ifdef RG_SIMD_AVX
+    // for every 8 bit mask, the lanes of its set bits moved to the front (left packing)
+    struct PackTable {
+        alignas(32) uint32_t lanes[256][8];
+
+        PackTable() {
+            for (int mask = 0; mask < 256; ++mask) {
+                int count = 0;
+                for (int lane = 0; lane < 8; ++lane) {
+                    if (mask & (1 << lane))
+                        lanes[mask][count++] = lane;
+                }
+                for (; count < 8; ++count) {
+                    lanes[mask][count] = 0;
+                }
+            }
+        }
+    };
+    const PackTable packTable;
+
+    __attribute__((target("avx2")))
+    size_t cullAvx2(const BoxLanes &b, size_t begin, size_t end, const PlaneLanes &p, uint32_t *visible) {
+        size_t count = 0;
+        size_t i = begin;
+        const __m256 zero = _mm256_setzero_ps();
+        __m256 planeX[6], planeY[6], planeZ[6], planeW[6], planeAbsX[6], planeAbsY[6], planeAbsZ[6];
+        for (int plane = 0; plane < 6; ++plane) {
+            planeX[plane] = _mm256_set1_ps(p.x[plane]);
+            planeY[plane] = _mm256_set1_ps(p.y[plane]);
+            planeZ[plane] = _mm256_set1_ps(p.z[plane]);
+            planeW[plane] = _mm256_set1_ps(p.w[plane]);
+            planeAbsX[plane] = _mm256_set1_ps(p.absX[plane]);
+            planeAbsY[plane] = _mm256_set1_ps(p.absY[plane]);
+            planeAbsZ[plane] = _mm256_set1_ps(p.absZ[plane]);
+        }
+        const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        for (; i + 8 <= end; i += 8) {
+            __m256 centerX = _mm256_loadu_ps(b.centerX + i), centerY = _mm256_loadu_ps(b.centerY + i), centerZ = _mm256_loadu_ps(b.centerZ + i);
+            __m256 extentX = _mm256_loadu_ps(b.extentX + i), extentY = _mm256_loadu_ps(b.extentY + i), extentZ = _mm256_loadu_ps(b.extentZ + i);
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int plane = 0; plane < 6; ++plane) {
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[plane], centerX), _mm256_mul_ps(planeY[plane], centerY)),
+                                                _mm256_add_ps(_mm256_mul_ps(planeZ[plane], centerZ), planeW[plane]));
+                __m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeAbsX[plane], extentX), _mm256_mul_ps(planeAbsY[plane], extentY)),
+                                             _mm256_mul_ps(planeAbsZ[plane], extentZ));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero, _CMP_GE_OQ));
+            }
+            int mask = _mm256_movemask_ps(inside);
+            // all 8 slots are written, the lanes past the visible ones are overwritten by the next batch
+            __m256i lanes = _mm256_load_si256((const __m256i *) packTable.lanes[mask]);
+            __m256i indices = _mm256_add_epi32(_mm256_set1_epi32((int) i), _mm256_permutevar8x32_epi32(laneIndex, lanes));
+            _mm256_storeu_si256((__m256i *) (visible + count), indices);
+            count += __builtin_popcount(mask);
+        }
+        return count + cullScalar(b, i, end, p, visible + count);
+    }
+#endif
+
+    KernelFunction kernelFunction(SimdLevel level) {
+        switch (level) {
+#ifdef RG_SIMD_SSE
+            case SimdLevel::Sse:
+                return cullSse;
+#endif
+#ifdef RG_SIMD_AVX
+            case SimdLevel::Avx2:
+                return cullAvx2;
+#endif
+            default:
+                return cullScalar;
+        }
+    }
+}
+
+void CullingBatch::clear() {
+    for (std::vector<float> *component : {&m_centerX, &m_centerY, &m_centerZ, &m_extentX, &m_extentY, &m_extentZ}) {
+        component->clear();
+    }
+}
+
+void CullingBatch::reserve(size_t count) {
+    for (std::vector<float> *component : {&m_centerX, &m_centerY, &m_centerZ, &m_extentX, &m_extentY, &m_extentZ}) {
+        component->reserve(count);
+    }
+}
+
+uint32_t CullingBatch::add(const Aabb &box) {
+    glm::vec3 center = box.center();
+    glm::vec3 extents = box.extents();
+    m_centerX.push_back(center.x);
+    m_centerY.push_back(center.y);
+    m_centerZ.push_back(center.z);
+    m_extentX.push_back(extents.x);
+    m_extentY.push_back(extents.y);
+    m_extentZ.push_back(extents.z);
+    return (uint32_t) (m_centerX.size() - 1);
+}
+
+size_t CullingBatch::cull(const Frustum &frustum, std::vector<uint32_t> &visible, SimdLevel simd) const {
+    PlaneLanes planes;
+    for (int plane = 0; plane < 6; ++plane) {
+        const glm::vec4 &p = frustum.planes[plane];
+        planes.x[plane] = p.x;
+        planes.y[plane] = p.y;
+        planes.z[plane] = p.z;
+        planes.w[plane] = p.w;
+        planes.absX[plane] = std::fabs(p.x);
+        planes.absY[plane] = std::fabs(p.y);
+        planes.absZ[plane] = std::fabs(p.z);
+    }
+    BoxLanes boxes{m_centerX.data(), m_centerY.data(), m_centerZ.data(), m_extentX.data(), m_extentY.data(), m_extentZ.data()};
+
+    // room for the kernels writing a whole batch of lanes past the last visible index
+    visible.resize(size() + MaxLanes);
+    size_t count = kernelFunction(kernelLevel(simd))(boxes, 0, size(), planes, visible.data());
+    visible.resize(count);
+    return count;
+}
+
+SimdLevel CullingBatch::kernelLevel(SimdLevel requested) {
+    if (!simdSupported(requested))
+        return SimdLevel::Scalar;
+    return requested == SimdLevel::Avx ? SimdLevel::Sse : requested;
+}
+
+};
@@ -0,0 +1,58 @@
+#include <glad/glad.h>
+
+#include "rg/frame_uniforms.h"
+#include "rg/gl_state.h"
+
+#include <cstring>
+
+namespace rg {
+
+void bindFrameUniformBlocks(unsigned int program) {
+    GLuint cameraBlock = glGetUniformBlockIndex(program, FRAME_CAMERA_BLOCK);
+    if (cameraBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, cameraBlock, FRAME_CAMERA_BINDING);
+    GLuint lightsBlock = glGetUniformBlockIndex(program, FRAME_LIGHTS_BLOCK);
+    if (lightsBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, lightsBlock, FRAME_LIGHTS_BINDING);
+}
+
+FrameUniformBuffer::FrameUniformBuffer() {
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    m_lightsOffset = (sizeof(FrameCamera) + alignment - 1) / alignment * alignment;
+    m_lightsStride = (sizeof(FrameLights) + alignment - 1) / alignment * alignment;
+    m_staging.resize(m_lightsOffset + (LightSets - 1) * m_lightsStride + sizeof(FrameLights));
+
+    GLState &state = GLState::Get();
+    glGenBuffers(1, &m_buffer);
+    state.bindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, m_staging.size(), nullptr, GL_DYNAMIC_DRAW);
+    // the binding points keep the ranges, the buffer is only written from here on
+    state.bindBufferRange(GL_UNIFORM_BUFFER, FRAME_CAMERA_BINDING, m_buffer, 0, sizeof(FrameCamera));
+    state.bindBufferRange(GL_UNIFORM_BUFFER, FRAME_LIGHTS_BINDING, m_buffer, m_lightsOffset, sizeof(FrameLights));
+}
+
+FrameUniformBuffer::~FrameUniformBuffer() {
+    GLState::Get().deleteBuffer(m_buffer);
+}
+
+void FrameUniformBuffer::update() {
+    std::memcpy(m_staging.data(), &camera, sizeof(camera));
+    std::memcpy(m_staging.data() + m_lightsOffset, &lights, sizeof(lights));
+    for (size_t set = 1; set < LightSets; ++set) {
+        std::memcpy(m_staging.data() + m_lightsOffset + set * m_lightsStride, &extraLights[set - 1], sizeof(FrameLights));
+    }
+    GLState::Get().bindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, m_staging.size(), m_staging.data());
+}
+
+UniformBlockRange FrameUniformBuffer::lightsRange(size_t set) const {
+    UniformBlockRange range;
+    range.binding = FRAME_LIGHTS_BINDING;
+    range.buffer = m_buffer;
+    range.offset = m_lightsOffset + set * m_lightsStride;
+    range.size = sizeof(FrameLights);
+    return range;
+}
+
+};
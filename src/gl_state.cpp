@@ -0,0 +1,194 @@
+#include <glad/glad.h>
+
+#include "rg/gl_state.h"
+
+namespace rg {
+
+namespace {
+    // no GL object or enum has this value, so the first call after invalidate() is always issued
+    const unsigned int Unknown = ~0u;
+
+    unsigned int *textureSlot(unsigned int target, unsigned int unit, unsigned int *texture2D, unsigned int *textureCube) {
+        if (unit >= GLState::MaxTrackedTextureUnits)
+            return nullptr;
+        if (target == GL_TEXTURE_2D)
+            return &texture2D[unit];
+        if (target == GL_TEXTURE_CUBE_MAP)
+            return &textureCube[unit];
+        return nullptr;
+    }
+}
+
+bool GLState::change(unsigned int &current, unsigned int value) {
+    if (current == value) {
+        ++m_counters.skipped;
+        return false;
+    }
+    current = value;
+    ++m_counters.issued;
+    return true;
+}
+
+void GLState::useProgram(unsigned int program) {
+    if (change(m_program, program))
+        glUseProgram(program);
+}
+
+void GLState::bindVertexArray(unsigned int vertexArray) {
+    if (change(m_vertexArray, vertexArray))
+        glBindVertexArray(vertexArray);
+}
+
+void GLState::bindBuffer(unsigned int target, unsigned int buffer) {
+    if (target == GL_ARRAY_BUFFER) {
+        if (change(m_arrayBuffer, buffer))
+            glBindBuffer(target, buffer);
+    } else if (target == GL_UNIFORM_BUFFER) {
+        if (change(m_uniformBuffer, buffer))
+            glBindBuffer(target, buffer);
+    } else {
+        ++m_counters.issued;
+        glBindBuffer(target, buffer);
+    }
+}
+
+void GLState::bindBufferRange(unsigned int target, unsigned int index, unsigned int buffer, ptrdiff_t offset, ptrdiff_t size) {
+    // binds the generic binding point of the target as well
+    ++m_counters.issued;
+    glBindBufferRange(target, index, buffer, offset, size);
+    if (target == GL_UNIFORM_BUFFER)
+        m_uniformBuffer = buffer;
+}
+
+void GLState::bindFramebuffer(unsigned int framebuffer) {
+    if (change(m_framebuffer, framebuffer))
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void GLState::activeTexture(unsigned int unit) {
+    if (change(m_activeUnit, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLState::bindTexture(unsigned int target, unsigned int texture) {
+    unsigned int *slot = textureSlot(target, m_activeUnit, m_texture2D, m_textureCube);
+    if (!slot) {
+        ++m_counters.issued;
+        glBindTexture(target, texture);
+    } else if (change(*slot, texture)) {
+        glBindTexture(target, texture);
+    }
+}
+
+void GLState::bindTextureUnit(unsigned int unit, unsigned int target, unsigned int texture) {
+    unsigned int *slot = textureSlot(target, unit, m_texture2D, m_textureCube);
+    if (slot && *slot == texture) {
+        // already bound there, the active unit does not have to change either
+        ++m_counters.skipped;
+        return;
+    }
+    activeTexture(unit);
+    bindTexture(target, texture);
+}
+
+void GLState::setEnabled(unsigned int capability, bool enabled) {
+    unsigned int *current = nullptr;
+    if (capability == GL_DEPTH_TEST)
+        current = &m_depthTest;
+    else if (capability == GL_CULL_FACE)
+        current = &m_cullFace;
+    else if (capability == GL_BLEND)
+        current = &m_blend;
+    if (current && !change(*current, enabled ? 1u : 0u))
+        return;
+    if (!current)
+        ++m_counters.issued;
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+void GLState::cullFace(unsigned int face) {
+    if (change(m_cullFaceMode, face))
+        glCullFace(face);
+}
+
+void GLState::depthFunc(unsigned int function) {
+    if (change(m_depthFunc, function))
+        glDepthFunc(function);
+}
+
+void GLState::blendFunc(unsigned int source, unsigned int destination) {
+    if (m_blendSource == source && m_blendDestination == destination) {
+        ++m_counters.skipped;
+        return;
+    }
+    m_blendSource = source;
+    m_blendDestination = destination;
+    ++m_counters.issued;
+    glBlendFunc(source, destination);
+}
+
+void GLState::deleteProgram(unsigned int program) {
+    if (m_program == program)
+        m_program = Unknown;
+    glDeleteProgram(program);
+}
+
+void GLState::deleteVertexArray(unsigned int vertexArray) {
+    if (m_vertexArray == vertexArray)
+        m_vertexArray = Unknown;
+    glDeleteVertexArrays(1, &vertexArray);
+}
+
+void GLState::deleteBuffer(unsigned int buffer) {
+    if (m_arrayBuffer == buffer)
+        m_arrayBuffer = Unknown;
+    if (m_uniformBuffer == buffer)
+        m_uniformBuffer = Unknown;
+    glDeleteBuffers(1, &buffer);
+}
+
+void GLState::deleteFramebuffer(unsigned int framebuffer) {
+    if (m_framebuffer == framebuffer)
+        m_framebuffer = Unknown;
+    glDeleteFramebuffers(1, &framebuffer);
+}
+
+void GLState::deleteTexture(unsigned int texture) {
+    for (unsigned int unit = 0; unit < MaxTrackedTextureUnits; ++unit) {
+        if (m_texture2D[unit] == texture)
+            m_texture2D[unit] = Unknown;
+        if (m_textureCube[unit] == texture)
+            m_textureCube[unit] = Unknown;
+    }
+    glDeleteTextures(1, &texture);
+}
+
+void GLState::invalidate() {
+    m_program = Unknown;
+    m_vertexArray = Unknown;
+    m_arrayBuffer = Unknown;
+    m_uniformBuffer = Unknown;
+    m_framebuffer = Unknown;
+    m_activeUnit = Unknown;
+    for (unsigned int unit = 0; unit < MaxTrackedTextureUnits; ++unit) {
+        m_texture2D[unit] = Unknown;
+        m_textureCube[unit] = Unknown;
+    }
+    m_depthTest = Unknown;
+    m_cullFace = Unknown;
+    m_blend = Unknown;
+    m_cullFaceMode = Unknown;
+    m_depthFunc = Unknown;
+    m_blendSource = Unknown;
+    m_blendDestination = Unknown;
+}
+
+void GLState::beginFrame() {
+    m_lastFrame = m_counters;
+    m_counters = GLStateCounters{};
+}
+
+};
@@ -0,0 +1,39 @@
+#include <glad/glad.h>
+
+#include "rg/instance_buffer.h"
+#include "rg/gl_state.h"
+
+#include <algorithm>
+
+namespace rg {
+
+InstanceBuffer::InstanceBuffer() {
+    glGenBuffers(1, &m_buffer);
+}
+
+InstanceBuffer::~InstanceBuffer() {
+    GLState::Get().deleteBuffer(m_buffer);
+}
+
+void InstanceBuffer::attach(unsigned int vertexArray) {
+    GLState &state = GLState::Get();
+    state.bindVertexArray(vertexArray);
+    state.bindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    for (unsigned int column = 0; column < 4; ++column) {
+        unsigned int location = FirstAttribute + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *) (column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+}
+
+void InstanceBuffer::update(const glm::mat4 *transforms, size_t count) {
+    GLState::Get().bindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    if (count > m_capacity)
+        m_capacity = std::max(count, m_capacity * 2);
+    glBufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), transforms);
+    m_count = count;
+}
+
+};
@@ -0,0 +1,236 @@
+#include "rg/job_system.h"
+
+#include <algorithm>
+
+namespace rg {
+
+namespace {
+    // the job system a worker thread belongs to and its index there
+    thread_local const JobSystem *t_system = nullptr;
+    thread_local size_t t_worker = 0;
+}
+
+JobSystem::JobSystem(unsigned int threadCount) : m_mainThread(std::this_thread::get_id()) {
+    m_workers.reserve(threadCount);
+    for (unsigned int i = 0; i < threadCount; ++i) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    // the deques all exist before the first worker looks at them
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        m_workers[i]->thread = std::thread([this, i] { workerLoop(i); });
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (auto &worker : m_workers) {
+        worker->thread.join();
+    }
+}
+
+void JobSystem::run(std::function<void()> job, JobCounter *counter, JobAffinity affinity) {
+    if (counter)
+        counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+    schedule({std::move(job), counter, affinity});
+}
+
+void JobSystem::runAfter(JobCounter &dependency, std::function<void()> job, JobCounter *counter, JobAffinity affinity) {
+    if (counter)
+        counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+    Job waiting{std::move(job), counter, affinity};
+    {
+        std::lock_guard<std::mutex> lock(dependency.m_mutex);
+        if (!dependency.done()) {
+            dependency.m_waiting.push_back(std::move(waiting));
+            return;
+        }
+    }
+    schedule(std::move(waiting));
+}
+
+void JobSystem::wait(JobCounter &counter) {
+    size_t index = self();
+    bool mainThread = isMainThread();
+    while (!counter.done()) {
+        Job job;
+        if ((mainThread && takeMainThreadJob(job)) || take(index, job)) {
+            execute(job);
+            continue;
+        }
+        std::this_thread::yield();
+    }
+    // the last finish() may still be leaving the counter, it must be done with it before the caller
+    // is free to destroy it
+    std::lock_guard<std::mutex> lock(counter.m_mutex);
+}
+
+void JobSystem::parallelFor(size_t count, const std::function<void(size_t)> &fn) {
+    if (count == 0)
+        return;
+    if (count == 1 || m_workers.empty()) {
+        for (size_t i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+    // shared with the helper jobs, a helper that only gets to run after all the work is done must
+    // still find valid state to look at
+    struct State {
+        std::atomic<size_t> next{0};
+        size_t remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+    auto state = std::make_shared<State>();
+    state->remaining = count;
+    const std::function<void(size_t)> *work = &fn;
+
+    auto drain = [state, work, count] {
+        size_t finished = 0;
+        for (size_t i = state->next++; i < count; i = state->next++) {
+            (*work)(i);
+            ++finished;
+        }
+        if (finished) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->remaining -= finished;
+            if (state->remaining == 0)
+                state->done.notify_all();
+        }
+    };
+    size_t helpers = std::min<size_t>(count - 1, m_workers.size());
+    for (size_t i = 0; i < helpers; ++i) {
+        run(drain);
+    }
+    // the calling thread works too instead of idling until the workers are done
+    drain();
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&] { return state->remaining == 0; });
+}
+
+size_t JobSystem::runMainThreadJobs() {
+    std::deque<Job> jobs;
+    {
+        std::lock_guard<std::mutex> lock(m_mainMutex);
+        jobs.swap(m_mainJobs);
+    }
+    // jobs these schedule for the main thread wait for the next call
+    for (Job &job : jobs) {
+        execute(job);
+    }
+    m_mainThreadExecuted.fetch_add(jobs.size(), std::memory_order_relaxed);
+    return jobs.size();
+}
+
+JobSystemCounters JobSystem::counters() const {
+    JobSystemCounters counters;
+    counters.executed = m_executed.load(std::memory_order_relaxed);
+    counters.stolen = m_stolen.load(std::memory_order_relaxed);
+    counters.mainThread = m_mainThreadExecuted.load(std::memory_order_relaxed);
+    return counters;
+}
+
+void JobSystem::schedule(Job job) {
+    // without workers the main thread runs everything, when it waits
+    if (job.affinity == JobAffinity::MainThread || m_workers.empty()) {
+        std::lock_guard<std::mutex> lock(m_mainMutex);
+        m_mainJobs.push_back(std::move(job));
+        return;
+    }
+    size_t index = self();
+    if (index == m_workers.size())
+        index = m_nextWorker.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+    Worker &worker = *m_workers[index];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.jobs.push_back(std::move(job));
+    }
+    m_queued.fetch_add(1);
+    // taking the lock orders this with a worker between checking for jobs and going to sleep
+    { std::lock_guard<std::mutex> lock(m_sleepMutex); }
+    m_wake.notify_one();
+}
+
+size_t JobSystem::self() const {
+    return t_system == this ? t_worker : m_workers.size();
+}
+
+bool JobSystem::take(size_t self, Job &job) {
+    size_t workers = m_workers.size();
+    if (self < workers) {
+        Worker &own = *m_workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            m_queued.fetch_sub(1);
+            return true;
+        }
+    }
+    for (size_t i = 1; i <= workers; ++i) {
+        size_t victim = (self + i) % workers;
+        if (victim == self)
+            continue;
+        Worker &other = *m_workers[victim];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.jobs.empty()) {
+            job = std::move(other.jobs.front());
+            other.jobs.pop_front();
+            m_queued.fetch_sub(1);
+            m_stolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JobSystem::takeMainThreadJob(Job &job) {
+    std::lock_guard<std::mutex> lock(m_mainMutex);
+    if (m_mainJobs.empty())
+        return false;
+    job = std::move(m_mainJobs.front());
+    m_mainJobs.pop_front();
+    return true;
+}
+
+void JobSystem::execute(Job &job) {
+    job.function();
+    m_executed.fetch_add(1, std::memory_order_relaxed);
+    finish(job.counter);
+}
+
+void JobSystem::finish(JobCounter *counter) {
+    if (!counter)
+        return;
+    std::vector<Job> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter->m_mutex);
+        if (counter->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            ready.swap(counter->m_waiting);
+    }
+    for (Job &job : ready) {
+        schedule(std::move(job));
+    }
+}
+
+void JobSystem::workerLoop(size_t index) {
+    t_system = this;
+    t_worker = index;
+    for (;;) {
+        Job job;
+        if (take(index, job)) {
+            execute(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wake.wait(lock, [this] { return m_stopping || m_queued.load() > 0; });
+        if (m_stopping && m_queued.load() == 0)
+            return;
+    }
+}
+
+};
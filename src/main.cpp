@@ -15,8 +15,20 @@
 #include <learnopengl/model.h>
 
 #include <iostream>
-
+#include <memory>
+
+#include <rg/benchmarks.h>
+#include <rg/bounds.h>
+#include <rg/bvh.h>
+#include <rg/occlusion.h>
+#include <rg/frame_uniforms.h>
+#include <rg/gl_state.h>
+#include <rg/instance_buffer.h>
+#include <rg/render_queue.h>
+#include <rg/snow_particles.h>
 #include <rg/service_locator.h>
+#include <rg/texture_loader.h>
+#include <rg/texture_registry.h>
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
@@ -29,12 +41,14 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
 
 void renderQuad();
 
-unsigned int loadTexture(char const * path);
-unsigned int loadCubemap(vector <std::string> faces);
+rg::TextureHandle loadTexture(char const * path);
+rg::TextureHandle loadCubemap(vector <std::string> faces);
 
 // settings
 const unsigned int SCR_WIDTH = 1000;
 const unsigned int SCR_HEIGHT = 900;
+// how many bytes of streamed model data may be uploaded to the GPU per frame
+const size_t MODEL_UPLOAD_BUDGET = 8 * 1024 * 1024;
 
 // camera
 
@@ -73,6 +87,14 @@ struct ProgramState {
     float giftScale = 0.5f;
     unsigned int numOfGifts = 4;
 
+    // snowfall
+    int snowflakeCount = 50000;
+    float snowflakeSize = 0.15f;
+    glm::vec3 wind = glm::vec3(0.4f, 0.0f, 0.1f);
+    bool cpuSnow = false;
+
+    bool occlusionCulling = true;
+
     // light settings
     glm::vec3 dirLightDir = glm::vec3(-0.2f, -1.0f, -0.3f);
     glm::vec3 dirLightAmbDiffSpec = glm::vec3(0.3f, 0.3f,0.2f);
@@ -85,6 +107,12 @@ struct ProgramState {
     float exposure = 1.0f;
 
     PointLight pointLight;
+    // what the frustum culling did in the last frame, shown in the Renderer window
+    rg::CullStats culling;
+    rg::BvhCounters sceneCounters;
+    rg::OcclusionCounters occlusion;
+    rg::RenderQueueCounters renderQueue;
+    std::string lookingAt;
     ProgramState()
             : camera(glm::vec3(0.0f, -1.0f, 12.0f)) {}
 
@@ -135,7 +163,10 @@ ProgramState *programState;
 
 void DrawImGui(ProgramState *programState);
 
-int main() {
+int main(int argc, char **argv) {
+    if (argc >= 3 && std::string(argv[1]) == "--bench")
+        return rg::runBenchmark(argv[2]);
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -170,8 +201,13 @@ int main() {
         return -1;
     }
 
+    // every bind and state change goes through the state cache, which drops the redundant ones
+    rg::GLState &glState = rg::GLState::Get();
+
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
     stbi_set_flip_vertically_on_load(true);
+    // block compressed textures, cooked next to their sources on first load
+    rg::detectTextureCompressionSupport();
 
     programState = new ProgramState;
     //programState->LoadFromFile("resources/program_state.txt");
@@ -289,32 +325,6 @@ int main() {
             1.0f, -1.0f,  1.0f
     };
 
-    // snowflake rectangle
-    float transparentVertices[] = {
-            // positions                // texture Coords (swapped y coordinates because texture is flipped upside down)
-            0.0f,  0.5f,  0.0f,  0.0f,  0.0f,
-            0.0f, -0.5f,  0.0f,  0.0f,  1.0f,
-            1.0f, -0.5f,  0.0f,  1.0f,  1.0f,
-
-            0.0f,  0.5f,  0.0f,  0.0f,  0.0f,
-            1.0f, -0.5f,  0.0f,  1.0f,  1.0f,
-            1.0f,  0.5f,  0.0f,  1.0f,  0.0f
-    };
-
-    vector<glm::vec3> snowflakePosition
-    {
-           glm::vec3(-1.0f, 4.0f, -0.45f),
-           glm::vec3( 2.5f, 4.5f, 0.55f),
-           glm::vec3( 0.5f, 4.0f, 0.7f),
-           glm::vec3(1.5f, 4.0f, -2.5f),
-           glm::vec3 (4.5f, 4.5f, -0.5f),
-           glm::vec3(-2.0f, 4.0f, -0.50f),
-           glm::vec3( 2.7f, 3.0f, 0.50f),
-           glm::vec3( 0.5f, 3.0f, 0.7f),
-           glm::vec3(1.5f, 4.0f, -2.5f),
-           glm::vec3 (4.7f, 4.0f, -0.55f)
-    };
-
     float cubeVertices[] = {
             // back face
             -0.5f, -0.5f, -0.5f,  0.0f, 0.0f, // bottom-left
@@ -376,11 +386,11 @@ int main() {
     glGenVertexArrays(1, &giftVAO);
     glGenBuffers(1, &giftVBO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, giftVBO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, giftVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(giftVertices), giftVertices, GL_STATIC_DRAW );
 
 
-    glBindVertexArray(giftVAO);
+    glState.bindVertexArray(giftVAO);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
@@ -390,78 +400,79 @@ int main() {
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)(6*sizeof(float)));
     glEnableVertexAttribArray(2);
 
-    glBindVertexArray(0);
+    glState.bindVertexArray(0);
 
 
     //skybox VAO, VBO
     unsigned int skyboxVAO, skyboxVBO;
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
+    glState.bindVertexArray(skyboxVAO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 
 
-    //snowflake VAO, VBO
-    unsigned int transparentVAO, transparentVBO;
-    glGenVertexArrays(1, &transparentVAO);
-    glGenBuffers(1, &transparentVBO);
-    glBindVertexArray(transparentVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, transparentVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(transparentVertices), transparentVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glBindVertexArray(0);
-
-
     // configure global opengl state
     // -----------------------------
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
+    glState.setEnabled(GL_DEPTH_TEST, true);
+    glState.depthFunc(GL_LESS);
 
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_FRONT);
+    glState.setEnabled(GL_CULL_FACE, true);
+    glState.cullFace(GL_FRONT);
     //glFrontFace(GL_CW);
 
     // build and compile shaders
     // -------------------------
-    Shader modelShader("resources/shaders/model.vs", "resources/shaders/model.fs");
+    Shader modelShader("resources/shaders/model_packed.vs", "resources/shaders/model.fs");
     Shader giftShader("resources/shaders/box.vs", "resources/shaders/box.fs");
     Shader skyboxShader("resources/shaders/skybox.vs", "resources/shaders/skybox.fs");
     Shader snowShader("resources/shaders/snowflakeShader.vs", "resources/shaders/snowflakeShader.fs");
+    // the snowfall is simulated on the GPU, its update program is built by the particle system
+    rg::SnowParticleSystem snow("resources/shaders/snowflake_update.vs", programState->snowflakeCount);
+    // the CPU fallback, only created once it is needed
+    std::unique_ptr<rg::CpuSnowParticleSystem> cpuSnow;
     Shader shader("resources/shaders/face_culling.vs", "resources/shaders/face_culling.fs");
     Shader shaderBlur("resources/shaders/blur.vs", "resources/shaders/blur.fs");
     Shader shaderBloom("resources/shaders/bloom.vs", "resources/shaders/bloom.fs");
+    // camera and lights, shared by all programs through their FrameCamera/FrameLights blocks
+    rg::FrameUniformBuffer frameUniforms;
 
     // load textures
-    unsigned int giftTexture = loadTexture("resources/textures/wrapPaper.png");
-    unsigned int iceTexture = loadTexture("resources/textures/ice_texture.jpg");
-    unsigned int snowflakeTexture = loadTexture("resources/textures/snowflake.png");
+    rg::TextureHandle giftTexture = loadTexture("resources/textures/wrapPaper.png");
+    rg::TextureHandle iceTexture = loadTexture("resources/textures/ice_texture.jpg");
+    rg::TextureHandle snowflakeTexture = loadTexture("resources/textures/snowflake.png");
 
     // load models
     // -----------
-    Model snowManModel("resources/objects/snowman/snowman_finish.obj", true);
-    Model treeModel("resources/objects/Christmas_Tree/Christmas_Tree/12150_Christmas_Tree_V2_L2.obj");
+    // the models are loaded in the background and streamed to the GPU over the first frames,
+    // until then their bounding boxes are drawn instead
+    // nothing reads the meshes back on the CPU, so their vertex and index data is dropped after the upload
+    Model snowManModel("resources/objects/snowman/snowman_finish.obj", true, ModelLoadMode::Streaming, VertexFormat::PackedQuantized,
+                       MeshCpuCopy::Drop);
+    Model treeModel("resources/objects/Christmas_Tree/Christmas_Tree/12150_Christmas_Tree_V2_L2.obj", false, ModelLoadMode::Streaming,
+                    VertexFormat::PackedQuantized, MeshCpuCopy::Drop);
 
     snowManModel.SetShaderTextureNamePrefix("material.");
     treeModel.SetShaderTextureNamePrefix("material.");
+    // the models are recorded on worker threads, which cannot set the sampler uniforms the first time
+    // they are used, so that happens up front
+    modelShader.use();
+    AssignSamplerUnits(modelShader, "material.");
 
     //Bloom-------------------------------------------------------------------------------------------------------------
      // configure framebuffers
      // ---------------------------------------
      unsigned int hdrFBO;
     glGenFramebuffers(1, &hdrFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
+    glState.bindFramebuffer(hdrFBO);
     // create 2 color buffers (1 for normal rendering, other for brightness threshold values)
     unsigned int colorBuffers[2];
     glGenTextures(2, colorBuffers);
     for (unsigned int i = 0; i < 2; i++)
     {
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
+        glState.bindTexture(GL_TEXTURE_2D, colorBuffers[i]);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -476,7 +487,7 @@ int main() {
     glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
     glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
+    glState.bindFramebuffer(hdrFBO);
     unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
     glDrawBuffers(2, attachments);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorBuffers[0], 0);
@@ -484,7 +495,7 @@ int main() {
     // check if framebuffer is complete
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         std::cout << "Framebuffer not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glState.bindFramebuffer(0);
 
     // ping-pong-framebuffer for blurring
     unsigned int pingpongFBO[2];
@@ -493,8 +504,8 @@ int main() {
     glGenTextures(2, pingpongColorbuffers);
     for (unsigned int i = 0; i < 2; i++)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
+        glState.bindFramebuffer(pingpongFBO[i]);
+        glState.bindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -526,7 +537,7 @@ int main() {
         FileSystem::getPath("resources/textures/winter/frost_bk.png")
     };
 
-    unsigned int cubemapTexture = loadCubemap(faces);
+    rg::TextureHandle cubemapTexture = loadCubemap(faces);
 
     modelShader.use();
     modelShader.setInt("diffuseTexture", 0);
@@ -539,15 +550,60 @@ int main() {
     unsigned int cubeVAO, cubeVBO;
     glGenVertexArrays(1, &cubeVAO);
     glGenBuffers(1, &cubeVBO);
-    glBindVertexArray(cubeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+    glState.bindVertexArray(cubeVAO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, cubeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), &cubeVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glBindVertexArray(0);
 
+    // model space bounds of one gift and one cube, every instance is tested with them
+    const rg::Bounds giftBounds = rg::computeBounds((const glm::vec3 *) giftVertices, std::size(giftVertices) / 8, 8 * sizeof(float));
+    const rg::Bounds cubeBounds = rg::computeBounds((const glm::vec3 *) cubeVertices, std::size(cubeVertices) / 5, 5 * sizeof(float));
+    // the snowman and the tree bring their occluders along, the ice cubes are the only other opaque
+    // objects (the gifts are alpha tested)
+    rg::OccluderBuilder cubeOccluderBuilder;
+    cubeOccluderBuilder.addTriangles(cubeVertices, 5 * sizeof(float), nullptr, 0, std::size(cubeVertices) / 5);
+    const rg::OccluderMesh cubeOccluder = cubeOccluderBuilder.build();
+    rg::OcclusionBuffer occlusion;
+
+    // per instance transforms, each object type is drawn with one instanced call
+    rg::InstanceBuffer giftInstances;
+    rg::InstanceBuffer cubeInstances;
+    giftInstances.attach(giftVAO);
+    cubeInstances.attach(cubeVAO);
+    glState.bindVertexArray(0);
+
+    // every object of the scene is an object of the scene BVH, which culls them against the frustum and
+    // picks the one the camera looks at: the two models, every gift slot and every ice cube
+    const uint32_t SnowManObject = 0;
+    const uint32_t TreeObject = 1;
+    const uint32_t FirstGiftObject = 2;
+    const uint32_t FirstCubeObject = FirstGiftObject + std::size(giftPositions);
+    vector<rg::Aabb> sceneBoxes(FirstCubeObject + cubePosition.size());
+    vector<std::string> sceneObjectNames(sceneBoxes.size());
+    sceneObjectNames[SnowManObject] = "snowman";
+    sceneObjectNames[TreeObject] = "tree";
+    for (size_t i = 0; i < std::size(giftPositions); i++)
+        sceneObjectNames[FirstGiftObject + i] = "gift " + std::to_string(i + 1);
+    rg::Bvh sceneBvh;
+    bool sceneBuilt = false;
+    vector<uint32_t> visibleObjects;
+    vector<bool> objectVisible;
+
+    // the ice cubes never move, their instance buffer is only rewritten when the set of visible ones changes
+    vector<glm::mat4> cubeTransforms;
+    for (size_t i = 0; i < cubePosition.size(); i++) {
+        cubeTransforms.push_back(glm::translate(glm::mat4(1.0f), cubePosition[i]));
+        sceneBoxes[FirstCubeObject + i] = cubeBounds.box.transformed(cubeTransforms.back());
+        sceneObjectNames[FirstCubeObject + i] = "ice cube " + std::to_string(i + 1);
+    }
+    vector<uint32_t> visibleCubes, uploadedCubes;
+    vector<glm::mat4> visibleCubeTransforms;
+    uploadedCubes.push_back(UINT32_MAX);    // nothing uploaded yet
+    vector<glm::mat4> giftTransforms, visibleGiftTransforms;
+    rg::RenderQueue renderQueue;
 
 
     // shader configuration
@@ -583,156 +639,294 @@ int main() {
         processInput(window);
 
         rg::ServiceLocator::Get().getProcessController().update(deltaTime);
+        // whatever the workers left for the GL thread, e.g. uploads of what they loaded
+        rg::ServiceLocator::Get().getJobSystem().runMainThreadJobs();
+        glState.beginFrame();
 
 
         programState->camera.update(deltaTime);
 
+        UploadBudget uploadBudget(MODEL_UPLOAD_BUDGET);
+        snowManModel.StreamUploads(uploadBudget);
+        treeModel.StreamUploads(uploadBudget);
+
         // render
         // ------
         glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
+        glState.bindFramebuffer(hdrFBO);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        modelShader.use();
         // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),
-                                                (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = programState->camera.GetViewMatrix();
-        modelShader.setMat4("projection", projection);
-        modelShader.setMat4("view", view);
-
-        modelShader.setVec3("viewPosition", programState->camera.Position);
-        modelShader.setFloat("material.shininess", 32.0f);
-        // directional light
-        modelShader.setVec3("dirLight.direction", programState->dirLightDir);
-        modelShader.setVec3("dirLight.ambient", glm::vec3(programState->dirLightAmbDiffSpec.x));
-        modelShader.setVec3("dirLight.diffuse", glm::vec3(programState->dirLightAmbDiffSpec.y));
-        modelShader.setVec3("dirLight.specular", glm::vec3(programState->dirLightAmbDiffSpec.z));
-
-        modelShader.setVec3("pointLights[0].position", glm::vec3(-5.0f, -10.0f,-5.0f));
-        modelShader.setVec3("pointLights[0].ambient", pointLight.ambient);
-        modelShader.setVec3("pointLights[0].diffuse", pointLight.diffuse);
-        modelShader.setVec3("pointLights[0].specular", pointLight.specular);
-        modelShader.setFloat("pointLights[0].constant", pointLight.constant);
-        modelShader.setFloat("pointLights[0].linear", pointLight.linear);
-        modelShader.setFloat("pointLights[0].quadratic", pointLight.quadratic);
-
-        modelShader.setVec3("pointLights[1].position", glm::vec3(-10.0f ,110.0f, 1.0f));
-        modelShader.setVec3("pointLights[1].ambient", pointLight.ambient);
-        modelShader.setVec3("pointLights[1].diffuse", pointLight.diffuse);
-        modelShader.setVec3("pointLights[1].specular", pointLight.specular);
-        modelShader.setFloat("pointLights[1].constant", pointLight.constant);
-        modelShader.setFloat("pointLights[1].linear", pointLight.linear);
-        modelShader.setFloat("pointLights[1].quadratic", pointLight.quadratic);
-
-        modelShader.setBool("blinn", programState->blinn);
-        // spotLight
-        if (programState->spotlightOn) {
-            modelShader.setVec3("spotLight.position", programState->camera.Position);
-            modelShader.setVec3("spotLight.direction", programState->camera.Front);
-            modelShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-            modelShader.setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-            modelShader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-            modelShader.setFloat("spotLight.constant", 1.0f);
-            modelShader.setFloat("spotLight.linear", 0.09);
-            modelShader.setFloat("spotLight.quadratic", 0.032);
-            modelShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-            modelShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
-        }else{
-            modelShader.setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
-            modelShader.setVec3("spotLight.specular", 0.0f, 0.0f, 0.0f);
-        }
-
-
-        // render the loaded snowman model
+        rg::FrameCamera &frameCamera = frameUniforms.camera;
+        frameCamera.projection = glm::perspective(glm::radians(programState->camera.Zoom),
+                                                  (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f);
+        frameCamera.view = programState->camera.GetViewMatrix();
+        frameCamera.skyboxView = glm::mat4(glm::mat3(frameCamera.view)); //remove translation from the view matrix
+        frameCamera.viewPosition = programState->camera.Position;
+
+        // every object is tested against the view frustum before it is drawn
+        glm::mat4 viewProjection = frameCamera.projection * frameCamera.view;
+        rg::Frustum frustum = rg::Frustum::fromMatrix(viewProjection);
+        rg::CullStats culling;
+
+        // the snowman model
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::translate(model,
                                programState->snowManPosition); // translate it down so it's at the center of the scene
         model = glm::scale(model, glm::vec3(programState->snowManScale));    // it's a bit too big for snowMan scene, so scale it down
-
-        modelShader.setMat4("model", model);
-        snowManModel.Draw(modelShader);
-
-        modelShader.setVec3("pointLights[0].position", glm::vec3(4.0 * cos(0.9), 4.0f, 4.0 * sin(0.9)));
-        // render the loaded tree model
+        // the tree model
         glm::mat4 treeModelMatrix = glm::mat4(1.0f);
         treeModelMatrix = glm::translate(treeModelMatrix,
                                programState->treePosition);
         treeModelMatrix = glm::scale(treeModelMatrix, glm::vec3(programState->treeScale));
         treeModelMatrix = glm::rotate(treeModelMatrix, -45.0f, glm::vec3(1.0f, 0.0f, 0.0f));
         treeModelMatrix = glm::rotate(treeModelMatrix, -45.0f, glm::vec3(0.0f, 0.0f, 1.0f));
-
-        modelShader.setMat4("model", treeModelMatrix);
-        treeModel.Draw(modelShader);
-
-        giftShader.use();
-
-        giftShader.setMat4("projection", projection);
-        giftShader.setMat4("view", view);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, giftTexture);
-        glBindVertexArray(giftVAO);
-
-        for (unsigned int i = 0; i < programState->numOfGifts; i++) {
+        // the gifts
+        giftTransforms.clear();
+        unsigned int numOfGifts = std::min<unsigned int>(programState->numOfGifts, std::size(giftPositions));
+        for (unsigned int i = 0; i < numOfGifts; i++) {
 
             glm::mat4 giftModel = glm::mat4(1.0f);
             giftModel = glm::translate(giftModel,
                                    giftPositions[i]);
             giftModel = glm::scale(giftModel, glm::vec3(programState->giftScale));
-            giftShader.setMat4("model", giftModel);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            giftTransforms.push_back(giftModel);
         }
 
-        // using blanding for snowflakes- discard
-        snowShader.use();
-        snowShader.setMat4("projection", projection);
-        snowShader.setMat4("view", view);
+        // the BVH follows the objects that moved with a refit. It is rebuilt when an object appears or
+        // disappears, e.g. a model that finished loading, which a refit of the old tree would handle badly.
+        sceneBoxes[SnowManObject] = snowManModel.bounds.box.transformed(model);
+        sceneBoxes[TreeObject] = treeModel.bounds.box.transformed(treeModelMatrix);
+        for (size_t i = 0; i < std::size(giftPositions); i++)
+            sceneBoxes[FirstGiftObject + i] = i < giftTransforms.size() ? giftBounds.box.transformed(giftTransforms[i]) : rg::Aabb();
+        bool rebuildScene = !sceneBuilt;
+        for (uint32_t i = 0; sceneBuilt && i < sceneBoxes.size(); i++)
+            rebuildScene |= sceneBoxes[i].empty() != sceneBvh.box(i).empty();
+        if (rebuildScene) {
+            sceneBvh.build(sceneBoxes);
+            sceneBuilt = true;
+        } else {
+            for (uint32_t i = 0; i < sceneBoxes.size(); i++)
+                sceneBvh.update(i, sceneBoxes[i]);
+            sceneBvh.refit();
+        }
+        sceneBvh.query(frustum, visibleObjects);
+        objectVisible.assign(sceneBoxes.size(), false);
+        for (uint32_t object : visibleObjects)
+            objectVisible[object] = true;
+        // what survived the frustum is tested against the occluders that did
+        if (programState->occlusionCulling) {
+            occlusion.begin(viewProjection);
+            if (objectVisible[SnowManObject])
+                occlusion.addOccluder(snowManModel.occluder, model);
+            if (objectVisible[TreeObject])
+                occlusion.addOccluder(treeModel.occluder, treeModelMatrix);
+            for (uint32_t i = 0; i < cubeTransforms.size(); i++) {
+                if (objectVisible[FirstCubeObject + i])
+                    occlusion.addOccluder(cubeOccluder, cubeTransforms[i]);
+            }
+            occlusion.rasterize();
+            for (uint32_t object : visibleObjects)
+                objectVisible[object] = occlusion.visible(sceneBoxes[object]);
+            programState->occlusion = occlusion.counters();
+        } else {
+            programState->occlusion = rg::OcclusionCounters();
+        }
+        rg::BvhHit lookedAt;
+        programState->lookingAt = sceneBvh.raycast(programState->camera.GetRay(), lookedAt, 100.0f)
+                                  ? sceneObjectNames[lookedAt.object] : "nothing";
 
-        glBindVertexArray(transparentVAO);
-        glBindTexture(GL_TEXTURE_2D, snowflakeTexture);
-        for (unsigned int i = 0; i < snowflakePosition.size(); i++)
-        {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, snowflakePosition[i]);
-            model = glm::translate(model, glm::vec3(0.0f,-0.5*tan(glfwGetTime()*0.6), 0.0f));
-            float angle= 20*tan(glfwGetTime());
-            model=glm::rotate(model,glm::radians(angle),glm::vec3(1.0f,0.5f,0.5f));
-            model=glm::scale(model,glm::vec3(0.5f,0.5f,0.5f));
-            snowShader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
+        rg::FrameLights &frameLights = frameUniforms.lights;
+        // directional light
+        frameLights.dirLight.direction = programState->dirLightDir;
+        frameLights.dirLight.ambient = glm::vec3(programState->dirLightAmbDiffSpec.x);
+        frameLights.dirLight.diffuse = glm::vec3(programState->dirLightAmbDiffSpec.y);
+        frameLights.dirLight.specular = glm::vec3(programState->dirLightAmbDiffSpec.z);
+
+        const glm::vec3 pointLightPositions[rg::FRAME_POINT_LIGHTS] = {
+                glm::vec3(-5.0f, -10.0f,-5.0f),
+                glm::vec3(-10.0f ,110.0f, 1.0f)
+        };
+        for (size_t i = 0; i < rg::FRAME_POINT_LIGHTS; i++) {
+            rg::FramePointLight &light = frameLights.pointLights[i];
+            light.position = pointLightPositions[i];
+            light.ambient = pointLight.ambient;
+            light.diffuse = pointLight.diffuse;
+            light.specular = pointLight.specular;
+            light.constant = pointLight.constant;
+            light.linear = pointLight.linear;
+            light.quadratic = pointLight.quadratic;
         }
 
-        shader.use();
-        shader.setMat4("view", view);
-        shader.setMat4("projection", projection);
+        // spotLight
+        rg::FrameSpotLight &spotLight = frameLights.spotLight;
+        spotLight.position = programState->camera.Position;
+        spotLight.direction = programState->camera.Front;
+        spotLight.ambient = glm::vec3(0.0f);
+        spotLight.diffuse = programState->spotlightOn ? glm::vec3(1.0f) : glm::vec3(0.0f);
+        spotLight.specular = programState->spotlightOn ? glm::vec3(1.0f) : glm::vec3(0.0f);
+        spotLight.constant = 1.0f;
+        spotLight.linear = 0.09f;
+        spotLight.quadratic = 0.032f;
+        spotLight.cutOff = glm::cos(glm::radians(12.5f));
+        spotLight.outerCutOff = glm::cos(glm::radians(15.0f));
+
+        // the tree is lit by the first point light moved next to it. That is a second set of lights in the
+        // frame uniforms rather than a change between the draws, so the draws can go in any order.
+        rg::FrameLights &treeLights = frameUniforms.extraLights[0];
+        treeLights = frameLights;
+        treeLights.pointLights[0].position = glm::vec3(4.0 * cos(0.9), 4.0f, 4.0 * sin(0.9));
+
+        // one upload for every program drawn this frame
+        frameUniforms.update();
+
+        // uniforms every draw of a program shares are set once, the queue only keeps the per draw ones
+        modelShader.use();
+        modelShader.setFloat("material.shininess", 32.0f);
+        modelShader.setBool("blinn", programState->blinn);
+        snowShader.use();
+        snowShader.setFloat("flakeSize", programState->snowflakeSize);
+        snowShader.setFloat("cullDistance", 100.0f);
+
+        // every draw of the frame goes into the queue, which sorts them by program, texture, vertex array
+        // and distance before anything is drawn
+        renderQueue.clear();
+        auto distanceTo = [&](const rg::Aabb &box) {
+            return glm::length(box.center() - programState->camera.Position);
+        };
 
-        // cubes
-        glBindVertexArray(cubeVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, iceTexture);
+        // the loaded models are recorded on the workers, each into a command buffer of its own. Their meshes
+        // are tested in model space, against the frustum of projection * view * model
+        struct ModelDraw {
+            const Model *model;
+            glm::mat4 matrix;
+            uint32_t object;
+            size_t lightSet;
+        };
+        const ModelDraw modelDraws[] = {{&snowManModel, model, SnowManObject, 0}, {&treeModel, treeModelMatrix, TreeObject, 1}};
+        rg::CullStats modelCulling[std::size(modelDraws)];
+        renderQueue.record(std::size(modelDraws), [&](rg::CommandBuffer &commands, size_t i) {
+            const ModelDraw &draw = modelDraws[i];
+            if (!objectVisible[draw.object]) {
+                modelCulling[i].record(false, std::max<size_t>(draw.model->meshes.size(), 1));
+                return;
+            }
+            rg::DrawPacket packet;
+            packet.program = modelShader.ID;
+            packet.uniformBlock = frameUniforms.lightsRange(draw.lightSet);
+            packet.depth = distanceTo(sceneBoxes[draw.object]);
+            draw.model->Submit(commands, modelShader, packet, draw.matrix, rg::Frustum::fromMatrix(viewProjection * draw.matrix),
+                               modelCulling[i]);
+        });
+        for (const rg::CullStats &stats : modelCulling)
+            culling += stats;
+
+        // instanced objects are one packet for all their visible instances, at the distance of the nearest
+        rg::DrawPacket instancedPacket;
+        instancedPacket.textureCount = 1;
+        instancedPacket.count = 36;
+
+        visibleGiftTransforms.clear();
+        float nearestGift = renderQueue.maxDepth;
+        for (size_t i = 0; i < giftTransforms.size(); i++) {
+            culling.record(objectVisible[FirstGiftObject + i]);
+            if (!objectVisible[FirstGiftObject + i])
+                continue;
+            visibleGiftTransforms.push_back(giftTransforms[i]);
+            nearestGift = std::min(nearestGift, distanceTo(sceneBoxes[FirstGiftObject + i]));
+        }
+        if (!visibleGiftTransforms.empty()) {
+            giftInstances.update(visibleGiftTransforms.data(), visibleGiftTransforms.size());
+            rg::DrawPacket giftPacket = instancedPacket;
+            giftPacket.program = giftShader.ID;
+            giftPacket.vertexArray = giftVAO;
+            giftPacket.textures[0] = {0, GL_TEXTURE_2D, giftTexture.id()};
+            giftPacket.depth = nearestGift;
+            giftPacket.instances = (unsigned int) giftInstances.size();
+            renderQueue.add(giftPacket);
+        }
 
+        // snowfall: one simulation step and one instanced draw for the whole field
+        auto updateSnow = [&](auto &system) {
+            if (system.size() != (size_t) programState->snowflakeCount)
+                system.resize(programState->snowflakeCount);
+            system.parameters.wind = programState->wind;
+            system.update(deltaTime, currentFrame);
+        };
+        bool snowOnCpu = programState->cpuSnow || !snow.valid();
+        if (snowOnCpu) {
+            if (!cpuSnow)
+                cpuSnow = std::make_unique<rg::CpuSnowParticleSystem>(programState->snowflakeCount);
+            updateSnow(*cpuSnow);
+        } else {
+            updateSnow(snow);
+        }
+        // the field is one draw item, its single flakes are culled by the vertex shader
+        const rg::SnowParameters &snowParameters = snowOnCpu ? cpuSnow->parameters : snow.parameters;
+        rg::Aabb snowBox;
+        snowBox.min = snowParameters.boxMin - glm::vec3(programState->snowflakeSize);
+        snowBox.max = snowParameters.boxMax + glm::vec3(programState->snowflakeSize);
+        bool snowVisible = frustum.intersects(snowBox);
+        culling.record(snowVisible);
+        if (snowVisible) {
+            // using blanding for snowflakes- discard. The flakes spin, both of their sides are visible.
+            // The particle systems bind their own buffers, so they draw themselves.
+            rg::DrawPacket snowPacket;
+            snowPacket.program = snowShader.ID;
+            snowPacket.textures[0] = {0, GL_TEXTURE_2D, snowflakeTexture.id()};
+            snowPacket.textureCount = 1;
+            snowPacket.cullMode = rg::CullMode::None;
+            rg::CpuSnowParticleSystem *cpuSnowSystem = snowOnCpu ? cpuSnow.get() : nullptr;
+            renderQueue.add(snowPacket, [&snow, cpuSnowSystem]() {
+                if (cpuSnowSystem)
+                    cpuSnowSystem->draw();
+                else
+                    snow.draw();
+            });
+        }
 
-        for (unsigned i = 0; i < 6; i++) {
-            glCullFace(GL_BACK);
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePosition[i]);
-            shader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+        // cubes
+        visibleCubes.clear();
+        float nearestCube = renderQueue.maxDepth;
+        for (uint32_t i = 0; i < cubeTransforms.size(); i++) {
+            culling.record(objectVisible[FirstCubeObject + i]);
+            if (!objectVisible[FirstCubeObject + i])
+                continue;
+            visibleCubes.push_back(i);
+            nearestCube = std::min(nearestCube, distanceTo(sceneBoxes[FirstCubeObject + i]));
+        }
+        if (visibleCubes != uploadedCubes) {
+            visibleCubeTransforms.clear();
+            for (uint32_t i : visibleCubes)
+                visibleCubeTransforms.push_back(cubeTransforms[i]);
+            cubeInstances.update(visibleCubeTransforms.data(), visibleCubeTransforms.size());
+            uploadedCubes = visibleCubes;
+        }
+        if (cubeInstances.size()) {
+            rg::DrawPacket cubePacket = instancedPacket;
+            cubePacket.program = shader.ID;
+            cubePacket.vertexArray = cubeVAO;
+            cubePacket.textures[0] = {0, GL_TEXTURE_2D, iceTexture.id()};
+            cubePacket.depth = nearestCube;
+            cubePacket.instances = (unsigned int) cubeInstances.size();
+            renderQueue.add(cubePacket);
         }
-        //skybox
-        glDepthFunc(GL_LEQUAL); //change depth function so depth test passes when values are equal to depth buffer's content
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(programState->camera.GetViewMatrix())); //remove translation from the view matrix
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
 
+        //skybox, after everything else so only the pixels nothing covers are shaded
+        rg::DrawPacket skyboxPacket;
+        skyboxPacket.pass = rg::RenderPass::Sky;
+        skyboxPacket.program = skyboxShader.ID;
+        skyboxPacket.vertexArray = skyboxVAO;
+        skyboxPacket.textures[0] = {0, GL_TEXTURE_CUBE_MAP, cubemapTexture.id()};
+        skyboxPacket.textureCount = 1;
+        skyboxPacket.depthTest = rg::DepthTest::LessEqual; // passes where the depth buffer still holds the far plane
+        skyboxPacket.count = 36;
+        renderQueue.add(skyboxPacket);
+        // the skybox surrounds the camera, it is always visible
+        culling.record(true);
 
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS); //set depth function back to default
+        renderQueue.submit();
+        programState->renderQueue = renderQueue.counters();
 
 
 
@@ -743,27 +937,27 @@ int main() {
         shaderBlur.use();
         for (unsigned int i = 0; i < amount; i++)
         {
-            glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
+            glState.bindFramebuffer(pingpongFBO[horizontal]);
             shaderBlur.setInt("horizontal", horizontal);
-            glBindTexture(GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingpongColorbuffers[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
+            glState.bindTextureUnit(0, GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingpongColorbuffers[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
             renderQuad();
             horizontal = !horizontal;
             if (first_iteration)
                 first_iteration = false;
         }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glState.bindFramebuffer(0);
 
         // now render floating point color buffer to 2D quad and tonemap HDR colors to default framebuffer's (clamped) color range
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         shaderBloom.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
+        glState.bindTextureUnit(0, GL_TEXTURE_2D, colorBuffers[0]);
+        glState.bindTextureUnit(1, GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
         shaderBloom.setInt("bloom", programState->bloom);
         shaderBloom.setFloat("exposure", programState->exposure);
         renderQuad();
 
+        programState->culling = culling;
+        programState->sceneCounters = sceneBvh.counters();
         if (programState->ImGuiEnabled)
             DrawImGui(programState);
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
@@ -780,12 +974,10 @@ int main() {
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
-    glDeleteVertexArrays(1, &giftVAO);
-    glDeleteBuffers(1, &giftVBO);
-    glDeleteVertexArrays(1, &skyboxVAO);
-    glDeleteBuffers(1, &skyboxVBO);
-    glDeleteVertexArrays(1, &transparentVAO);
-    glDeleteBuffers(1, &transparentVBO);
+    glState.deleteVertexArray(giftVAO);
+    glState.deleteBuffer(giftVBO);
+    glState.deleteVertexArray(skyboxVAO);
+    glState.deleteBuffer(skyboxVBO);
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
@@ -876,6 +1068,11 @@ void DrawImGui(ProgramState *programState) {
         ImGui::DragFloat("pointLight.quadratic", &programState->pointLight.quadratic, 0.05, 0.0, 1.0);
 
         ImGui::DragFloat("exposure", &programState->exposure);
+        ImGui::SliderInt("snowflakes", &programState->snowflakeCount, 0, 1000000, "%d", ImGuiSliderFlags_Logarithmic);
+        ImGui::DragFloat("snowflake size", &programState->snowflakeSize, 0.01, 0.01, 1.0);
+        ImGui::DragFloat3("wind", (float*)&programState->wind, 0.05);
+        ImGui::Checkbox("simulate snow on the CPU", &programState->cpuSnow);
+        ImGui::Checkbox("occlusion culling", &programState->occlusionCulling);
         ImGui::Checkbox("bloom", &programState->bloom);
 
         ImGui::End();
@@ -891,8 +1088,36 @@ void DrawImGui(ProgramState *programState) {
         ImGui::End();
     }
 
+    {
+        ImGui::Begin("Renderer");
+        const rg::GLStateCounters &counters = rg::GLState::Get().lastFrame();
+        ImGui::Text("GL state calls: %llu issued, %llu skipped", (unsigned long long) counters.issued,
+                    (unsigned long long) counters.skipped);
+        ImGui::Text("Frustum and occlusion culling: %u submitted, %u culled", programState->culling.submitted,
+                    programState->culling.culled);
+        const rg::OcclusionCounters &occlusion = programState->occlusion;
+        ImGui::Text("Occlusion: %u occluder triangles (%u rasterized, %.3f ms), %u of %u tested hidden",
+                    occlusion.occluderTriangles, occlusion.rasterizedTriangles, occlusion.rasterizeMilliseconds,
+                    occlusion.occluded, occlusion.tested);
+        const rg::RenderQueueCounters &queue = programState->renderQueue;
+        ImGui::Text("Render queue: %u packets from %u command buffers, recorded in %.3f ms, sorted in %.1f us", queue.packets,
+                    queue.commandBuffers, queue.recordMilliseconds, queue.sortMicroseconds);
+        ImGui::Text("Changes sorted (unsorted): %u (%u) programs, %u (%u) textures, %u (%u) vertex arrays",
+                    queue.programChanges, queue.unsortedProgramChanges, queue.textureChanges, queue.unsortedTextureChanges,
+                    queue.vertexArrayChanges, queue.unsortedVertexArrayChanges);
+        ImGui::Text("Uniforms skipped: %u", queue.uniformsSkipped);
+        const rg::BvhCounters &bvh = programState->sceneCounters;
+        ImGui::Text("Scene BVH: %u builds (last %.3f ms), %u refits (last %.3f ms, %u nodes)", bvh.builds,
+                    bvh.buildMilliseconds, bvh.refits, bvh.refitMilliseconds, bvh.refitNodes);
+        ImGui::Text("Scene BVH query: %u nodes visited, %u objects tested", bvh.nodesVisited, bvh.objectsTested);
+        ImGui::Text("Looking at: %s", programState->lookingAt.c_str());
+        ImGui::End();
+    }
+
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    // the backend sets its own program, textures and blend state
+    rg::GLState::Get().invalidate();
 }
 
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
@@ -931,73 +1156,15 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
 #endif
 }
 
-unsigned int loadTexture(char const * path)
+// textures go through the shared registry, so a file that a model already loaded is not loaded again
+rg::TextureHandle loadTexture(char const * path)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width,height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents,0);
-
-    if(data)
-    {
-        GLenum format;
-        if(nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-
-    }
-    return textureID;
+    return rg::TextureRegistry::Get().acquire(path);
 }
 
-unsigned int loadCubemap(vector <std::string> faces)
+rg::TextureHandle loadCubemap(vector <std::string> faces)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels;
-    for(unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels,0);
-        if(data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
+    return rg::TextureRegistry::Get().acquireCubemap(faces);
 }
 
 // renderQuad() renders a 1x1 XY quad in NDC
@@ -1018,15 +1185,14 @@ void renderQuad()
         // setup  VAO
         glGenVertexArrays(1, &quadVAO);
         glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        rg::GLState::Get().bindVertexArray(quadVAO);
+        rg::GLState::Get().bindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     }
-    glBindVertexArray(quadVAO);
+    rg::GLState::Get().bindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
 }
\ No newline at end of file
@@ -0,0 +1,273 @@
+#include "rg/mesh_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rg {
+
+namespace {
+    const char CookedMagic[4] = {'R', 'G', 'M', 'C'};
+    const size_t BlobAlignment = 16;
+
+    struct CookedFileHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceHash;
+        uint32_t importFlags;
+        uint32_t vertexStride;
+        uint32_t meshCount;
+        uint32_t dependencyCount;
+        uint64_t dependencyOffset;
+        uint64_t dependencyHash;    // of the contents of all dependencies, in order
+        uint64_t fileSize;
+    };
+
+    struct CookedMeshRecord {
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        uint64_t textureOffset;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t textureCount;
+        uint32_t indexSize;
+    };
+
+    void appendBytes(std::vector<char> &out, const void *data, size_t size) {
+        const char *bytes = static_cast<const char *>(data);
+        out.insert(out.end(), bytes, bytes + size);
+    }
+
+    void appendString(std::vector<char> &out, const std::string &s) {
+        uint32_t length = s.size();
+        appendBytes(out, &length, sizeof(length));
+        appendBytes(out, s.data(), s.size());
+    }
+
+    void alignTo(std::vector<char> &out, size_t alignment) {
+        out.resize((out.size() + alignment - 1) / alignment * alignment, 0);
+    }
+
+    bool readString(const char *base, size_t size, uint64_t &offset, std::string &s) {
+        uint32_t length;
+        if (offset + sizeof(length) > size)
+            return false;
+        std::memcpy(&length, base + offset, sizeof(length));
+        offset += sizeof(length);
+        if (offset + length > size)
+            return false;
+        s.assign(base + offset, length);
+        offset += length;
+        return true;
+    }
+
+    // false when a dependency can not be read, which makes the cooked file stale as well
+    bool hashDependencies(const std::vector<std::string> &paths, uint64_t &hash) {
+        hash = hashBytes(nullptr, 0);
+        for (const std::string &path : paths) {
+            uint64_t fileHash;
+            if (!hashFileContents(path, fileHash))
+                return false;
+            hash = hashBytes(&fileHash, sizeof(fileHash), hash);
+        }
+        return true;
+    }
+}
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool hashFileContents(const std::string &path, uint64_t &hash) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    hash = 14695981039346656037ull;
+    std::vector<char> chunk(1 << 16);
+    while (in) {
+        in.read(chunk.data(), chunk.size());
+        hash = hashBytes(chunk.data(), in.gcount(), hash);
+    }
+    return true;
+}
+
+std::string cookedPathFor(const std::string &sourcePath) {
+    return sourcePath + ".rgmesh";
+}
+
+CookedModelFile::~CookedModelFile() {
+    close();
+}
+
+void CookedModelFile::close() {
+    if (m_mapping) {
+        munmap(m_mapping, m_mappingSize);
+        m_mapping = nullptr;
+        m_mappingSize = 0;
+    }
+    m_meshes.clear();
+}
+
+bool CookedModelFile::open(const std::string &cookedPath, const CookedModelKey &key) {
+    close();
+
+    int fd = ::open(cookedPath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(CookedFileHeader)) {
+        ::close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    m_mapping = mapping;
+    m_mappingSize = size;
+
+    const char *base = static_cast<const char *>(mapping);
+    CookedFileHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, CookedMagic, sizeof(CookedMagic)) != 0
+        || header.version != Version
+        || header.sourceHash != key.sourceHash
+        || header.importFlags != key.importFlags
+        || header.vertexStride != key.vertexStride
+        || header.fileSize != size) {
+        close();
+        return false;
+    }
+
+    uint64_t recordsEnd = sizeof(CookedFileHeader) + (uint64_t) header.meshCount * sizeof(CookedMeshRecord);
+    if (recordsEnd > size) {
+        close();
+        return false;
+    }
+
+    std::vector<std::string> dependencies(header.dependencyCount);
+    uint64_t dependencyOffset = header.dependencyOffset;
+    for (std::string &dependency : dependencies) {
+        if (!readString(base, size, dependencyOffset, dependency)) {
+            close();
+            return false;
+        }
+    }
+    uint64_t dependencyHash;
+    if (!hashDependencies(dependencies, dependencyHash) || dependencyHash != header.dependencyHash) {
+        close();
+        return false;
+    }
+    const CookedMeshRecord *records = reinterpret_cast<const CookedMeshRecord *>(base + sizeof(CookedFileHeader));
+    m_meshes.resize(header.meshCount);
+    for (uint32_t i = 0; i < header.meshCount; ++i) {
+        const CookedMeshRecord &record = records[i];
+        uint64_t vertexBytes = (uint64_t) record.vertexCount * header.vertexStride;
+        uint64_t indexBytes = (uint64_t) record.indexCount * record.indexSize;
+        if ((record.indexSize != 2 && record.indexSize != 4)
+            || record.vertexOffset + vertexBytes > size || record.indexOffset + indexBytes > size) {
+            close();
+            return false;
+        }
+        CookedMesh &mesh = m_meshes[i];
+        mesh.vertices = base + record.vertexOffset;
+        mesh.vertexCount = record.vertexCount;
+        mesh.indices = base + record.indexOffset;
+        mesh.indexCount = record.indexCount;
+        mesh.indexSize = record.indexSize;
+
+        uint64_t offset = record.textureOffset;
+        mesh.textures.resize(record.textureCount);
+        for (CookedTexture &texture : mesh.textures) {
+            if (!readString(base, size, offset, texture.type) || !readString(base, size, offset, texture.path)) {
+                close();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool writeCookedModel(const std::string &cookedPath, const CookedModelKey &key,
+                      const std::vector<CookedMesh> &meshes, const std::vector<std::string> &dependencies) {
+    std::vector<char> out;
+    CookedFileHeader header{};
+    if (!hashDependencies(dependencies, header.dependencyHash))
+        return false;
+    std::memcpy(header.magic, CookedMagic, sizeof(CookedMagic));
+    header.version = CookedModelFile::Version;
+    header.sourceHash = key.sourceHash;
+    header.importFlags = key.importFlags;
+    header.vertexStride = key.vertexStride;
+    header.meshCount = meshes.size();
+    header.dependencyCount = dependencies.size();
+    appendBytes(out, &header, sizeof(header));
+
+    std::vector<CookedMeshRecord> records(meshes.size());
+    size_t recordsOffset = out.size();
+    out.resize(out.size() + records.size() * sizeof(CookedMeshRecord));
+
+    header.dependencyOffset = out.size();
+    for (const std::string &dependency : dependencies)
+        appendString(out, dependency);
+
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        records[i].textureOffset = out.size();
+        records[i].textureCount = meshes[i].textures.size();
+        for (const CookedTexture &texture : meshes[i].textures) {
+            appendString(out, texture.type);
+            appendString(out, texture.path);
+        }
+    }
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        const CookedMesh &mesh = meshes[i];
+        alignTo(out, BlobAlignment);
+        records[i].vertexOffset = out.size();
+        records[i].vertexCount = mesh.vertexCount;
+        appendBytes(out, mesh.vertices, (size_t) mesh.vertexCount * key.vertexStride);
+        alignTo(out, BlobAlignment);
+        records[i].indexOffset = out.size();
+        records[i].indexCount = mesh.indexCount;
+        records[i].indexSize = mesh.indexSize;
+        appendBytes(out, mesh.indices, (size_t) mesh.indexCount * mesh.indexSize);
+    }
+    std::memcpy(out.data() + recordsOffset, records.data(), records.size() * sizeof(CookedMeshRecord));
+    header.fileSize = out.size();
+    std::memcpy(out.data(), &header, sizeof(header));
+
+    // write next to the destination and rename, so a crash mid-write never leaves a
+    // truncated file that would be picked up on the next start
+    std::string tmpPath = cookedPath + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cout << "ERROR::MESH_CACHE::FAILED_TO_WRITE " << tmpPath << std::endl;
+            return false;
+        }
+        file.write(out.data(), out.size());
+        if (!file) {
+            std::cout << "ERROR::MESH_CACHE::FAILED_TO_WRITE " << tmpPath << std::endl;
+            return false;
+        }
+    }
+    if (std::rename(tmpPath.c_str(), cookedPath.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+};
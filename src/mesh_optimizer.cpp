@@ -0,0 +1,342 @@
+#include "rg/mesh_optimizer.h"
+#include "rg/mesh_cache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace rg {
+
+namespace {
+    const uint32_t InvalidIndex = ~0u;
+
+    // Forsyth's scoring constants, tuned for a 32 entry LRU cache
+    const int ForsythCacheSize = 32;
+    const float ForsythCacheDecayPower = 1.5f;
+    const float ForsythLastTriangleScore = 0.75f;
+    const float ForsythValenceBoostScale = 2.0f;
+    const float ForsythValenceBoostPower = 0.5f;
+
+    float forsythVertexScore(int cachePosition, uint32_t remainingTriangles) {
+        if (remainingTriangles == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            if (cachePosition < 3) {
+                // the vertices of the last triangle get a fixed score, so the next triangle
+                // does not just reuse the same edge over and over
+                score = ForsythLastTriangleScore;
+            } else {
+                const float scale = 1.0f / (ForsythCacheSize - 3);
+                score = std::pow(1.0f - (cachePosition - 3) * scale, ForsythCacheDecayPower);
+            }
+        }
+        score += ForsythValenceBoostScale * std::pow((float) remainingTriangles, -ForsythValenceBoostPower);
+        return score;
+    }
+
+    struct Vec3 {
+        float x, y, z;
+    };
+
+    Vec3 readPosition(const unsigned char *vertices, uint32_t index, size_t stride, size_t positionOffset) {
+        Vec3 p;
+        std::memcpy(&p, vertices + (size_t) index * stride + positionOffset, sizeof(p));
+        return p;
+    }
+}
+
+MeshOptimizationStats &MeshOptimizationStats::operator+=(const MeshOptimizationStats &other) {
+    size_t totalTriangles = triangles + other.triangles;
+    if (totalTriangles > 0) {
+        acmrBefore = (acmrBefore * triangles + other.acmrBefore * other.triangles) / totalTriangles;
+        acmrAfter = (acmrAfter * triangles + other.acmrAfter * other.triangles) / totalTriangles;
+    }
+    verticesBefore += other.verticesBefore;
+    verticesAfter += other.verticesAfter;
+    triangles = totalTriangles;
+    return *this;
+}
+
+std::ostream &operator<<(std::ostream &out, const MeshOptimizationStats &stats) {
+    return out << stats.triangles << " triangles, vertices " << stats.verticesBefore << " -> " << stats.verticesAfter
+               << ", ACMR " << stats.acmrBefore << " -> " << stats.acmrAfter;
+}
+
+float computeACMR(const uint32_t *indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize) {
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return 0.0f;
+    // FIFO cache: a vertex is still cached if fewer than cacheSize misses happened since it was loaded
+    std::vector<uint32_t> loadedAt(vertexCount, 0);
+    uint32_t misses = 0;
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+        uint32_t v = indices[i];
+        if (loadedAt[v] == 0 || misses - loadedAt[v] >= cacheSize) {
+            ++misses;
+            loadedAt[v] = misses;
+        }
+    }
+    return (float) misses / triangleCount;
+}
+
+size_t weldVertices(void *vertices, size_t vertexCount, size_t stride, uint32_t *indices, size_t indexCount) {
+    if (vertexCount == 0)
+        return 0;
+    unsigned char *bytes = static_cast<unsigned char *>(vertices);
+
+    // open addressing table of vertex indices, at most half full
+    size_t tableSize = 1;
+    while (tableSize < vertexCount * 2)
+        tableSize <<= 1;
+    std::vector<uint32_t> table(tableSize, InvalidIndex);
+
+    std::vector<uint32_t> remap(vertexCount);
+    size_t uniqueCount = 0;
+    for (size_t v = 0; v < vertexCount; ++v) {
+        const unsigned char *vertex = bytes + v * stride;
+        size_t slot = hashBytes(vertex, stride) & (tableSize - 1);
+        while (table[slot] != InvalidIndex && std::memcmp(bytes + (size_t) table[slot] * stride, vertex, stride) != 0)
+            slot = (slot + 1) & (tableSize - 1);
+
+        if (table[slot] == InvalidIndex) {
+            // first occurrence; unique vertices only ever move towards the front, so this is safe in place
+            if (uniqueCount != v)
+                std::memmove(bytes + uniqueCount * stride, vertex, stride);
+            table[slot] = uniqueCount;
+            remap[v] = uniqueCount++;
+        } else {
+            remap[v] = table[slot];
+        }
+    }
+    for (size_t i = 0; i < indexCount; ++i)
+        indices[i] = remap[indices[i]];
+    return uniqueCount;
+}
+
+void optimizeVertexCache(uint32_t *indices, size_t indexCount, size_t vertexCount) {
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    // triangles using each vertex: vertexTriangles[offset[v] .. offset[v] + remaining[v]) are the ones
+    // not emitted yet, emitted triangles are swapped to the end of the range
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+        ++remaining[indices[i]];
+    std::vector<uint32_t> offset(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+        offset[v + 1] = offset[v] + remaining[v];
+    std::vector<uint32_t> vertexTriangles(triangleCount * 3);
+    {
+        std::vector<uint32_t> fill(offset.begin(), offset.end() - 1);
+        for (size_t t = 0; t < triangleCount; ++t)
+            for (int k = 0; k < 3; ++k)
+                vertexTriangles[fill[indices[t * 3 + k]]++] = t;
+    }
+
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+        vertexScore[v] = forsythVertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const uint32_t *tri = indices + t * 3;
+        triangleScore[t] = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+    }
+
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> nextCache;
+    cache.reserve(ForsythCacheSize + 3);
+    nextCache.reserve(ForsythCacheSize + 3);
+
+    size_t bestTriangle = std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin();
+    size_t scanCursor = 0;
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+        if (bestTriangle == InvalidIndex) {
+            // nothing in the cache has triangles left, continue with the next unused triangle
+            while (emitted[scanCursor])
+                ++scanCursor;
+            bestTriangle = scanCursor;
+        }
+
+        const uint32_t *tri = indices + bestTriangle * 3;
+        emitted[bestTriangle] = true;
+        nextCache.clear();
+        for (int k = 0; k < 3; ++k) {
+            uint32_t v = tri[k];
+            output.push_back(v);
+            if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end())
+                nextCache.push_back(v);
+            // remove the triangle from the vertex's list of remaining triangles
+            uint32_t *begin = vertexTriangles.data() + offset[v];
+            uint32_t *end = begin + remaining[v];
+            uint32_t *it = std::find(begin, end, (uint32_t) bestTriangle);
+            std::swap(*it, *(end - 1));
+            --remaining[v];
+        }
+        for (uint32_t v : cache) {
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                nextCache.push_back(v);
+        }
+        // vertices pushed out of the cache lose their cache score
+        for (size_t i = ForsythCacheSize; i < nextCache.size(); ++i)
+            vertexScore[nextCache[i]] = forsythVertexScore(-1, remaining[nextCache[i]]);
+        if (nextCache.size() > (size_t) ForsythCacheSize)
+            nextCache.resize(ForsythCacheSize);
+        std::swap(cache, nextCache);
+
+        for (size_t i = 0; i < cache.size(); ++i)
+            vertexScore[cache[i]] = forsythVertexScore(i, remaining[cache[i]]);
+
+        // only the triangles touching the cache changed score, the best next one is among them
+        bestTriangle = InvalidIndex;
+        float bestScore = -1.0f;
+        for (uint32_t v : cache) {
+            for (uint32_t j = 0; j < remaining[v]; ++j) {
+                uint32_t t = vertexTriangles[offset[v] + j];
+                const uint32_t *other = indices + (size_t) t * 3;
+                triangleScore[t] = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t *indices, size_t indexCount, const void *vertices, size_t vertexCount,
+                      size_t stride, size_t positionOffset) {
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+    const unsigned char *bytes = static_cast<const unsigned char *>(vertices);
+
+    // split into clusters where all three vertices of a triangle miss the cache, reordering whole
+    // clusters then does not cost any extra vertex shader invocations
+    const uint32_t cacheSize = 16;
+    std::vector<uint32_t> loadedAt(vertexCount, 0);
+    uint32_t misses = 0;
+    std::vector<size_t> clusterStart;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        int triangleMisses = 0;
+        for (int k = 0; k < 3; ++k) {
+            uint32_t v = indices[t * 3 + k];
+            if (loadedAt[v] == 0 || misses - loadedAt[v] >= cacheSize) {
+                ++misses;
+                loadedAt[v] = misses;
+                ++triangleMisses;
+            }
+        }
+        if (t == 0 || triangleMisses == 3)
+            clusterStart.push_back(t);
+    }
+    clusterStart.push_back(triangleCount);
+    size_t clusterCount = clusterStart.size() - 1;
+    if (clusterCount < 2)
+        return;
+
+    // area weighted centroid and normal of every cluster
+    std::vector<Vec3> clusterCentroid(clusterCount, Vec3{0.0f, 0.0f, 0.0f});
+    std::vector<Vec3> clusterNormal(clusterCount, Vec3{0.0f, 0.0f, 0.0f});
+    std::vector<float> clusterArea(clusterCount, 0.0f);
+    Vec3 meshCentroid{0.0f, 0.0f, 0.0f};
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; ++c) {
+        for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; ++t) {
+            Vec3 a = readPosition(bytes, indices[t * 3 + 0], stride, positionOffset);
+            Vec3 b = readPosition(bytes, indices[t * 3 + 1], stride, positionOffset);
+            Vec3 d = readPosition(bytes, indices[t * 3 + 2], stride, positionOffset);
+            Vec3 e1{b.x - a.x, b.y - a.y, b.z - a.z};
+            Vec3 e2{d.x - a.x, d.y - a.y, d.z - a.z};
+            Vec3 n{e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x};
+            float area = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+            Vec3 centroid{(a.x + b.x + d.x) / 3.0f, (a.y + b.y + d.y) / 3.0f, (a.z + b.z + d.z) / 3.0f};
+
+            clusterNormal[c].x += n.x;
+            clusterNormal[c].y += n.y;
+            clusterNormal[c].z += n.z;
+            clusterCentroid[c].x += centroid.x * area;
+            clusterCentroid[c].y += centroid.y * area;
+            clusterCentroid[c].z += centroid.z * area;
+            clusterArea[c] += area;
+        }
+        meshCentroid.x += clusterCentroid[c].x;
+        meshCentroid.y += clusterCentroid[c].y;
+        meshCentroid.z += clusterCentroid[c].z;
+        meshArea += clusterArea[c];
+    }
+    if (meshArea <= 0.0f)
+        return;
+    meshCentroid = Vec3{meshCentroid.x / meshArea, meshCentroid.y / meshArea, meshCentroid.z / meshArea};
+
+    // clusters facing away from the center of the mesh are the most likely to occlude the rest of it
+    std::vector<float> sortKey(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; ++c) {
+        if (clusterArea[c] <= 0.0f)
+            continue;
+        Vec3 centroid{clusterCentroid[c].x / clusterArea[c], clusterCentroid[c].y / clusterArea[c],
+                      clusterCentroid[c].z / clusterArea[c]};
+        const Vec3 &n = clusterNormal[c];
+        float length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+        if (length <= 0.0f)
+            continue;
+        sortKey[c] = ((centroid.x - meshCentroid.x) * n.x + (centroid.y - meshCentroid.y) * n.y
+                      + (centroid.z - meshCentroid.z) * n.z) / length;
+    }
+
+    std::vector<uint32_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c)
+        order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+    for (uint32_t c : order)
+        output.insert(output.end(), indices + clusterStart[c] * 3, indices + clusterStart[c + 1] * 3);
+    std::copy(output.begin(), output.end(), indices);
+}
+
+size_t optimizeVertexFetch(void *vertices, size_t vertexCount, size_t stride, uint32_t *indices, size_t indexCount) {
+    unsigned char *bytes = static_cast<unsigned char *>(vertices);
+    std::vector<unsigned char> original(bytes, bytes + vertexCount * stride);
+    std::vector<uint32_t> remap(vertexCount, InvalidIndex);
+    size_t nextVertex = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+        uint32_t &v = indices[i];
+        if (remap[v] == InvalidIndex) {
+            remap[v] = nextVertex;
+            std::memcpy(bytes + nextVertex * stride, original.data() + (size_t) v * stride, stride);
+            ++nextVertex;
+        }
+        v = remap[v];
+    }
+    return nextVertex;
+}
+
+MeshOptimizationStats optimizeMesh(void *vertices, size_t &vertexCount, size_t stride, size_t positionOffset,
+                                   uint32_t *indices, size_t indexCount) {
+    MeshOptimizationStats stats;
+    stats.verticesBefore = vertexCount;
+    stats.triangles = indexCount / 3;
+    stats.acmrBefore = computeACMR(indices, indexCount, vertexCount);
+
+    // the reordering passes assume a triangle list
+    if (indexCount % 3 == 0) {
+        vertexCount = weldVertices(vertices, vertexCount, stride, indices, indexCount);
+        optimizeVertexCache(indices, indexCount, vertexCount);
+        optimizeOverdraw(indices, indexCount, vertices, vertexCount, stride, positionOffset);
+        vertexCount = optimizeVertexFetch(vertices, vertexCount, stride, indices, indexCount);
+    }
+
+    stats.verticesAfter = vertexCount;
+    stats.acmrAfter = computeACMR(indices, indexCount, vertexCount);
+    return stats;
+}
+
+};
@@ -0,0 +1,462 @@
+#include "rg/occlusion.h"
+#include "rg/service_locator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#ifdef RG_SIMD_SSE
+#include <emmintrin.h>
+#endif
+
+namespace rg {
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    using Triangle = OcclusionBuffer::Triangle;
+
+    // voxel states while building a proxy, what is still Empty after the flood fill is the inside
+    enum Voxel : uint8_t {
+        Empty,
+        Surface,
+        Outside
+    };
+
+    size_t readIndex(const void *indices, size_t indexSize, size_t i) {
+        if (!indices)
+            return i;
+        if (indexSize == sizeof(uint16_t))
+            return static_cast<const uint16_t *>(indices)[i];
+        return static_cast<const uint32_t *>(indices)[i];
+    }
+
+    // the rectangle [u0, u1] x [v0, v1] on the plane axis = plane, in voxels, facing toward side
+    void emitQuad(OccluderMesh &mesh, const glm::vec3 &origin, float voxel, int axis, int side, int plane,
+                  int u0, int v0, int u1, int v1) {
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+        glm::vec3 corners[4];
+        const int cornerU[4] = {u0, u1, u1, u0};
+        const int cornerV[4] = {v0, v0, v1, v1};
+        for (int i = 0; i < 4; ++i) {
+            glm::vec3 p;
+            p[axis] = (float) plane;
+            p[u] = (float) cornerU[i];
+            p[v] = (float) cornerV[i];
+            corners[i] = origin + p * voxel;
+        }
+        // u x v is the axis, so the corners are counter-clockwise seen from the positive side
+        const int order[2][6] = {{0, 2, 1, 0, 3, 2}, {0, 1, 2, 0, 2, 3}};
+        for (int i : order[side > 0]) {
+            mesh.vertices.push_back(corners[i]);
+        }
+    }
+
+    void rasterizeScalar(const Triangle &t, float *depth, unsigned int stride, int minX, int minY, int maxX, int maxY) {
+        for (int y = minY; y <= maxY; ++y) {
+            float py = y + 0.5f;
+            float *row = depth + (size_t) y * stride;
+            for (int x = minX; x <= maxX; ++x) {
+                float px = x + 0.5f;
+                bool inside = true;
+                for (int edge = 0; edge < 3; ++edge) {
+                    inside &= t.edgeA[edge] * px + t.edgeB[edge] * py + t.edgeC[edge] >= 0.0f;
+                }
+                if (!inside)
+                    continue;
+                float z = std::clamp(t.depthA * px + t.depthB * py + t.depthC, t.minDepth, t.maxDepth);
+                row[x] = std::min(row[x], z);
+            }
+        }
+    }
+
+    bool anyNotInFrontScalar(const float *depth, unsigned int stride, int minX, int minY, int maxX, int maxY, float nearest) {
+        for (int y = minY; y <= maxY; ++y) {
+            const float *row = depth + (size_t) y * stride;
+            for (int x = minX; x <= maxX; ++x) {
+                if (row[x] >= nearest)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+#ifdef RG_SIMD_SSE
+    // 4 pixels of a row at once. Groups start at multiples of 4, which the tiles are, and may cover pixels
+    // past the box of the triangle, the edge functions keep those untouched.
+    void rasterizeSse(const Triangle &t, float *depth, unsigned int stride, int minX, int minY, int maxX, int maxY) {
+        const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 edgeA0 = _mm_set1_ps(t.edgeA[0]), edgeA1 = _mm_set1_ps(t.edgeA[1]), edgeA2 = _mm_set1_ps(t.edgeA[2]);
+        const __m128 depthA = _mm_set1_ps(t.depthA);
+        const __m128 minDepth = _mm_set1_ps(t.minDepth), maxDepth = _mm_set1_ps(t.maxDepth);
+        int firstX = minX & ~3;
+        for (int y = minY; y <= maxY; ++y) {
+            float py = y + 0.5f;
+            // the parts of the plane equations that are constant along the row
+            __m128 row0 = _mm_set1_ps(t.edgeB[0] * py + t.edgeC[0]);
+            __m128 row1 = _mm_set1_ps(t.edgeB[1] * py + t.edgeC[1]);
+            __m128 row2 = _mm_set1_ps(t.edgeB[2] * py + t.edgeC[2]);
+            __m128 rowDepth = _mm_set1_ps(t.depthB * py + t.depthC);
+            float *row = depth + (size_t) y * stride;
+            for (int x = firstX; x <= maxX; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float) x), offsets);
+                __m128 inside = _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA0, px), row0), zero),
+                                           _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA1, px), row1), zero));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA2, px), row2), zero));
+                if (!_mm_movemask_ps(inside))
+                    continue;
+                __m128 z = _mm_max_ps(_mm_min_ps(_mm_add_ps(_mm_mul_ps(depthA, px), rowDepth), maxDepth), minDepth);
+                __m128 current = _mm_loadu_ps(row + x);
+                __m128 nearer = _mm_min_ps(current, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+            }
+        }
+    }
+
+    bool anyNotInFrontSse(const float *depth, unsigned int stride, int minX, int minY, int maxX, int maxY, float nearest) {
+        const __m128 nearest4 = _mm_set1_ps(nearest);
+        const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+        const __m128i first = _mm_set1_epi32(minX - 1);
+        const __m128i last = _mm_set1_epi32(maxX + 1);
+        int firstX = minX & ~3;
+        for (int y = minY; y <= maxY; ++y) {
+            const float *row = depth + (size_t) y * stride;
+            for (int x = firstX; x <= maxX; x += 4) {
+                __m128i pixel = _mm_add_epi32(_mm_set1_epi32(x), lanes);
+                __m128i inBox = _mm_and_si128(_mm_cmpgt_epi32(pixel, first), _mm_cmplt_epi32(pixel, last));
+                __m128 behind = _mm_cmpge_ps(_mm_loadu_ps(row + x), nearest4);
+                if (_mm_movemask_ps(_mm_and_ps(behind, _mm_castsi128_ps(inBox))))
+                    return true;
+            }
+        }
+        return false;
+    }
+#endif
+}
+
+void OccluderBuilder::addTriangles(const void *positions, size_t stride, const void *indices, size_t indexSize, size_t indexCount) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(positions);
+    for (size_t i = 0; i + 3 <= indexCount; i += 3) {
+        for (size_t corner = 0; corner < 3; ++corner) {
+            glm::vec3 position;
+            std::memcpy(&position, bytes + readIndex(indices, indexSize, i + corner) * stride, sizeof(position));
+            m_triangles.push_back(position);
+            m_box.extend(position);
+        }
+    }
+}
+
+OccluderMesh OccluderBuilder::build(unsigned int resolution) const {
+    OccluderMesh mesh;
+    if (m_triangles.empty() || resolution == 0)
+        return mesh;
+    glm::vec3 size = m_box.max - m_box.min;
+    float longest = std::max(size.x, std::max(size.y, size.z));
+    if (!(longest > 0.0f))
+        return mesh;
+    float voxel = longest / resolution;
+    // two voxels of margin on every side: the surface never touches the border, so the outside is connected
+    // and the flood fill started in a corner reaches all of it
+    int dims[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        dims[axis] = (int) std::floor(size[axis] / voxel) + 5;
+    }
+    glm::vec3 origin = m_box.min - glm::vec3(2.0f * voxel);
+    std::vector<uint8_t> grid((size_t) dims[0] * dims[1] * dims[2], Empty);
+    auto cell = [&](int x, int y, int z) { return ((size_t) z * dims[1] + y) * dims[0] + x; };
+
+    // the surface: every triangle is sampled at half the voxel size, so no voxel it crosses is skipped.
+    // A sample marks every voxel within a quarter voxel of it, a surface on the border between two
+    // voxels marks both, so the inside never reaches up to the surface.
+    float spacing = voxel * 0.5f;
+    for (size_t i = 0; i < m_triangles.size(); i += 3) {
+        const glm::vec3 &a = m_triangles[i], &b = m_triangles[i + 1], &c = m_triangles[i + 2];
+        float longestEdge = std::max(glm::length(b - a), std::max(glm::length(c - a), glm::length(c - b)));
+        int steps = std::max(1, (int) std::ceil(longestEdge / spacing));
+        for (int s = 0; s <= steps; ++s) {
+            for (int t = 0; s + t <= steps; ++t) {
+                glm::vec3 p = a + (b - a) * ((float) s / steps) + (c - a) * ((float) t / steps);
+                int first[3], last[3];
+                for (int axis = 0; axis < 3; ++axis) {
+                    float q = (p[axis] - origin[axis]) / voxel;
+                    first[axis] = std::clamp((int) std::floor(q - 0.25f), 1, dims[axis] - 2);
+                    last[axis] = std::clamp((int) std::floor(q + 0.25f), 1, dims[axis] - 2);
+                }
+                for (int z = first[2]; z <= last[2]; ++z) {
+                    for (int y = first[1]; y <= last[1]; ++y) {
+                        for (int x = first[0]; x <= last[0]; ++x) {
+                            grid[cell(x, y, z)] = Surface;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<size_t> stack{0};
+    grid[0] = Outside;
+    while (!stack.empty()) {
+        size_t current = stack.back();
+        stack.pop_back();
+        int x = (int) (current % dims[0]);
+        int y = (int) (current / dims[0] % dims[1]);
+        int z = (int) (current / ((size_t) dims[0] * dims[1]));
+        const int neighbours[6][3] = {{x - 1, y, z}, {x + 1, y, z}, {x, y - 1, z}, {x, y + 1, z}, {x, y, z - 1}, {x, y, z + 1}};
+        for (const int *n : neighbours) {
+            if (n[0] < 0 || n[1] < 0 || n[2] < 0 || n[0] >= dims[0] || n[1] >= dims[1] || n[2] >= dims[2])
+                continue;
+            size_t next = cell(n[0], n[1], n[2]);
+            if (grid[next] == Empty) {
+                grid[next] = Outside;
+                stack.push_back(next);
+            }
+        }
+    }
+    auto inside = [&](const int p[3]) {
+        for (int axis = 0; axis < 3; ++axis) {
+            if (p[axis] < 0 || p[axis] >= dims[axis])
+                return false;
+        }
+        return grid[cell(p[0], p[1], p[2])] == Empty;
+    };
+
+    // the faces between inside and not inside voxels, slice by slice, merged greedily into rectangles
+    for (int axis = 0; axis < 3; ++axis) {
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+        std::vector<uint8_t> mask((size_t) dims[u] * dims[v]);
+        for (int side = -1; side <= 1; side += 2) {
+            for (int slice = 0; slice < dims[axis]; ++slice) {
+                for (int j = 0; j < dims[v]; ++j) {
+                    for (int i = 0; i < dims[u]; ++i) {
+                        int p[3], q[3];
+                        p[axis] = slice;
+                        p[u] = i;
+                        p[v] = j;
+                        std::copy(p, p + 3, q);
+                        q[axis] += side;
+                        mask[(size_t) j * dims[u] + i] = inside(p) && !inside(q);
+                    }
+                }
+                for (int j = 0; j < dims[v]; ++j) {
+                    for (int i = 0; i < dims[u];) {
+                        if (!mask[(size_t) j * dims[u] + i]) {
+                            ++i;
+                            continue;
+                        }
+                        int width = 1;
+                        while (i + width < dims[u] && mask[(size_t) j * dims[u] + i + width])
+                            ++width;
+                        int height = 1;
+                        for (; j + height < dims[v]; ++height) {
+                            const uint8_t *row = &mask[(size_t) (j + height) * dims[u] + i];
+                            if (std::find(row, row + width, 0) != row + width)
+                                break;
+                        }
+                        for (int h = 0; h < height; ++h) {
+                            std::fill_n(&mask[(size_t) (j + h) * dims[u] + i], width, 0);
+                        }
+                        emitQuad(mesh, origin, voxel, axis, side, slice + (side > 0), i, j, i + width, j + height);
+                        i += width;
+                    }
+                }
+            }
+        }
+    }
+    return mesh;
+}
+
+OcclusionBuffer::OcclusionBuffer(unsigned int width, unsigned int height) {
+    resize(width, height);
+}
+
+void OcclusionBuffer::resize(unsigned int width, unsigned int height) {
+    m_tilesX = std::max(1u, (width + TileWidth - 1) / TileWidth);
+    m_tilesY = std::max(1u, (height + TileHeight - 1) / TileHeight);
+    m_width = m_tilesX * TileWidth;
+    m_height = m_tilesY * TileHeight;
+    m_depth.assign((size_t) m_width * m_height, 1.0f);
+    m_triangles.clear();
+    m_tileTriangles.assign((size_t) m_tilesX * m_tilesY, {});
+}
+
+void OcclusionBuffer::begin(const glm::mat4 &viewProjection) {
+    m_viewProjection = viewProjection;
+    m_triangles.clear();
+    for (std::vector<uint32_t> &triangles : m_tileTriangles) {
+        triangles.clear();
+    }
+    m_counters = OcclusionCounters();
+}
+
+void OcclusionBuffer::addOccluder(const OccluderMesh &mesh, const glm::mat4 &model) {
+    glm::mat4 transform = m_viewProjection * model;
+    for (size_t i = 0; i + 3 <= mesh.vertices.size(); i += 3) {
+        ++m_counters.occluderTriangles;
+        glm::vec4 clip[3];
+        for (int corner = 0; corner < 3; ++corner) {
+            clip[corner] = transform * glm::vec4(mesh.vertices[i + corner], 1.0f);
+        }
+        // clipped against the near plane (z >= -w), the only one the division needs; the screen edges
+        // are handled by clamping to the buffer. One plane leaves at most a quad.
+        glm::vec4 polygon[4];
+        int count = 0;
+        for (int corner = 0; corner < 3; ++corner) {
+            const glm::vec4 &current = clip[corner];
+            const glm::vec4 &next = clip[(corner + 1) % 3];
+            float currentDistance = current.z + current.w;
+            float nextDistance = next.z + next.w;
+            if (currentDistance >= 0.0f)
+                polygon[count++] = current;
+            if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+                polygon[count++] = current + (next - current) * (currentDistance / (currentDistance - nextDistance));
+        }
+        for (int corner = 1; corner + 1 < count; ++corner) {
+            setupTriangle(polygon[0], polygon[corner], polygon[corner + 1]);
+        }
+    }
+}
+
+void OcclusionBuffer::setupTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c) {
+    // to pixels, the buffer covers [-1, 1] of NDC x and y
+    glm::vec3 screen[3];
+    const glm::vec4 *clip[3] = {&a, &b, &c};
+    for (int i = 0; i < 3; ++i) {
+        float inverseW = 1.0f / clip[i]->w;
+        screen[i] = glm::vec3((clip[i]->x * inverseW * 0.5f + 0.5f) * m_width,
+                              (clip[i]->y * inverseW * 0.5f + 0.5f) * m_height,
+                              clip[i]->z * inverseW);
+    }
+    glm::vec3 d1 = screen[1] - screen[0];
+    glm::vec3 d2 = screen[2] - screen[0];
+    float area = d1.x * d2.y - d2.x * d1.y;
+    // back facing, degenerate or not a number
+    if (!(area > 0.0f))
+        return;
+
+    Triangle t;
+    t.minDepth = std::min(screen[0].z, std::min(screen[1].z, screen[2].z));
+    t.maxDepth = std::max(screen[0].z, std::max(screen[1].z, screen[2].z));
+    if (t.minDepth >= 1.0f)
+        return;
+    // the pixels whose centers can be inside
+    float minX = std::min(screen[0].x, std::min(screen[1].x, screen[2].x));
+    float maxX = std::max(screen[0].x, std::max(screen[1].x, screen[2].x));
+    float minY = std::min(screen[0].y, std::min(screen[1].y, screen[2].y));
+    float maxY = std::max(screen[0].y, std::max(screen[1].y, screen[2].y));
+    t.minX = (int) std::max(0.0f, std::ceil(minX - 0.5f));
+    t.minY = (int) std::max(0.0f, std::ceil(minY - 0.5f));
+    t.maxX = (int) std::min(m_width - 1.0f, std::floor(maxX - 0.5f));
+    t.maxY = (int) std::min(m_height - 1.0f, std::floor(maxY - 0.5f));
+    if (t.minX > t.maxX || t.minY > t.maxY)
+        return;
+
+    for (int edge = 0; edge < 3; ++edge) {
+        const glm::vec3 &from = screen[edge];
+        const glm::vec3 &to = screen[(edge + 1) % 3];
+        t.edgeA[edge] = from.y - to.y;
+        t.edgeB[edge] = to.x - from.x;
+        t.edgeC[edge] = -(t.edgeA[edge] * from.x + t.edgeB[edge] * from.y);
+    }
+    t.depthA = (d1.z * d2.y - d2.z * d1.y) / area;
+    t.depthB = (d2.z * d1.x - d1.z * d2.x) / area;
+    t.depthC = screen[0].z - t.depthA * screen[0].x - t.depthB * screen[0].y;
+
+    uint32_t index = (uint32_t) m_triangles.size();
+    m_triangles.push_back(t);
+    for (int tileY = t.minY / (int) TileHeight; tileY <= t.maxY / (int) TileHeight; ++tileY) {
+        for (int tileX = t.minX / (int) TileWidth; tileX <= t.maxX / (int) TileWidth; ++tileX) {
+            m_tileTriangles[(size_t) tileY * m_tilesX + tileX].push_back(index);
+        }
+    }
+}
+
+void OcclusionBuffer::rasterize(bool parallel) {
+    Clock::time_point start = Clock::now();
+    SimdLevel level = kernelLevel(simd);
+    auto rasterizeOne = [&](size_t tile) { rasterizeTile((unsigned int) tile, level); };
+    size_t tiles = m_tileTriangles.size();
+    if (parallel && tiles > 1) {
+        ServiceLocator::Get().getJobSystem().parallelFor(tiles, rasterizeOne);
+    } else {
+        for (size_t tile = 0; tile < tiles; ++tile) {
+            rasterizeOne(tile);
+        }
+    }
+    m_counters.rasterizedTriangles = (unsigned int) m_triangles.size();
+    m_counters.rasterizeMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void OcclusionBuffer::rasterizeTile(unsigned int tile, SimdLevel level) {
+    int tileMinX = (int) (tile % m_tilesX * TileWidth);
+    int tileMinY = (int) (tile / m_tilesX * TileHeight);
+    int tileMaxX = tileMinX + (int) TileWidth - 1;
+    int tileMaxY = tileMinY + (int) TileHeight - 1;
+    for (int y = tileMinY; y <= tileMaxY; ++y) {
+        std::fill_n(m_depth.data() + (size_t) y * m_width + tileMinX, TileWidth, 1.0f);
+    }
+    for (uint32_t index : m_tileTriangles[tile]) {
+        const Triangle &t = m_triangles[index];
+        int minX = std::max(t.minX, tileMinX), maxX = std::min(t.maxX, tileMaxX);
+        int minY = std::max(t.minY, tileMinY), maxY = std::min(t.maxY, tileMaxY);
+#ifdef RG_SIMD_SSE
+        if (level == SimdLevel::Sse) {
+            rasterizeSse(t, m_depth.data(), m_width, minX, minY, maxX, maxY);
+            continue;
+        }
+#endif
+        rasterizeScalar(t, m_depth.data(), m_width, minX, minY, maxX, maxY);
+    }
+}
+
+bool OcclusionBuffer::visible(const Aabb &box) {
+    ++m_counters.tested;
+    if (box.empty())
+        return true;
+    float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+    float nearest = INFINITY;
+    for (int i = 0; i < 8; ++i) {
+        glm::vec3 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z);
+        glm::vec4 clip = m_viewProjection * glm::vec4(corner, 1.0f);
+        if (clip.z + clip.w < 0.0f || clip.w <= 0.0f)
+            return true;
+        float inverseW = 1.0f / clip.w;
+        float x = (clip.x * inverseW * 0.5f + 0.5f) * m_width;
+        float y = (clip.y * inverseW * 0.5f + 0.5f) * m_height;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearest = std::min(nearest, clip.z * inverseW);
+    }
+    // nothing is behind the far plane the buffer is cleared to
+    nearest = std::min(nearest, 1.0f);
+    // every pixel the box touches, not just the ones whose centers it covers
+    if (maxX < 0.0f || maxY < 0.0f || minX >= (float) m_width || minY >= (float) m_height)
+        return true;
+    int x0 = (int) std::max(0.0f, std::floor(minX));
+    int y0 = (int) std::max(0.0f, std::floor(minY));
+    int x1 = (int) std::min(m_width - 1.0f, std::floor(maxX));
+    int y1 = (int) std::min(m_height - 1.0f, std::floor(maxY));
+
+    bool result;
+#ifdef RG_SIMD_SSE
+    if (kernelLevel(simd) == SimdLevel::Sse)
+        result = anyNotInFrontSse(m_depth.data(), m_width, x0, y0, x1, y1, nearest);
+    else
+#endif
+        result = anyNotInFrontScalar(m_depth.data(), m_width, x0, y0, x1, y1, nearest);
+    if (!result)
+        ++m_counters.occluded;
+    return result;
+}
+
+SimdLevel OcclusionBuffer::kernelLevel(SimdLevel requested) {
+    if (requested == SimdLevel::Scalar || !simdSupported(SimdLevel::Sse))
+        return SimdLevel::Scalar;
+    return SimdLevel::Sse;
+}
+
+};
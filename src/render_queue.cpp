@@ -0,0 +1,334 @@
+#include <glad/glad.h>
+
+#include "rg/render_queue.h"
+#include "rg/gl_state.h"
+#include "rg/service_locator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace rg {
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // up to this many keys are insertion sorted
+    const size_t SmallSortCount = 64;
+
+    size_t wordsOf(uint8_t type) {
+        const size_t words[] = {1, 1, 3, 16};
+        return words[type];
+    }
+
+    bool sameTexture(const DrawPacket &previous, const TextureBinding &binding) {
+        for (unsigned int i = 0; i < previous.textureCount; ++i) {
+            if (previous.textures[i].unit == binding.unit)
+                return previous.textures[i].target == binding.target && previous.textures[i].texture == binding.texture;
+        }
+        return false;
+    }
+
+    void draw(const DrawPacket &packet) {
+        if (!packet.count || !packet.instances)
+            return;
+        GLenum mode = packet.primitive == Primitive::Lines ? GL_LINES : GL_TRIANGLES;
+        if (packet.indexType == IndexType::None) {
+            if (packet.instances > 1)
+                glDrawArraysInstanced(mode, (GLint) packet.first, packet.count, packet.instances);
+            else
+                glDrawArrays(mode, (GLint) packet.first, packet.count);
+            return;
+        }
+        GLenum type = packet.indexType == IndexType::UnsignedShort ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        void *offset = (void *) packet.first;
+        if (packet.instances > 1)
+            glDrawElementsInstancedBaseVertex(mode, packet.count, type, offset, packet.instances, packet.baseVertex);
+        else
+            glDrawElementsBaseVertex(mode, packet.count, type, offset, packet.baseVertex);
+    }
+}
+
+void CommandBuffer::clear() {
+    m_packets.clear();
+    m_keys.clear();
+    m_uniforms.clear();
+    m_uniformData.clear();
+    m_pendingUniforms = 0;
+    m_callbacks.clear();
+}
+
+void CommandBuffer::pushUniform(int location, UniformType type, const void *data, size_t words) {
+    if (location < 0)
+        return;
+    m_uniforms.push_back({location, type, (uint32_t) m_uniformData.size()});
+    size_t offset = m_uniformData.size();
+    m_uniformData.resize(offset + words);
+    std::memcpy(m_uniformData.data() + offset, data, words * sizeof(uint32_t));
+}
+
+void CommandBuffer::uniform(int location, int value) {
+    pushUniform(location, UniformType::Int, &value, 1);
+}
+
+void CommandBuffer::uniform(int location, float value) {
+    pushUniform(location, UniformType::Float, &value, 1);
+}
+
+void CommandBuffer::uniform(int location, const glm::vec3 &value) {
+    pushUniform(location, UniformType::Vec3, &value[0], 3);
+}
+
+void CommandBuffer::uniform(int location, const glm::mat4 &value) {
+    pushUniform(location, UniformType::Mat4, &value[0][0], 16);
+}
+
+void CommandBuffer::add(const DrawPacket &packet) {
+    addEntry(packet, NoCallback);
+}
+
+void CommandBuffer::add(const DrawPacket &packet, std::function<void()> draw) {
+    m_callbacks.push_back(std::move(draw));
+    addEntry(packet, (uint32_t) m_callbacks.size() - 1);
+}
+
+void CommandBuffer::addEntry(const DrawPacket &packet, uint32_t callback) {
+    uint32_t uniformCount = (uint32_t) m_uniforms.size() - m_pendingUniforms;
+    m_packets.push_back({packet, m_pendingUniforms, uniformCount, callback});
+    m_keys.push_back(RenderQueue::makeKey(packet, maxDepth));
+    m_pendingUniforms = (uint32_t) m_uniforms.size();
+}
+
+RenderQueue::RenderQueue() : m_buffers(1) {
+}
+
+void RenderQueue::clear() {
+    for (CommandBuffer &buffer : m_buffers) {
+        buffer.clear();
+    }
+    m_usedBuffers = 1;
+    m_buffers[0].maxDepth = maxDepth;
+    m_counters = RenderQueueCounters();
+}
+
+void RenderQueue::record(size_t chunks, const std::function<void(CommandBuffer &, size_t)> &fn, bool parallel) {
+    Clock::time_point start = Clock::now();
+    size_t first = m_usedBuffers;
+    m_usedBuffers += chunks;
+    if (m_buffers.size() < m_usedBuffers)
+        m_buffers.resize(m_usedBuffers);
+    for (size_t i = first; i < m_usedBuffers; ++i) {
+        m_buffers[i].maxDepth = maxDepth;
+    }
+    auto recordOne = [&](size_t chunk) { fn(m_buffers[first + chunk], chunk); };
+    if (parallel && chunks > 1) {
+        ServiceLocator::Get().getJobSystem().parallelFor(chunks, recordOne);
+    } else {
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            recordOne(chunk);
+        }
+    }
+    m_counters.recordMilliseconds += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+size_t RenderQueue::size() const {
+    size_t packets = 0;
+    for (size_t i = 0; i < m_usedBuffers; ++i) {
+        packets += m_buffers[i].size();
+    }
+    return packets;
+}
+
+uint64_t RenderQueue::makeKey(const DrawPacket &packet, float maxDepth) {
+    uint64_t pass = (uint64_t) packet.pass & 0xF;
+    uint64_t program = packet.program & 0x3FF;
+    uint64_t material = (packet.textureCount ? packet.textures[0].texture : 0) & 0xFFFF;
+    uint64_t vertexArray = packet.vertexArray & 0x3FF;
+    // NaN ends up in front
+    float normalized = packet.depth / maxDepth;
+    normalized = normalized > 0.0f ? std::min(normalized, 1.0f) : 0.0f;
+    uint64_t depth = (uint64_t) (normalized * 0xFFFFFF);
+    return pass << 60 | program << 50 | material << 34 | vertexArray << 24 | depth;
+}
+
+void RenderQueue::radixSort(const std::vector<uint64_t> &keys, std::vector<uint32_t> &order, std::vector<uint32_t> &scratch) {
+    size_t count = keys.size();
+    order.resize(count);
+    scratch.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        order[i] = (uint32_t) i;
+    }
+    // a frame of a few dozen packets is done before the histograms would even be cleared
+    if (count <= SmallSortCount) {
+        for (size_t i = 1; i < count; ++i) {
+            uint32_t index = order[i];
+            size_t j = i;
+            for (; j > 0 && keys[order[j - 1]] > keys[index]; --j) {
+                order[j] = order[j - 1];
+            }
+            order[j] = index;
+        }
+        return;
+    }
+    // the histograms of all digits in one pass over the keys
+    uint32_t histograms[8][256] = {};
+    for (uint64_t key : keys) {
+        for (int digit = 0; digit < 8; ++digit) {
+            ++histograms[digit][(key >> (digit * 8)) & 0xFF];
+        }
+    }
+    for (int digit = 0; digit < 8; ++digit) {
+        uint32_t *histogram = histograms[digit];
+        int shift = digit * 8;
+        // every key has the same value in this digit, the pass would not move anything
+        if (histogram[(keys[0] >> shift) & 0xFF] == count)
+            continue;
+        uint32_t offset = 0;
+        for (int bucket = 0; bucket < 256; ++bucket) {
+            uint32_t bucketCount = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketCount;
+        }
+        for (uint32_t index : order) {
+            scratch[histogram[(keys[index] >> shift) & 0xFF]++] = index;
+        }
+        order.swap(scratch);
+    }
+}
+
+void RenderQueue::countChanges(const DrawPacket &previous, const DrawPacket &packet, bool sorted) {
+    unsigned int programChanges = previous.program != packet.program;
+    unsigned int vertexArrayChanges = packet.vertexArray && previous.vertexArray != packet.vertexArray;
+    unsigned int textureChanges = 0;
+    for (unsigned int i = 0; i < packet.textureCount; ++i) {
+        textureChanges += !sameTexture(previous, packet.textures[i]);
+    }
+    if (sorted) {
+        m_counters.programChanges += programChanges;
+        m_counters.vertexArrayChanges += vertexArrayChanges;
+        m_counters.textureChanges += textureChanges;
+    } else {
+        m_counters.unsortedProgramChanges += programChanges;
+        m_counters.unsortedVertexArrayChanges += vertexArrayChanges;
+        m_counters.unsortedTextureChanges += textureChanges;
+    }
+}
+
+void RenderQueue::setUniforms(const CommandBuffer &buffer, const CommandBuffer::Entry &entry, std::vector<SetUniform> &current) {
+    using UniformType = CommandBuffer::UniformType;
+    for (uint32_t i = entry.firstUniform; i < entry.firstUniform + entry.uniformCount; ++i) {
+        const CommandBuffer::Uniform &uniform = buffer.m_uniforms[i];
+        const uint32_t *data = buffer.m_uniformData.data() + uniform.offset;
+        size_t words = wordsOf((uint8_t) uniform.type);
+        auto set = std::find_if(current.begin(), current.end(), [&](const SetUniform &other) { return other.location == uniform.location; });
+        if (set != current.end() && set->type == uniform.type && std::memcmp(set->data, data, words * sizeof(uint32_t)) == 0) {
+            ++m_counters.uniformsSkipped;
+            continue;
+        }
+        if (set != current.end())
+            *set = {uniform.location, uniform.type, data};
+        else
+            current.push_back({uniform.location, uniform.type, data});
+        switch (uniform.type) {
+            case UniformType::Int:
+                glUniform1i(uniform.location, (GLint) data[0]);
+                break;
+            case UniformType::Float:
+                glUniform1f(uniform.location, *reinterpret_cast<const float *>(data));
+                break;
+            case UniformType::Vec3:
+                glUniform3fv(uniform.location, 1, reinterpret_cast<const float *>(data));
+                break;
+            case UniformType::Mat4:
+                glUniformMatrix4fv(uniform.location, 1, GL_FALSE, reinterpret_cast<const float *>(data));
+                break;
+        }
+    }
+}
+
+void RenderQueue::sort() {
+    double recordMilliseconds = m_counters.recordMilliseconds;
+    m_counters = RenderQueueCounters();
+    m_counters.recordMilliseconds = recordMilliseconds;
+
+    // the buffers in the order they were handed out, so the same packets recorded by other threads
+    // give the same order
+    m_keys.clear();
+    m_refs.clear();
+    for (uint32_t buffer = 0; buffer < m_usedBuffers; ++buffer) {
+        const CommandBuffer &commands = m_buffers[buffer];
+        m_counters.commandBuffers += !commands.m_packets.empty();
+        m_keys.insert(m_keys.end(), commands.m_keys.begin(), commands.m_keys.end());
+        for (uint32_t i = 0; i < commands.m_packets.size(); ++i) {
+            m_refs.push_back({buffer, i});
+        }
+    }
+    m_counters.packets = (unsigned int) m_refs.size();
+
+    Clock::time_point start = Clock::now();
+    radixSort(m_keys, m_order, m_scratch);
+    m_counters.sortMicroseconds = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+    const DrawPacket none;
+    for (size_t i = 0; i < m_refs.size(); ++i) {
+        countChanges(i ? entry(m_refs[i - 1]).packet : none, entry(m_refs[i]).packet, false);
+    }
+    const DrawPacket *previous = &none;
+    for (uint32_t index : m_order) {
+        const DrawPacket &packet = entry(m_refs[index]).packet;
+        countChanges(*previous, packet, true);
+        previous = &packet;
+    }
+}
+
+void RenderQueue::submit() {
+    sort();
+
+    GLState &state = GLState::Get();
+    unsigned int currentProgram = 0;
+    // the uniform values the current program got from this queue
+    std::vector<SetUniform> current;
+    UniformBlockRange boundBlock;
+    for (uint32_t index : m_order) {
+        const Ref &ref = m_refs[index];
+        const CommandBuffer &buffer = m_buffers[ref.buffer];
+        const CommandBuffer::Entry &entry = buffer.m_packets[ref.entry];
+        const DrawPacket &packet = entry.packet;
+
+        state.useProgram(packet.program);
+        if (packet.program != currentProgram) {
+            current.clear();
+            currentProgram = packet.program;
+        }
+        if (packet.uniformBlock.buffer && !(packet.uniformBlock == boundBlock)) {
+            const UniformBlockRange &block = packet.uniformBlock;
+            state.bindBufferRange(GL_UNIFORM_BUFFER, block.binding, block.buffer, block.offset, block.size);
+            boundBlock = block;
+        }
+        if (packet.vertexArray)
+            state.bindVertexArray(packet.vertexArray);
+        for (unsigned int i = 0; i < packet.textureCount; ++i) {
+            const TextureBinding &binding = packet.textures[i];
+            state.bindTextureUnit(binding.unit, binding.target, binding.texture);
+        }
+        state.setEnabled(GL_CULL_FACE, packet.cullMode != CullMode::None);
+        if (packet.cullMode != CullMode::None)
+            state.cullFace(packet.cullMode == CullMode::Front ? GL_FRONT : GL_BACK);
+        state.depthFunc(packet.depthTest == DepthTest::LessEqual ? GL_LEQUAL : GL_LESS);
+        setUniforms(buffer, entry, current);
+
+        if (entry.callback != CommandBuffer::NoCallback) {
+            buffer.m_callbacks[entry.callback]();
+            // whatever it set or bound is not known here anymore
+            current.clear();
+            boundBlock = UniformBlockRange();
+        } else {
+            draw(packet);
+        }
+    }
+    state.setEnabled(GL_CULL_FACE, true);
+    state.cullFace(GL_BACK);
+    state.depthFunc(GL_LESS);
+}
+
+};
@@ -88,43 +88,36 @@ glm::vec2 InputController::getMouseOffset() const {
 }
 
 
-template<typename Process, typename ...Args>
-void ProcessController::pushProcess(Args &&...args) {
-    static_assert(std::is_base_of<ProcessBase, Process>::value);
-    m_next_frame_processes.push_back(std::make_unique<Process>(std::forward<Args>(args)...));
-}
-
 void ProcessController::pushProcess(std::unique_ptr<ProcessBase> p) {
     m_next_frame_processes.push_back(std::move(p));
 }
 
 
 void ProcessController::update(float dt) {
-    m_current_frame_processes.erase(
-            std::remove_if(
-                    m_current_frame_processes.begin(),
-                    m_current_frame_processes.end(),
-                    [](auto& p) { return p->isDone(); }
-                    ),
-            m_current_frame_processes.end()
-    );
-    std::move(
-            m_next_frame_processes.begin(),
-            m_next_frame_processes.end(),
-            std::back_inserter(m_current_frame_processes)
-    );
+    for (auto& p : m_next_frame_processes) {
+        m_buckets[p->priority()].push_back(std::move(p));
+    }
     m_next_frame_processes.clear();
 
-    std::stable_sort(
-        m_current_frame_processes.begin(),
-        m_current_frame_processes.end(),
-        [](auto& p1, auto& p2) {
-            return p1->priority() > p2->priority();
+    m_process_count = 0;
+    for (auto bucket = m_buckets.begin(); bucket != m_buckets.end();) {
+        Bucket& processes = bucket->second;
+        for (size_t i = 0; i < processes.size();) {
+            if (processes[i]->isDone()) {
+                // the last process takes its place and is looked at next
+                processes[i] = std::move(processes.back());
+                processes.pop_back();
+                continue;
+            }
+            processes[i]->update(dt);
+            ++i;
         }
-    );
-
-    for (auto& p : m_current_frame_processes) {
-        p->update(dt);
+        m_process_count += processes.size();
+        // a priority nobody uses anymore is not walked every frame
+        if (processes.empty())
+            bucket = m_buckets.erase(bucket);
+        else
+            ++bucket;
     }
 }
 
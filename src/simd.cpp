@@ -0,0 +1,59 @@
+#include "rg/simd.h"
+
+#include <initializer_list>
+
+namespace rg {
+
+const char *simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar:
+            return "scalar";
+        case SimdLevel::Sse:
+            return "sse";
+        case SimdLevel::Avx:
+            return "avx";
+        case SimdLevel::Avx2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+bool simdSupported(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar:
+            return true;
+        case SimdLevel::Sse:
+#ifdef RG_SIMD_SSE
+            return true;
+#else
+            return false;
+#endif
+        case SimdLevel::Avx:
+#ifdef RG_SIMD_AVX
+            return __builtin_cpu_supports("avx");
+#else
+            return false;
+#endif
+        case SimdLevel::Avx2:
+#ifdef RG_SIMD_AVX
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+SimdLevel bestSimdLevel() {
+    // asking the CPU is not free, the answer does not change
+    static const SimdLevel best = [] {
+        for (SimdLevel level : {SimdLevel::Avx2, SimdLevel::Avx, SimdLevel::Sse}) {
+            if (simdSupported(level))
+                return level;
+        }
+        return SimdLevel::Scalar;
+    }();
+    return best;
+}
+
+};
@@ -0,0 +1,247 @@
+#include <glad/glad.h>
+
+#include "rg/snow_particles.h"
+#include "rg/gl_state.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+namespace rg {
+
+namespace {
+    // a unit quad centered on the flake: position, texture coordinates
+    const float SnowflakeQuad[] = {
+            -0.5f,  0.5f, 0.0f, 0.0f, 0.0f,
+            -0.5f, -0.5f, 0.0f, 0.0f, 1.0f,
+             0.5f, -0.5f, 0.0f, 1.0f, 1.0f,
+
+            -0.5f,  0.5f, 0.0f, 0.0f, 0.0f,
+             0.5f, -0.5f, 0.0f, 1.0f, 1.0f,
+             0.5f,  0.5f, 0.0f, 1.0f, 0.0f
+    };
+
+    unsigned int createQuadBuffer() {
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        GLState::Get().bindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(SnowflakeQuad), SnowflakeQuad, GL_STATIC_DRAW);
+        return buffer;
+    }
+
+    // the quad attributes of the snowflake vertex shader, on the bound vertex array
+    void attachQuad(unsigned int quadBuffer) {
+        GLState::Get().bindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *) 0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *) (3 * sizeof(float)));
+    }
+
+    // 0 when the program does not build
+    unsigned int createUpdateProgram(const std::string &path) {
+        std::ifstream in(path);
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        std::string source = buffer.str();
+        if (source.empty())
+            std::cout << "ERROR::SNOW_PARTICLES::SHADER_NOT_FOUND " << path << std::endl;
+
+        const char *code = source.c_str();
+        unsigned int shader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(shader, 1, &code, nullptr);
+        glCompileShader(shader);
+        int success;
+        char infoLog[1024];
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(shader, sizeof(infoLog), nullptr, infoLog);
+            std::cout << "ERROR::SNOW_PARTICLES::COMPILATION_FAILED\n" << infoLog << std::endl;
+        }
+
+        unsigned int program = glCreateProgram();
+        glAttachShader(program, shader);
+        // the varyings have to be known before linking, which is why this does not go through Shader
+        const char *varyings[] = {"outPositionAngle", "outVelocityLife"};
+        glTransformFeedbackVaryings(program, 2, varyings, GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(program);
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glGetProgramInfoLog(program, sizeof(infoLog), nullptr, infoLog);
+            std::cout << "ERROR::SNOW_PARTICLES::LINKING_FAILED\n" << infoLog << std::endl;
+            glDeleteProgram(program);
+            program = 0;
+        }
+        glDeleteShader(shader);
+        return program;
+    }
+}
+
+SnowParticleSystem::SnowParticleSystem(const std::string &updateShaderPath, size_t count, const SnowParameters &parameters)
+        : parameters(parameters) {
+    m_updateProgram = createUpdateProgram(updateShaderPath);
+    m_uniforms.reflect(m_updateProgram);
+
+    m_quadBuffer = createQuadBuffer();
+    glGenBuffers(2, m_state);
+    createArrays();
+    resize(count);
+}
+
+SnowParticleSystem::~SnowParticleSystem() {
+    GLState &state = GLState::Get();
+    deleteArrays();
+    state.deleteBuffer(m_state[0]);
+    state.deleteBuffer(m_state[1]);
+    state.deleteBuffer(m_quadBuffer);
+    state.deleteProgram(m_updateProgram);
+}
+
+void SnowParticleSystem::createArrays() {
+    GLState &state = GLState::Get();
+    glGenVertexArrays(2, m_updateArray);
+    glGenVertexArrays(2, m_drawArray);
+    for (int i = 0; i < 2; ++i) {
+        // the update pass reads the whole state as two vertex attributes
+        state.bindVertexArray(m_updateArray[i]);
+        state.bindBuffer(GL_ARRAY_BUFFER, m_state[i]);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(SnowParticle), (void *) offsetof(SnowParticle, positionAngle));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(SnowParticle), (void *) offsetof(SnowParticle, velocityLife));
+
+        // the draw pass instances the quad once per flake
+        state.bindVertexArray(m_drawArray[i]);
+        attachQuad(m_quadBuffer);
+        state.bindBuffer(GL_ARRAY_BUFFER, m_state[i]);
+        glEnableVertexAttribArray(SNOWFLAKE_INSTANCE_ATTRIBUTE);
+        glVertexAttribPointer(SNOWFLAKE_INSTANCE_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(SnowParticle),
+                              (void *) offsetof(SnowParticle, positionAngle));
+        glVertexAttribDivisor(SNOWFLAKE_INSTANCE_ATTRIBUTE, 1);
+    }
+    state.bindVertexArray(0);
+}
+
+void SnowParticleSystem::deleteArrays() {
+    GLState &state = GLState::Get();
+    for (int i = 0; i < 2; ++i) {
+        state.deleteVertexArray(m_updateArray[i]);
+        state.deleteVertexArray(m_drawArray[i]);
+    }
+}
+
+void SnowParticleSystem::resize(size_t count) {
+    // the initial state is the only one that is ever built on the CPU
+    std::vector<SnowParticle> particles(count);
+    std::mt19937 generator(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    float fallSpeed = parameters.gravity / parameters.drag;
+    for (SnowParticle &particle : particles) {
+        glm::vec3 position = parameters.boxMin + (parameters.boxMax - parameters.boxMin) *
+                                                 glm::vec3(unit(generator), unit(generator), unit(generator));
+        particle.positionAngle = glm::vec4(position, unit(generator) * 6.2831853f);
+        particle.velocityLife = glm::vec4(parameters.wind.x, -fallSpeed, parameters.wind.z, unit(generator) * parameters.lifetime);
+    }
+
+    GLState &state = GLState::Get();
+    for (int i = 0; i < 2; ++i) {
+        state.bindBuffer(GL_ARRAY_BUFFER, m_state[i]);
+        glBufferData(GL_ARRAY_BUFFER, count * sizeof(SnowParticle), i == 0 ? particles.data() : nullptr, GL_STREAM_COPY);
+    }
+    m_current = 0;
+    m_count = count;
+}
+
+void SnowParticleSystem::update(float deltaTime, float time) {
+    if (m_count == 0 || !valid())
+        return;
+    GLState &state = GLState::Get();
+    state.useProgram(m_updateProgram);
+    glUniform1f(m_uniforms.find(UniformName("deltaTime").hash), std::min(deltaTime, parameters.maxStep));
+    glUniform1f(m_uniforms.find(UniformName("time").hash), time);
+    glUniform1ui(m_uniforms.find(UniformName("seed").hash), ++m_step * 2654435761u);
+    glUniform3fv(m_uniforms.find(UniformName("boxMin").hash), 1, &parameters.boxMin[0]);
+    glUniform3fv(m_uniforms.find(UniformName("boxMax").hash), 1, &parameters.boxMax[0]);
+    glUniform3fv(m_uniforms.find(UniformName("wind").hash), 1, &parameters.wind[0]);
+    glUniform1f(m_uniforms.find(UniformName("gravity").hash), parameters.gravity);
+    glUniform1f(m_uniforms.find(UniformName("drag").hash), parameters.drag);
+    glUniform1f(m_uniforms.find(UniformName("lifetime").hash), parameters.lifetime);
+
+    unsigned int next = 1 - m_current;
+    state.setEnabled(GL_RASTERIZER_DISCARD, true);
+    state.bindVertexArray(m_updateArray[m_current]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_state[next]);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, (GLsizei) m_count);
+    glEndTransformFeedback();
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    state.setEnabled(GL_RASTERIZER_DISCARD, false);
+    m_current = next;
+}
+
+void SnowParticleSystem::draw() {
+    if (m_count == 0)
+        return;
+    GLState::Get().bindVertexArray(m_drawArray[m_current]);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei) m_count);
+}
+
+CpuSnowParticleSystem::CpuSnowParticleSystem(size_t count, const SnowParameters &parameters)
+        : parameters(parameters), m_simulation(0, parameters) {
+    GLState &state = GLState::Get();
+    m_quadBuffer = createQuadBuffer();
+    glGenBuffers(1, &m_instanceBuffer);
+    glGenVertexArrays(1, &m_drawArray);
+    state.bindVertexArray(m_drawArray);
+    attachQuad(m_quadBuffer);
+    state.bindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    glEnableVertexAttribArray(SNOWFLAKE_INSTANCE_ATTRIBUTE);
+    glVertexAttribPointer(SNOWFLAKE_INSTANCE_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void *) 0);
+    glVertexAttribDivisor(SNOWFLAKE_INSTANCE_ATTRIBUTE, 1);
+    state.bindVertexArray(0);
+    resize(count);
+}
+
+CpuSnowParticleSystem::~CpuSnowParticleSystem() {
+    GLState &state = GLState::Get();
+    state.deleteVertexArray(m_drawArray);
+    state.deleteBuffer(m_instanceBuffer);
+    state.deleteBuffer(m_quadBuffer);
+}
+
+void CpuSnowParticleSystem::resize(size_t count) {
+    m_simulation.parameters = parameters;
+    m_simulation.resize(count);
+    GLState::Get().bindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+}
+
+void CpuSnowParticleSystem::update(float deltaTime, float time) {
+    m_simulation.parameters = parameters;
+    if (size() == 0)
+        return;
+    GLState::Get().bindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    // invalidating the whole buffer lets the driver hand out fresh memory instead of waiting
+    // for the draw of the previous frame to finish reading it
+    void *flakes = glMapBufferRange(GL_ARRAY_BUFFER, 0, size() * sizeof(glm::vec4),
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!flakes) {
+        std::cout << "ERROR::SNOW_PARTICLES::MAP_FAILED" << std::endl;
+        return;
+    }
+    // the workers only write memory, every GL call stays on this thread
+    m_simulation.step(deltaTime, time, (glm::vec4 *) flakes);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+}
+
+void CpuSnowParticleSystem::draw() {
+    if (size() == 0)
+        return;
+    GLState::Get().bindVertexArray(m_drawArray);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei) size());
+}
+
+};
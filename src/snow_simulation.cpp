@@ -0,0 +1,334 @@
+#include "rg/snow_simulation.h"
+#include "rg/service_locator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#ifdef RG_SIMD_SSE
+#include <xmmintrin.h>
+#endif
+#ifdef RG_SIMD_AVX
+#include <immintrin.h>
+#endif
+
+namespace rg {
+
+namespace {
+    // everything a step needs that is the same for every flake
+    struct StepConstants {
+        float deltaTime;
+        float pull;         // how far the velocity moves towards the air velocity, min(drag * dt, 1)
+        float fall;         // gravity * dt
+        glm::vec3 wind;
+        // air = wind + 0.6 * (sin(1.3 t + phase), 0, cos(1.7 t + phase)), expanded with the angle sum
+        // identities into a weighted sum of the per flake sin(phase) and cos(phase), so no flake needs a sin
+        float flutterXCos, flutterXSin, flutterZCos, flutterZSin;
+        glm::vec3 boxMin, boxMax, boxSize;
+        float fallSpeed;
+        float lifetime;
+        uint32_t seed;
+    };
+
+    using KernelFunction = void (*)(const SnowSimulation::Lanes &, size_t, size_t, const StepConstants &, glm::vec4 *);
+
+    // the hash and random of snowflake_update.vs, so both paths respawn a flake at the same place
+    uint32_t hashFlake(uint32_t x) {
+        x ^= x >> 16u;
+        x *= 0x7feb352du;
+        x ^= x >> 15u;
+        x *= 0x846ca68bu;
+        x ^= x >> 16u;
+        return x;
+    }
+
+    float random(uint32_t &state) {
+        state = hashFlake(state);
+        return float(state >> 8u) * (1.0f / 16777216.0f);
+    }
+
+    void respawn(const SnowSimulation::Lanes &l, size_t i, const StepConstants &c) {
+        uint32_t state = hashFlake((uint32_t) i) ^ c.seed;
+        l.x[i] = c.boxMin.x + c.boxSize.x * random(state);
+        l.y[i] = c.boxMax.y;
+        l.z[i] = c.boxMin.z + c.boxSize.z * random(state);
+        l.velocityX[i] = c.wind.x + c.flutterXCos * l.cosPhase[i] + c.flutterXSin * l.sinPhase[i];
+        l.velocityY[i] = -c.fallSpeed;
+        l.velocityZ[i] = c.wind.z + c.flutterZCos * l.cosPhase[i] + c.flutterZSin * l.sinPhase[i];
+        l.life[i] = c.lifetime * (0.5f + 0.5f * random(state));
+    }
+
+    void updateScalar(const SnowSimulation::Lanes &l, size_t begin, size_t end, const StepConstants &c, glm::vec4 *out) {
+        for (size_t i = begin; i < end; ++i) {
+            float airX = c.wind.x + c.flutterXCos * l.cosPhase[i] + c.flutterXSin * l.sinPhase[i];
+            float airZ = c.wind.z + c.flutterZCos * l.cosPhase[i] + c.flutterZSin * l.sinPhase[i];
+            float velocityX = l.velocityX[i] + (airX - l.velocityX[i]) * c.pull;
+            float velocityY = l.velocityY[i] + (c.wind.y - l.velocityY[i]) * c.pull - c.fall;
+            float velocityZ = l.velocityZ[i] + (airZ - l.velocityZ[i]) * c.pull;
+            float x = l.x[i] + velocityX * c.deltaTime;
+            float y = l.y[i] + velocityY * c.deltaTime;
+            float z = l.z[i] + velocityZ * c.deltaTime;
+            // flakes blown out of the box come back on the other side
+            if (x < c.boxMin.x)
+                x += c.boxSize.x;
+            else if (x >= c.boxMax.x)
+                x -= c.boxSize.x;
+            if (z < c.boxMin.z)
+                z += c.boxSize.z;
+            else if (z >= c.boxMax.z)
+                z -= c.boxSize.z;
+            float life = l.life[i] - c.deltaTime;
+
+            l.x[i] = x;
+            l.y[i] = y;
+            l.z[i] = z;
+            l.angle[i] += l.spin[i] * c.deltaTime;
+            l.velocityX[i] = velocityX;
+            l.velocityY[i] = velocityY;
+            l.velocityZ[i] = velocityZ;
+            l.life[i] = life;
+            if (life <= 0.0f || y < c.boxMin.y)
+                respawn(l, i, c);
+            if (out)
+                out[i] = glm::vec4(l.x[i], l.y[i], l.z[i], l.angle[i]);
+        }
+    }
+
+#ifdef RG_SIMD_SSE
+    // writes 4 flakes, one xyz + angle vec4 each
+    inline void storeFlakes(float *out, __m128 x, __m128 y, __m128 z, __m128 angle) {
+        _MM_TRANSPOSE4_PS(x, y, z, angle);
+        _mm_storeu_ps(out, x);
+        _mm_storeu_ps(out + 4, y);
+        _mm_storeu_ps(out + 8, z);
+        _mm_storeu_ps(out + 12, angle);
+    }
+
+    void updateSse(const SnowSimulation::Lanes &l, size_t begin, size_t end, const StepConstants &c, glm::vec4 *out) {
+        const __m128 deltaTime = _mm_set1_ps(c.deltaTime);
+        const __m128 pull = _mm_set1_ps(c.pull);
+        const __m128 fall = _mm_set1_ps(c.fall);
+        const __m128 windX = _mm_set1_ps(c.wind.x), windY = _mm_set1_ps(c.wind.y), windZ = _mm_set1_ps(c.wind.z);
+        const __m128 flutterXCos = _mm_set1_ps(c.flutterXCos), flutterXSin = _mm_set1_ps(c.flutterXSin);
+        const __m128 flutterZCos = _mm_set1_ps(c.flutterZCos), flutterZSin = _mm_set1_ps(c.flutterZSin);
+        const __m128 minX = _mm_set1_ps(c.boxMin.x), maxX = _mm_set1_ps(c.boxMax.x), sizeX = _mm_set1_ps(c.boxSize.x);
+        const __m128 minZ = _mm_set1_ps(c.boxMin.z), maxZ = _mm_set1_ps(c.boxMax.z), sizeZ = _mm_set1_ps(c.boxSize.z);
+        const __m128 minY = _mm_set1_ps(c.boxMin.y);
+        const __m128 zero = _mm_setzero_ps();
+
+        size_t i = begin;
+        for (; i + 4 <= end; i += 4) {
+            __m128 cosPhase = _mm_loadu_ps(l.cosPhase + i);
+            __m128 sinPhase = _mm_loadu_ps(l.sinPhase + i);
+            __m128 airX = _mm_add_ps(windX, _mm_add_ps(_mm_mul_ps(flutterXCos, cosPhase), _mm_mul_ps(flutterXSin, sinPhase)));
+            __m128 airZ = _mm_add_ps(windZ, _mm_add_ps(_mm_mul_ps(flutterZCos, cosPhase), _mm_mul_ps(flutterZSin, sinPhase)));
+
+            __m128 velocityX = _mm_loadu_ps(l.velocityX + i);
+            __m128 velocityY = _mm_loadu_ps(l.velocityY + i);
+            __m128 velocityZ = _mm_loadu_ps(l.velocityZ + i);
+            velocityX = _mm_add_ps(velocityX, _mm_mul_ps(_mm_sub_ps(airX, velocityX), pull));
+            velocityY = _mm_sub_ps(_mm_add_ps(velocityY, _mm_mul_ps(_mm_sub_ps(windY, velocityY), pull)), fall);
+            velocityZ = _mm_add_ps(velocityZ, _mm_mul_ps(_mm_sub_ps(airZ, velocityZ), pull));
+
+            __m128 x = _mm_add_ps(_mm_loadu_ps(l.x + i), _mm_mul_ps(velocityX, deltaTime));
+            __m128 y = _mm_add_ps(_mm_loadu_ps(l.y + i), _mm_mul_ps(velocityY, deltaTime));
+            __m128 z = _mm_add_ps(_mm_loadu_ps(l.z + i), _mm_mul_ps(velocityZ, deltaTime));
+            x = _mm_add_ps(x, _mm_and_ps(_mm_cmplt_ps(x, minX), sizeX));
+            x = _mm_sub_ps(x, _mm_and_ps(_mm_cmpge_ps(x, maxX), sizeX));
+            z = _mm_add_ps(z, _mm_and_ps(_mm_cmplt_ps(z, minZ), sizeZ));
+            z = _mm_sub_ps(z, _mm_and_ps(_mm_cmpge_ps(z, maxZ), sizeZ));
+            __m128 angle = _mm_add_ps(_mm_loadu_ps(l.angle + i), _mm_mul_ps(_mm_loadu_ps(l.spin + i), deltaTime));
+            __m128 life = _mm_sub_ps(_mm_loadu_ps(l.life + i), deltaTime);
+
+            _mm_storeu_ps(l.x + i, x);
+            _mm_storeu_ps(l.y + i, y);
+            _mm_storeu_ps(l.z + i, z);
+            _mm_storeu_ps(l.angle + i, angle);
+            _mm_storeu_ps(l.velocityX + i, velocityX);
+            _mm_storeu_ps(l.velocityY + i, velocityY);
+            _mm_storeu_ps(l.velocityZ + i, velocityZ);
+            _mm_storeu_ps(l.life + i, life);
+
+            // respawns are rare, the few lanes that need one are done one by one
+            int dead = _mm_movemask_ps(_mm_or_ps(_mm_cmple_ps(life, zero), _mm_cmplt_ps(y, minY)));
+            if (dead) {
+                for (int lane = 0; lane < 4; ++lane) {
+                    if (dead & (1 << lane))
+                        respawn(l, i + lane, c);
+                }
+                x = _mm_loadu_ps(l.x + i);
+                y = _mm_loadu_ps(l.y + i);
+                z = _mm_loadu_ps(l.z + i);
+            }
+            if (out)
+                storeFlakes((float *) (out + i), x, y, z, angle);
+        }
+        updateScalar(l, i, end, c, out);
+    }
+#endif
+
+#ifdef RG_SIMD_AVX
+    __attribute__((target("avx")))
+    void updateAvx(const SnowSimulation::Lanes &l, size_t begin, size_t end, const StepConstants &c, glm::vec4 *out) {
+        const __m256 deltaTime = _mm256_set1_ps(c.deltaTime);
+        const __m256 pull = _mm256_set1_ps(c.pull);
+        const __m256 fall = _mm256_set1_ps(c.fall);
+        const __m256 windX = _mm256_set1_ps(c.wind.x), windY = _mm256_set1_ps(c.wind.y), windZ = _mm256_set1_ps(c.wind.z);
+        const __m256 flutterXCos = _mm256_set1_ps(c.flutterXCos), flutterXSin = _mm256_set1_ps(c.flutterXSin);
+        const __m256 flutterZCos = _mm256_set1_ps(c.flutterZCos), flutterZSin = _mm256_set1_ps(c.flutterZSin);
+        const __m256 minX = _mm256_set1_ps(c.boxMin.x), maxX = _mm256_set1_ps(c.boxMax.x), sizeX = _mm256_set1_ps(c.boxSize.x);
+        const __m256 minZ = _mm256_set1_ps(c.boxMin.z), maxZ = _mm256_set1_ps(c.boxMax.z), sizeZ = _mm256_set1_ps(c.boxSize.z);
+        const __m256 minY = _mm256_set1_ps(c.boxMin.y);
+        const __m256 zero = _mm256_setzero_ps();
+
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+            __m256 cosPhase = _mm256_loadu_ps(l.cosPhase + i);
+            __m256 sinPhase = _mm256_loadu_ps(l.sinPhase + i);
+            __m256 airX = _mm256_add_ps(windX, _mm256_add_ps(_mm256_mul_ps(flutterXCos, cosPhase), _mm256_mul_ps(flutterXSin, sinPhase)));
+            __m256 airZ = _mm256_add_ps(windZ, _mm256_add_ps(_mm256_mul_ps(flutterZCos, cosPhase), _mm256_mul_ps(flutterZSin, sinPhase)));
+
+            __m256 velocityX = _mm256_loadu_ps(l.velocityX + i);
+            __m256 velocityY = _mm256_loadu_ps(l.velocityY + i);
+            __m256 velocityZ = _mm256_loadu_ps(l.velocityZ + i);
+            velocityX = _mm256_add_ps(velocityX, _mm256_mul_ps(_mm256_sub_ps(airX, velocityX), pull));
+            velocityY = _mm256_sub_ps(_mm256_add_ps(velocityY, _mm256_mul_ps(_mm256_sub_ps(windY, velocityY), pull)), fall);
+            velocityZ = _mm256_add_ps(velocityZ, _mm256_mul_ps(_mm256_sub_ps(airZ, velocityZ), pull));
+
+            __m256 x = _mm256_add_ps(_mm256_loadu_ps(l.x + i), _mm256_mul_ps(velocityX, deltaTime));
+            __m256 y = _mm256_add_ps(_mm256_loadu_ps(l.y + i), _mm256_mul_ps(velocityY, deltaTime));
+            __m256 z = _mm256_add_ps(_mm256_loadu_ps(l.z + i), _mm256_mul_ps(velocityZ, deltaTime));
+            x = _mm256_add_ps(x, _mm256_and_ps(_mm256_cmp_ps(x, minX, _CMP_LT_OQ), sizeX));
+            x = _mm256_sub_ps(x, _mm256_and_ps(_mm256_cmp_ps(x, maxX, _CMP_GE_OQ), sizeX));
+            z = _mm256_add_ps(z, _mm256_and_ps(_mm256_cmp_ps(z, minZ, _CMP_LT_OQ), sizeZ));
+            z = _mm256_sub_ps(z, _mm256_and_ps(_mm256_cmp_ps(z, maxZ, _CMP_GE_OQ), sizeZ));
+            __m256 angle = _mm256_add_ps(_mm256_loadu_ps(l.angle + i), _mm256_mul_ps(_mm256_loadu_ps(l.spin + i), deltaTime));
+            __m256 life = _mm256_sub_ps(_mm256_loadu_ps(l.life + i), deltaTime);
+
+            _mm256_storeu_ps(l.x + i, x);
+            _mm256_storeu_ps(l.y + i, y);
+            _mm256_storeu_ps(l.z + i, z);
+            _mm256_storeu_ps(l.angle + i, angle);
+            _mm256_storeu_ps(l.velocityX + i, velocityX);
+            _mm256_storeu_ps(l.velocityY + i, velocityY);
+            _mm256_storeu_ps(l.velocityZ + i, velocityZ);
+            _mm256_storeu_ps(l.life + i, life);
+
+            int dead = _mm256_movemask_ps(_mm256_or_ps(_mm256_cmp_ps(life, zero, _CMP_LE_OQ), _mm256_cmp_ps(y, minY, _CMP_LT_OQ)));
+            if (dead) {
+                for (int lane = 0; lane < 8; ++lane) {
+                    if (dead & (1 << lane))
+                        respawn(l, i + lane, c);
+                }
+                x = _mm256_loadu_ps(l.x + i);
+                y = _mm256_loadu_ps(l.y + i);
+                z = _mm256_loadu_ps(l.z + i);
+            }
+            if (out) {
+                float *flakes = (float *) (out + i);
+                storeFlakes(flakes, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y),
+                            _mm256_castps256_ps128(z), _mm256_castps256_ps128(angle));
+                storeFlakes(flakes + 16, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1),
+                            _mm256_extractf128_ps(z, 1), _mm256_extractf128_ps(angle, 1));
+            }
+        }
+        updateScalar(l, i, end, c, out);
+    }
+#endif
+
+    KernelFunction kernelFunction(SimdLevel level) {
+        switch (level) {
+#ifdef RG_SIMD_SSE
+            case SimdLevel::Sse:
+                return updateSse;
+#endif
+#ifdef RG_SIMD_AVX
+            case SimdLevel::Avx:
+                return updateAvx;
+#endif
+            default:
+                return updateScalar;
+        }
+    }
+}
+
+SnowSimulation::SnowSimulation(size_t count, const SnowParameters &parameters)
+        : parameters(parameters) {
+    resize(count);
+}
+
+void SnowSimulation::resize(size_t count) {
+    for (std::vector<float> *attribute : {&m_x, &m_y, &m_z, &m_angle, &m_velocityX, &m_velocityY, &m_velocityZ, &m_life,
+                                          &m_sinPhase, &m_cosPhase, &m_spin}) {
+        attribute->resize(count);
+    }
+    // same generator and order as rg::SnowParticleSystem::resize
+    std::mt19937 generator(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    glm::vec3 boxSize = parameters.boxMax - parameters.boxMin;
+    float fallSpeed = parameters.gravity / parameters.drag;
+    for (size_t i = 0; i < count; ++i) {
+        m_x[i] = parameters.boxMin.x + boxSize.x * unit(generator);
+        m_y[i] = parameters.boxMin.y + boxSize.y * unit(generator);
+        m_z[i] = parameters.boxMin.z + boxSize.z * unit(generator);
+        m_angle[i] = unit(generator) * 6.2831853f;
+        m_velocityX[i] = parameters.wind.x;
+        m_velocityY[i] = -fallSpeed;
+        m_velocityZ[i] = parameters.wind.z;
+        m_life[i] = unit(generator) * parameters.lifetime;
+
+        float phase = float(hashFlake((uint32_t) i) & 1023u) * (6.2831853f / 1024.0f);
+        m_sinPhase[i] = std::sin(phase);
+        m_cosPhase[i] = std::cos(phase);
+        m_spin[i] = 0.5f + phase * 0.3f;
+    }
+    m_count = count;
+}
+
+void SnowSimulation::step(float deltaTime, float time, glm::vec4 *out, bool parallel) {
+    if (m_count == 0)
+        return;
+    deltaTime = std::min(deltaTime, parameters.maxStep);
+
+    StepConstants c;
+    c.deltaTime = deltaTime;
+    c.pull = std::min(parameters.drag * deltaTime, 1.0f);
+    c.fall = parameters.gravity * deltaTime;
+    c.wind = parameters.wind;
+    // sin(a + p) = sin a cos p + cos a sin p, cos(b + p) = cos b cos p - sin b sin p
+    c.flutterXCos = 0.6f * std::sin(time * 1.3f);
+    c.flutterXSin = 0.6f * std::cos(time * 1.3f);
+    c.flutterZCos = 0.6f * std::cos(time * 1.7f);
+    c.flutterZSin = -0.6f * std::sin(time * 1.7f);
+    c.boxMin = parameters.boxMin;
+    c.boxMax = parameters.boxMax;
+    c.boxSize = parameters.boxMax - parameters.boxMin;
+    c.fallSpeed = parameters.gravity / parameters.drag;
+    c.lifetime = parameters.lifetime;
+    c.seed = ++m_step * 2654435761u;
+
+    Lanes lanes{m_x.data(), m_y.data(), m_z.data(), m_angle.data(),
+                m_velocityX.data(), m_velocityY.data(), m_velocityZ.data(), m_life.data(),
+                m_sinPhase.data(), m_cosPhase.data(), m_spin.data()};
+    KernelFunction update = kernelFunction(kernelLevel(simd));
+    size_t chunks = (m_count + ChunkSize - 1) / ChunkSize;
+    auto updateChunk = [&](size_t chunk) {
+        size_t begin = chunk * ChunkSize;
+        update(lanes, begin, std::min(begin + ChunkSize, m_count), c, out);
+    };
+    if (parallel && chunks > 1) {
+        ServiceLocator::Get().getJobSystem().parallelFor(chunks, updateChunk);
+    } else {
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            updateChunk(chunk);
+        }
+    }
+}
+
+SimdLevel SnowSimulation::kernelLevel(SimdLevel requested) {
+    if (!simdSupported(requested))
+        return SimdLevel::Scalar;
+    return requested == SimdLevel::Avx2 ? SimdLevel::Avx : requested;
+}
+
+};
@@ -0,0 +1,577 @@
+#include "rg/texture_compression.h"
+#include "rg/service_locator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace rg {
+
+namespace {
+    // GL enums, spelled out so this file does not depend on the GL headers
+    const uint32_t GlCompressedRgbS3tcDxt1 = 0x83F0;
+    const uint32_t GlCompressedRgbaS3tcDxt5 = 0x83F3;
+    const uint32_t GlCompressedRedRgtc1 = 0x8DBB;
+    const uint32_t GlCompressedRgRgtc2 = 0x8DBD;
+    const uint32_t GlRed = 0x1903;
+    const uint32_t GlRgb = 0x1907;
+    const uint32_t GlRgba = 0x1908;
+    const uint32_t GlRg = 0x8227;
+
+    // bumped whenever the encoder output changes, so cooked files get rebuilt
+    const char *EncoderVersion = "1";
+    const char *SourceHashKey = "rg.sourceHash";
+    const char *EncoderVersionKey = "rg.encoderVersion";
+
+    const unsigned char KtxIdentifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+    const uint32_t KtxEndianness = 0x04030201;
+
+    struct KtxHeader {
+        unsigned char identifier[12];
+        uint32_t endianness;
+        uint32_t glType;
+        uint32_t glTypeSize;
+        uint32_t glFormat;
+        uint32_t glInternalFormat;
+        uint32_t glBaseInternalFormat;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t numberOfArrayElements;
+        uint32_t numberOfFaces;
+        uint32_t numberOfMipmapLevels;
+        uint32_t bytesOfKeyValueData;
+    };
+
+    uint32_t glBaseInternalFormat(BlockFormat format) {
+        switch (format) {
+            case BlockFormat::BC3: return GlRgba;
+            case BlockFormat::BC4: return GlRed;
+            case BlockFormat::BC5: return GlRg;
+            default: return GlRgb;
+        }
+    }
+
+    size_t levelBytes(BlockFormat format, uint32_t width, uint32_t height) {
+        return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+    }
+
+    uint16_t packRgb565(const float color[3]) {
+        int r = std::clamp((int) std::lround(color[0] * 31.0f / 255.0f), 0, 31);
+        int g = std::clamp((int) std::lround(color[1] * 63.0f / 255.0f), 0, 63);
+        int b = std::clamp((int) std::lround(color[2] * 31.0f / 255.0f), 0, 31);
+        return (uint16_t) (r << 11 | g << 5 | b);
+    }
+
+    void unpackRgb565(uint16_t packed, int color[3]) {
+        int r = (packed >> 11) & 31;
+        int g = (packed >> 5) & 63;
+        int b = packed & 31;
+        color[0] = r << 3 | r >> 2;
+        color[1] = g << 2 | g >> 4;
+        color[2] = b << 3 | b >> 2;
+    }
+
+    // assigns every texel to the closest of the four palette colors, returns the squared error
+    int bc1Indices(const unsigned char *rgba, uint16_t color0, uint16_t color1, uint32_t &indices) {
+        int palette[4][3];
+        unpackRgb565(color0, palette[0]);
+        unpackRgb565(color1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        int totalError = 0;
+        indices = 0;
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            int bestError = INT32_MAX;
+            for (int p = 0; p < 4; ++p) {
+                int dr = rgba[i * 4 + 0] - palette[p][0];
+                int dg = rgba[i * 4 + 1] - palette[p][1];
+                int db = rgba[i * 4 + 2] - palette[p][2];
+                int error = dr * dr + dg * dg + db * db;
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            totalError += bestError;
+            indices |= (uint32_t) best << (2 * i);
+        }
+        return totalError;
+    }
+
+    // color0 > color1 selects the four color mode; equal endpoints only ever need index 0
+    void orderEndpoints(uint16_t &color0, uint16_t &color1) {
+        if (color0 < color1)
+            std::swap(color0, color1);
+    }
+
+    void writeBC1(unsigned char *out, uint16_t color0, uint16_t color1, uint32_t indices) {
+        std::memcpy(out, &color0, 2);
+        std::memcpy(out + 2, &color1, 2);
+        std::memcpy(out + 4, &indices, 4);
+    }
+
+    // texels of the block at (blockX, blockY), edges are clamped for sizes that are not a multiple of 4
+    void fetchBlock(const unsigned char *pixels, uint32_t width, uint32_t height, int components,
+                    uint32_t blockX, uint32_t blockY, unsigned char rgba[64]) {
+        for (uint32_t y = 0; y < 4; ++y) {
+            for (uint32_t x = 0; x < 4; ++x) {
+                uint32_t px = std::min(blockX * 4 + x, width - 1);
+                uint32_t py = std::min(blockY * 4 + y, height - 1);
+                const unsigned char *texel = pixels + ((size_t) py * width + px) * components;
+                unsigned char *dst = rgba + (y * 4 + x) * 4;
+                if (components == 1) {
+                    dst[0] = dst[1] = dst[2] = texel[0];
+                    dst[3] = 255;
+                } else {
+                    dst[0] = texel[0];
+                    dst[1] = texel[1];
+                    dst[2] = texel[2];
+                    dst[3] = components == 4 ? texel[3] : 255;
+                }
+            }
+        }
+    }
+
+    void encodeBlock(BlockFormat format, const unsigned char rgba[64], unsigned char *out) {
+        unsigned char channel[16];
+        switch (format) {
+            case BlockFormat::BC1:
+                encodeBC1Block(rgba, out);
+                break;
+            case BlockFormat::BC3:
+                for (int i = 0; i < 16; ++i)
+                    channel[i] = rgba[i * 4 + 3];
+                encodeBC4Block(channel, out);
+                encodeBC1Block(rgba, out + 8);
+                break;
+            case BlockFormat::BC4:
+                for (int i = 0; i < 16; ++i)
+                    channel[i] = rgba[i * 4];
+                encodeBC4Block(channel, out);
+                break;
+            case BlockFormat::BC5:
+                for (int i = 0; i < 16; ++i)
+                    channel[i] = rgba[i * 4];
+                encodeBC4Block(channel, out);
+                for (int i = 0; i < 16; ++i)
+                    channel[i] = rgba[i * 4 + 1];
+                encodeBC4Block(channel, out + 8);
+                break;
+        }
+    }
+
+    void encodeLevel(const unsigned char *pixels, uint32_t width, uint32_t height, int components, BlockFormat format,
+                     std::vector<unsigned char> &out) {
+        uint32_t blocksX = (width + 3) / 4;
+        uint32_t blocksY = (height + 3) / 4;
+        size_t bytes = blockBytes(format);
+        out.resize((size_t) blocksX * blocksY * bytes);
+        auto encodeRow = [&](size_t blockY) {
+            unsigned char rgba[64];
+            for (uint32_t blockX = 0; blockX < blocksX; ++blockX) {
+                fetchBlock(pixels, width, height, components, blockX, blockY, rgba);
+                encodeBlock(format, rgba, out.data() + ((size_t) blockY * blocksX + blockX) * bytes);
+            }
+        };
+        // small levels are not worth the hand off to the pool
+        if (blocksX * blocksY < 1024) {
+            for (uint32_t blockY = 0; blockY < blocksY; ++blockY)
+                encodeRow(blockY);
+        } else {
+            ServiceLocator::Get().getJobSystem().parallelFor(blocksY, encodeRow);
+        }
+    }
+
+    // 2x2 box filter; odd sizes clamp at the edge. Normal maps are renormalized, otherwise
+    // the shorter averaged normals would darken the lighting at a distance.
+    void downsample(const std::vector<unsigned char> &src, uint32_t width, uint32_t height, int components,
+                    bool normalMap, std::vector<unsigned char> &dst, uint32_t &dstWidth, uint32_t &dstHeight) {
+        dstWidth = std::max(1u, width / 2);
+        dstHeight = std::max(1u, height / 2);
+        dst.resize((size_t) dstWidth * dstHeight * components);
+        for (uint32_t y = 0; y < dstHeight; ++y) {
+            uint32_t y0 = std::min(2 * y, height - 1);
+            uint32_t y1 = std::min(2 * y + 1, height - 1);
+            for (uint32_t x = 0; x < dstWidth; ++x) {
+                uint32_t x0 = std::min(2 * x, width - 1);
+                uint32_t x1 = std::min(2 * x + 1, width - 1);
+                unsigned char *out = dst.data() + ((size_t) y * dstWidth + x) * components;
+                for (int c = 0; c < components; ++c) {
+                    int sum = src[((size_t) y0 * width + x0) * components + c] + src[((size_t) y0 * width + x1) * components + c]
+                              + src[((size_t) y1 * width + x0) * components + c] + src[((size_t) y1 * width + x1) * components + c];
+                    out[c] = (unsigned char) ((sum + 2) / 4);
+                }
+                if (normalMap) {
+                    float n[3];
+                    for (int c = 0; c < 3; ++c)
+                        n[c] = out[c] / 127.5f - 1.0f;
+                    float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                    if (length > 0.0f) {
+                        for (int c = 0; c < 3; ++c)
+                            out[c] = (unsigned char) std::clamp((int) std::lround((n[c] / length + 1.0f) * 127.5f), 0, 255);
+                    }
+                }
+            }
+        }
+    }
+
+    void appendKeyValue(std::vector<unsigned char> &out, const std::string &key, const std::string &value) {
+        uint32_t size = key.size() + 1 + value.size() + 1;
+        const unsigned char *sizeBytes = reinterpret_cast<const unsigned char *>(&size);
+        out.insert(out.end(), sizeBytes, sizeBytes + 4);
+        out.insert(out.end(), key.begin(), key.end());
+        out.push_back(0);
+        out.insert(out.end(), value.begin(), value.end());
+        out.push_back(0);
+        out.resize((out.size() + 3) & ~size_t(3), 0);
+    }
+}
+
+size_t blockBytes(BlockFormat format) {
+    return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+uint32_t glInternalFormat(BlockFormat format) {
+    switch (format) {
+        case BlockFormat::BC3: return GlCompressedRgbaS3tcDxt5;
+        case BlockFormat::BC4: return GlCompressedRedRgtc1;
+        case BlockFormat::BC5: return GlCompressedRgRgtc2;
+        default: return GlCompressedRgbS3tcDxt1;
+    }
+}
+
+const char *blockFormatName(BlockFormat format) {
+    switch (format) {
+        case BlockFormat::BC3: return "BC3";
+        case BlockFormat::BC4: return "BC4";
+        case BlockFormat::BC5: return "BC5";
+        default: return "BC1";
+    }
+}
+
+size_t CompressedImage::byteSize() const {
+    size_t size = 0;
+    for (const std::vector<unsigned char> &level : levels)
+        size += level.size();
+    return size;
+}
+
+bool chooseBlockFormat(const unsigned char *pixels, int width, int height, int components, TextureUsage usage,
+                       BlockFormat &format) {
+    if (components == 1) {
+        format = BlockFormat::BC4;
+        return true;
+    }
+    if (components != 3 && components != 4)
+        return false;
+    if (usage == TextureUsage::NormalMap) {
+        format = BlockFormat::BC5;
+        return true;
+    }
+    format = BlockFormat::BC1;
+    if (components == 4) {
+        size_t texels = (size_t) width * height;
+        for (size_t i = 0; i < texels; ++i) {
+            if (pixels[i * 4 + 3] != 255) {
+                format = BlockFormat::BC3;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+void compressImage(const unsigned char *pixels, int width, int height, int components, BlockFormat format,
+                   bool mipmaps, CompressedImage &image) {
+    image.format = format;
+    image.width = width;
+    image.height = height;
+    image.levels.clear();
+
+    bool normalMap = format == BlockFormat::BC5 && components >= 3;
+    uint32_t levelWidth = width;
+    uint32_t levelHeight = height;
+    std::vector<unsigned char> current;
+    std::vector<unsigned char> next;
+    const unsigned char *levelPixels = pixels;
+    for (;;) {
+        image.levels.emplace_back();
+        encodeLevel(levelPixels, levelWidth, levelHeight, components, format, image.levels.back());
+        if (!mipmaps || (levelWidth == 1 && levelHeight == 1))
+            break;
+        if (levelPixels == pixels)
+            current.assign(pixels, pixels + (size_t) levelWidth * levelHeight * components);
+        uint32_t nextWidth, nextHeight;
+        downsample(current, levelWidth, levelHeight, components, normalMap, next, nextWidth, nextHeight);
+        std::swap(current, next);
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+        levelPixels = current.data();
+    }
+}
+
+void encodeBC1Block(const unsigned char rgba[64], unsigned char out[8]) {
+    // principal axis of the colors through their mean, the endpoints are the extremes along it
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            mean[c] += rgba[i * 4 + c] / 16.0f;
+    float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 16; ++i) {
+        float r = rgba[i * 4 + 0] - mean[0];
+        float g = rgba[i * 4 + 1] - mean[1];
+        float b = rgba[i * 4 + 2] - mean[2];
+        cov[0] += r * r;
+        cov[1] += r * g;
+        cov[2] += r * b;
+        cov[3] += g * g;
+        cov[4] += g * b;
+        cov[5] += b * b;
+    }
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float length = std::max(std::abs(x), std::max(std::abs(y), std::abs(z)));
+        if (length <= 0.0f)
+            break;
+        axis[0] = x / length;
+        axis[1] = y / length;
+        axis[2] = z / length;
+    }
+    float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    for (float &a : axis)
+        a /= axisLength;
+
+    float minProjection = 0.0f;
+    float maxProjection = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float projection = (rgba[i * 4 + 0] - mean[0]) * axis[0] + (rgba[i * 4 + 1] - mean[1]) * axis[1]
+                           + (rgba[i * 4 + 2] - mean[2]) * axis[2];
+        minProjection = std::min(minProjection, projection);
+        maxProjection = std::max(maxProjection, projection);
+    }
+    // inset the endpoints a little, the extremes are rarely hit exactly by the palette anyway
+    float inset = (maxProjection - minProjection) / 16.0f;
+    minProjection += inset;
+    maxProjection -= inset;
+    float high[3], low[3];
+    for (int c = 0; c < 3; ++c) {
+        high[c] = mean[c] + axis[c] * maxProjection;
+        low[c] = mean[c] + axis[c] * minProjection;
+    }
+    uint16_t color0 = packRgb565(high);
+    uint16_t color1 = packRgb565(low);
+    orderEndpoints(color0, color1);
+    uint32_t indices;
+    int error = bc1Indices(rgba, color0, color1, indices);
+
+    // one least squares refit of the endpoints to the chosen indices
+    if (color0 != color1) {
+        const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+        float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+        float ax[3] = {0.0f, 0.0f, 0.0f};
+        float bx[3] = {0.0f, 0.0f, 0.0f};
+        for (int i = 0; i < 16; ++i) {
+            float a = weights[(indices >> (2 * i)) & 3];
+            float b = 1.0f - a;
+            aa += a * a;
+            bb += b * b;
+            ab += a * b;
+            for (int c = 0; c < 3; ++c) {
+                ax[c] += a * rgba[i * 4 + c];
+                bx[c] += b * rgba[i * 4 + c];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::abs(determinant) > 1e-6f) {
+            float refitHigh[3], refitLow[3];
+            for (int c = 0; c < 3; ++c) {
+                refitHigh[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+                refitLow[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+            }
+            uint16_t refit0 = packRgb565(refitHigh);
+            uint16_t refit1 = packRgb565(refitLow);
+            orderEndpoints(refit0, refit1);
+            uint32_t refitIndices;
+            int refitError = bc1Indices(rgba, refit0, refit1, refitIndices);
+            if (refitError < error) {
+                color0 = refit0;
+                color1 = refit1;
+                indices = refitIndices;
+            }
+        }
+    } else {
+        indices = 0;
+    }
+    writeBC1(out, color0, color1, indices);
+}
+
+void encodeBC4Block(const unsigned char values[16], unsigned char out[8]) {
+    unsigned char minValue = 255;
+    unsigned char maxValue = 0;
+    for (int i = 0; i < 16; ++i) {
+        minValue = std::min(minValue, values[i]);
+        maxValue = std::max(maxValue, values[i]);
+    }
+    out[0] = maxValue;
+    out[1] = minValue;
+    uint64_t indices = 0;
+    if (maxValue != minValue) {
+        // endpoint0 > endpoint1 selects the mode with 6 interpolated values
+        int palette[8];
+        palette[0] = maxValue;
+        palette[1] = minValue;
+        for (int i = 1; i < 7; ++i)
+            palette[i + 1] = ((7 - i) * maxValue + i * minValue + 3) / 7;
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            int bestError = 256;
+            for (int p = 0; p < 8; ++p) {
+                int error = std::abs(values[i] - palette[p]);
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t) best << (3 * i);
+        }
+    }
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = (unsigned char) (indices >> (8 * i));
+}
+
+std::string ktxPathFor(const std::string &sourcePath) {
+    return sourcePath + ".ktx";
+}
+
+bool writeKtx(const std::string &path, const CompressedImage &image, uint64_t sourceHash) {
+    KtxHeader header{};
+    std::memcpy(header.identifier, KtxIdentifier, sizeof(KtxIdentifier));
+    header.endianness = KtxEndianness;
+    header.glTypeSize = 1;
+    header.glInternalFormat = glInternalFormat(image.format);
+    header.glBaseInternalFormat = glBaseInternalFormat(image.format);
+    header.pixelWidth = image.width;
+    header.pixelHeight = image.height;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = image.levels.size();
+
+    std::vector<unsigned char> keyValues;
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long) sourceHash);
+    appendKeyValue(keyValues, SourceHashKey, hash);
+    appendKeyValue(keyValues, EncoderVersionKey, EncoderVersion);
+    header.bytesOfKeyValueData = keyValues.size();
+
+    // write next to the destination and rename, like the mesh cache
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cout << "ERROR::TEXTURE_CACHE::FAILED_TO_WRITE " << tmpPath << std::endl;
+            return false;
+        }
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(keyValues.data()), keyValues.size());
+        for (const std::vector<unsigned char> &level : image.levels) {
+            // block sizes are multiples of 4, so the levels never need padding
+            uint32_t imageSize = level.size();
+            file.write(reinterpret_cast<const char *>(&imageSize), sizeof(imageSize));
+            file.write(reinterpret_cast<const char *>(level.data()), level.size());
+        }
+        if (!file) {
+            std::cout << "ERROR::TEXTURE_CACHE::FAILED_TO_WRITE " << tmpPath << std::endl;
+            return false;
+        }
+    }
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool readKtx(const std::string &path, uint64_t sourceHash, CompressedImage &image) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+        return false;
+    std::vector<unsigned char> bytes((size_t) in.tellg());
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char *>(bytes.data()), bytes.size()) || bytes.size() < sizeof(KtxHeader))
+        return false;
+    KtxHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (std::memcmp(header.identifier, KtxIdentifier, sizeof(KtxIdentifier)) != 0 || header.endianness != KtxEndianness
+        || header.glType != 0 || header.pixelDepth != 0 || header.numberOfArrayElements != 0 || header.numberOfFaces != 1
+        || header.pixelWidth == 0 || header.pixelHeight == 0 || header.numberOfMipmapLevels == 0) {
+        return false;
+    }
+    bool knownFormat = false;
+    for (BlockFormat format : {BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC4, BlockFormat::BC5}) {
+        if (glInternalFormat(format) == header.glInternalFormat) {
+            image.format = format;
+            knownFormat = true;
+        }
+    }
+    if (!knownFormat)
+        return false;
+
+    // the key/value data has to name the same source contents and encoder version
+    size_t offset = sizeof(KtxHeader);
+    size_t keyValueEnd = offset + header.bytesOfKeyValueData;
+    if (keyValueEnd > bytes.size())
+        return false;
+    char expectedHash[17];
+    std::snprintf(expectedHash, sizeof(expectedHash), "%016llx", (unsigned long long) sourceHash);
+    bool hashMatches = false;
+    bool versionMatches = false;
+    while (offset + 4 <= keyValueEnd) {
+        uint32_t size;
+        std::memcpy(&size, bytes.data() + offset, 4);
+        offset += 4;
+        if (offset + size > keyValueEnd)
+            return false;
+        const char *pair = reinterpret_cast<const char *>(bytes.data() + offset);
+        std::string key(pair, strnlen(pair, size));
+        std::string value;
+        if (key.size() + 1 < size)
+            value.assign(pair + key.size() + 1, strnlen(pair + key.size() + 1, size - key.size() - 1));
+        hashMatches = hashMatches || (key == SourceHashKey && value == expectedHash);
+        versionMatches = versionMatches || (key == EncoderVersionKey && value == EncoderVersion);
+        offset += (size + 3) & ~uint32_t(3);
+    }
+    if (!hashMatches || !versionMatches)
+        return false;
+
+    image.width = header.pixelWidth;
+    image.height = header.pixelHeight;
+    image.levels.assign(header.numberOfMipmapLevels, {});
+    offset = keyValueEnd;
+    uint32_t levelWidth = image.width;
+    uint32_t levelHeight = image.height;
+    for (std::vector<unsigned char> &level : image.levels) {
+        uint32_t imageSize;
+        if (offset + 4 > bytes.size())
+            return false;
+        std::memcpy(&imageSize, bytes.data() + offset, 4);
+        offset += 4;
+        if (imageSize != levelBytes(image.format, levelWidth, levelHeight) || offset + imageSize > bytes.size())
+            return false;
+        level.assign(bytes.begin() + offset, bytes.begin() + offset + imageSize);
+        offset += (imageSize + 3) & ~uint32_t(3);
+        levelWidth = std::max(1u, levelWidth / 2);
+        levelHeight = std::max(1u, levelHeight / 2);
+    }
+    return true;
+}
+
+};
@@ -0,0 +1,368 @@
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include "rg/texture_loader.h"
+#include "rg/gl_state.h"
+#include "rg/mesh_cache.h"
+#include "rg/service_locator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <utility>
+
+namespace rg {
+
+namespace {
+    double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    GLenum formatFor(int components) {
+        if (components == 1)
+            return GL_RED;
+        else if (components == 4)
+            return GL_RGBA;
+        return GL_RGB;
+    }
+
+    const char *uncompressedFormatName(int components) {
+        if (components == 1)
+            return "R8";
+        else if (components == 4)
+            return "RGBA8";
+        return "RGB8";
+    }
+
+    std::atomic<bool> compressionEnabled{false};
+    // bumped whenever the way images are cooked changes, so files cooked the old way are redone
+    const uint64_t CookVersion = 2;
+
+    bool sameFormat(const DecodedImage &a, const DecodedImage &b) {
+        if (a.compressed.levels.empty() != b.compressed.levels.empty())
+            return false;
+        return a.compressed.levels.empty() ? a.components == b.components : a.compressed.format == b.compressed.format;
+    }
+
+    // All faces of a cubemap need the same internal format, but each face picked its own: one face with
+    // alpha is BC3 next to BC1 faces. Faces that disagree are encoded again in the widest format any face
+    // needs (BC3 over BC1), and if some face can not take that, the whole cube is uploaded as RGBA8.
+    // Faces that failed to load are left alone, they stay empty.
+    void unifyCubemapFaces(const std::vector<EncodedImage> &encoded, std::vector<DecodedImage> &faces) {
+        const DecodedImage *first = nullptr;
+        bool agree = true;
+        bool blockCompressed = true;
+        for (const DecodedImage &face : faces) {
+            if (face.empty())
+                continue;
+            if (!first)
+                first = &face;
+            agree = agree && sameFormat(face, *first);
+            BlockFormat format = face.compressed.format;
+            blockCompressed = blockCompressed && !face.compressed.levels.empty()
+                              && (format == BlockFormat::BC1 || format == BlockFormat::BC3);
+        }
+        if (agree)
+            return;
+
+        for (size_t i = 0; i < faces.size(); ++i) {
+            DecodedImage &face = faces[i];
+            if (face.empty() || (blockCompressed && face.compressed.format == BlockFormat::BC3))
+                continue;
+            DecodedImage redone;
+            int desiredComponents = blockCompressed ? 0 : 4;
+            redone.pixels = stbi_load_from_memory(encoded[i].bytes.data(), encoded[i].bytes.size(), &redone.width,
+                                                  &redone.height, &redone.components, desiredComponents);
+            if (!redone.pixels) {
+                face = DecodedImage();
+                continue;
+            }
+            if (desiredComponents)
+                redone.components = desiredComponents;
+            if (blockCompressed) {
+                // all BC1 or BC3 but not all the same, so this one is BC1 and has to become BC3
+                compressImage(redone.pixels, redone.width, redone.height, redone.components, BlockFormat::BC3,
+                              false, redone.compressed);
+                // cooked the way the cube needs it, the next load reads the matching format right away
+                writeKtx(ktxPathFor(encoded[i].path), redone.compressed, cookHashFor(encoded[i].contentHash, TextureUsage::CubeFace));
+                stbi_image_free(redone.pixels);
+                redone.pixels = nullptr;
+            }
+            face = std::move(redone);
+        }
+    }
+
+    void uploadCompressedLevels(GLenum target, const CompressedImage &image, size_t levelCount) {
+        uint32_t width = image.width;
+        uint32_t height = image.height;
+        for (size_t level = 0; level < levelCount; ++level) {
+            glCompressedTexImage2D(target, level, glInternalFormat(image.format), width, height, 0,
+                                   image.levels[level].size(), image.levels[level].data());
+            width = std::max(1u, width / 2);
+            height = std::max(1u, height / 2);
+        }
+    }
+}
+
+bool detectTextureCompressionSupport() {
+    // BC4/BC5 (RGTC) are core since 3.0, BC1/BC3 need S3TC
+    GLint extensionCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    bool s3tc = false;
+    for (GLint i = 0; i < extensionCount && !s3tc; ++i) {
+        const char *extension = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+        s3tc = extension && std::strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0;
+    }
+    setTextureCompressionEnabled(s3tc);
+    if (!s3tc)
+        std::cout << "TEXTURE::COMPRESSION disabled, GL_EXT_texture_compression_s3tc is not supported" << std::endl;
+    return s3tc;
+}
+
+void setTextureCompressionEnabled(bool enabled) {
+    compressionEnabled = enabled;
+}
+
+bool textureCompressionEnabled() {
+    return compressionEnabled;
+}
+
+size_t DecodedImage::byteSize() const {
+    if (!compressed.levels.empty())
+        return compressed.byteSize();
+    return (size_t) width * height * components;
+}
+
+DecodedImage::~DecodedImage() {
+    if (pixels)
+        stbi_image_free(pixels);
+}
+
+DecodedImage::DecodedImage(DecodedImage &&other) noexcept {
+    *this = std::move(other);
+}
+
+DecodedImage &DecodedImage::operator=(DecodedImage &&other) noexcept {
+    if (this != &other) {
+        if (pixels)
+            stbi_image_free(pixels);
+        pixels = std::exchange(other.pixels, nullptr);
+        compressed = std::move(other.compressed);
+        width = other.width;
+        height = other.height;
+        components = other.components;
+    }
+    return *this;
+}
+
+uint64_t cookHashFor(uint64_t contentHash, TextureUsage usage) {
+    // the usage picks the format, a file cooked for a different usage (or by an older format choice) is stale
+    uint64_t hash = hashBytes(&usage, sizeof(usage), contentHash);
+    return hashBytes(&CookVersion, sizeof(CookVersion), hash);
+}
+
+bool readEncodedImage(const std::string &path, EncodedImage &image) {
+    auto start = std::chrono::steady_clock::now();
+    image.path = path;
+    std::ifstream in(path, std::ios::binary);
+    image.bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    image.ok = !image.bytes.empty();
+    image.contentHash = hashBytes(image.bytes.data(), image.bytes.size());
+    image.readMs = millisecondsSince(start);
+    return image.ok;
+}
+
+bool decodeImage(const EncodedImage &encoded, DecodedImage &image, TextureUsage usage, bool *cooked) {
+    image = DecodedImage();
+    if (cooked)
+        *cooked = false;
+    if (!encoded.ok)
+        return false;
+    bool compress = textureCompressionEnabled();
+    std::string ktxPath = ktxPathFor(encoded.path);
+    if (compress && readKtx(ktxPath, cookHashFor(encoded.contentHash, usage), image.compressed)) {
+        image.width = image.compressed.width;
+        image.height = image.compressed.height;
+        if (cooked)
+            *cooked = true;
+        return true;
+    }
+
+    image.pixels = stbi_load_from_memory(encoded.bytes.data(), encoded.bytes.size(),
+                                         &image.width, &image.height, &image.components, 0);
+    if (!image.pixels)
+        return false;
+
+    BlockFormat format;
+    if (compress && chooseBlockFormat(image.pixels, image.width, image.height, image.components, usage, format)) {
+        compressImage(image.pixels, image.width, image.height, image.components, format,
+                      usage != TextureUsage::CubeFace, image.compressed);
+        writeKtx(ktxPath, image.compressed, cookHashFor(encoded.contentHash, usage));
+        stbi_image_free(image.pixels);
+        image.pixels = nullptr;
+    }
+    return true;
+}
+
+unsigned int uploadTexture(const DecodedImage &image) {
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    if (image.empty())
+        return textureID;
+
+    GLState::Get().bindTexture(GL_TEXTURE_2D, textureID);
+    if (!image.compressed.levels.empty()) {
+        uploadCompressedLevels(GL_TEXTURE_2D, image.compressed, image.compressed.levels.size());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.compressed.levels.size() - 1);
+    } else {
+        GLenum format = formatFor(image.components);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return textureID;
+}
+
+unsigned int uploadCubemap(const std::vector<DecodedImage> &faces) {
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    GLState::Get().bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    const DecodedImage *first = nullptr;
+    for (const DecodedImage &face : faces) {
+        if (!first && !face.empty())
+            first = &face;
+    }
+    for (unsigned int i = 0; i < faces.size(); i++) {
+        if (!faces[i].empty() && !sameFormat(faces[i], *first)) {
+            // a cube with mixed formats is incomplete, better none than a broken one
+            std::cout << "ERROR::TEXTURE::CUBEMAP_FACES_HAVE_DIFFERENT_FORMATS" << std::endl;
+            break;
+        }
+        if (!faces[i].compressed.levels.empty()) {
+            uploadCompressedLevels(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, faces[i].compressed, 1);
+            continue;
+        }
+        if (!faces[i].pixels)
+            continue;
+        GLenum format = formatFor(faces[i].components);
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, faces[i].width, faces[i].height, 0, format,
+                     GL_UNSIGNED_BYTE, faces[i].pixels);
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    return textureID;
+}
+
+std::vector<unsigned int> TextureLoader::load(const std::vector<std::string> &paths,
+                                              const std::vector<TextureUsage> &usages) {
+    return upload2D(read(paths), usages);
+}
+
+std::vector<EncodedImage> TextureLoader::read(const std::vector<std::string> &paths) {
+    std::vector<EncodedImage> images(paths.size());
+    ServiceLocator::Get().getJobSystem().parallelFor(paths.size(), [&](size_t i) {
+        readEncodedImage(paths[i], images[i]);
+    });
+    return images;
+}
+
+std::vector<DecodedImage> TextureLoader::decode(const std::vector<EncodedImage> &images,
+                                                const std::vector<TextureUsage> &usages) {
+    size_t firstTiming = m_timings.size();
+    m_timings.resize(firstTiming + images.size());
+    std::vector<DecodedImage> decoded(images.size());
+    ServiceLocator::Get().getJobSystem().parallelFor(images.size(), [&](size_t i) {
+        auto start = std::chrono::steady_clock::now();
+        TextureLoadTiming &timing = m_timings[firstTiming + i];
+        timing.path = images[i].path;
+        timing.readMs = images[i].readMs;
+        TextureUsage usage = i < usages.size() ? usages[i] : TextureUsage::Color;
+        timing.failed = !decodeImage(images[i], decoded[i], usage, &timing.cooked);
+        timing.width = decoded[i].width;
+        timing.height = decoded[i].height;
+        timing.format = decoded[i].compressed.levels.empty() ? uncompressedFormatName(decoded[i].components)
+                                                             : blockFormatName(decoded[i].compressed.format);
+        // generated mips add a third on top of the base level
+        timing.gpuBytes = decoded[i].compressed.levels.empty() ? decoded[i].byteSize() * 4 / 3 : decoded[i].byteSize();
+        timing.decodeMs = millisecondsSince(start);
+    });
+    return decoded;
+}
+
+std::vector<unsigned int> TextureLoader::upload2D(const std::vector<EncodedImage> &images,
+                                                 const std::vector<TextureUsage> &usages) {
+    size_t firstTiming = m_timings.size();
+    std::vector<DecodedImage> decoded = decode(images, usages);
+
+    std::vector<unsigned int> ids(images.size());
+    for (size_t i = 0; i < images.size(); ++i) {
+        TextureLoadTiming &timing = m_timings[firstTiming + i];
+        if (timing.failed)
+            std::cout << "Texture failed to load at path: " << images[i].path << std::endl;
+        auto start = std::chrono::steady_clock::now();
+        ids[i] = uploadTexture(decoded[i]);
+        timing.uploadMs = millisecondsSince(start);
+        // free the pixels as soon as they are on the GPU, not at the end of the batch
+        decoded[i] = DecodedImage();
+    }
+    return ids;
+}
+
+unsigned int TextureLoader::uploadCubemap(const std::vector<EncodedImage> &faces) {
+    size_t firstTiming = m_timings.size();
+    std::vector<DecodedImage> decoded = decode(faces, std::vector<TextureUsage>(faces.size(), TextureUsage::CubeFace));
+    unifyCubemapFaces(faces, decoded);
+    for (size_t i = 0; i < faces.size(); ++i) {
+        TextureLoadTiming &timing = m_timings[firstTiming + i];
+        if (timing.failed)
+            std::cout << "Cubemap texture failed to load at path: " << faces[i].path << std::endl;
+        // the faces have no mips and may have been encoded again to match the others
+        timing.format = decoded[i].compressed.levels.empty() ? uncompressedFormatName(decoded[i].components)
+                                                             : blockFormatName(decoded[i].compressed.format);
+        timing.gpuBytes = decoded[i].byteSize();
+    }
+    auto start = std::chrono::steady_clock::now();
+    unsigned int id = rg::uploadCubemap(decoded);
+    // a single upload for all faces, spread evenly so the per-face numbers still add up
+    double perFace = millisecondsSince(start) / (faces.empty() ? 1 : faces.size());
+    for (size_t i = 0; i < faces.size(); ++i)
+        m_timings[firstTiming + i].uploadMs = perFace;
+    return id;
+}
+
+void TextureLoader::printTimings(std::ostream &out) const {
+    double readTotal = 0.0;
+    double decodeTotal = 0.0;
+    double uploadTotal = 0.0;
+    size_t gpuBytesTotal = 0;
+    for (const TextureLoadTiming &timing : m_timings) {
+        out << "TEXTURE::LOAD " << timing.path << " (" << timing.width << "x" << timing.height << " "
+            << timing.format << (timing.cooked ? ", cooked" : "") << ")"
+            << std::fixed << std::setprecision(2)
+            << " read " << timing.readMs << " ms, decode " << timing.decodeMs
+            << " ms, upload " << timing.uploadMs << " ms, " << timing.gpuBytes / 1024 << " KB"
+            << (timing.failed ? " [FAILED]" : "") << '\n';
+        readTotal += timing.readMs;
+        decodeTotal += timing.decodeMs;
+        uploadTotal += timing.uploadMs;
+        gpuBytesTotal += timing.gpuBytes;
+    }
+    out << "TEXTURE::LOAD " << m_timings.size() << " textures on " << ServiceLocator::Get().getJobSystem().threadCount()
+        << " threads, read " << readTotal << " ms, decode " << decodeTotal << " ms (summed), upload "
+        << uploadTotal << " ms, " << gpuBytesTotal / 1024 << " KB" << std::defaultfloat << std::endl;
+}
+
+};
@@ -0,0 +1,269 @@
+#include <glad/glad.h>
+
+#include "rg/texture_registry.h"
+#include "rg/gl_state.h"
+#include "rg/texture_loader.h"
+#include "rg/mesh_cache.h"
+
+#include <filesystem>
+#include <iostream>
+
+namespace rg {
+
+namespace {
+    std::string canonicalPath(const std::string &path) {
+        std::error_code error;
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+        return error ? path : canonical.string();
+    }
+
+    // the usage decides how a texture is compressed, the same file used differently is a different texture
+    std::string pathKey(const std::string &canonicalPath, TextureUsage usage) {
+        return canonicalPath + '#' + std::to_string((uint32_t) usage);
+    }
+}
+
+TextureHandle::TextureHandle(uint32_t slot) : m_slot(slot) {
+    TextureRegistry::Get().addRef(m_slot);
+}
+
+TextureHandle::~TextureHandle() {
+    if (valid())
+        TextureRegistry::Get().release(m_slot);
+}
+
+TextureHandle::TextureHandle(const TextureHandle &other) : m_slot(other.m_slot) {
+    if (valid())
+        TextureRegistry::Get().addRef(m_slot);
+}
+
+TextureHandle::TextureHandle(TextureHandle &&other) noexcept : m_slot(other.m_slot) {
+    other.m_slot = InvalidSlot;
+}
+
+TextureHandle &TextureHandle::operator=(const TextureHandle &other) {
+    if (this != &other) {
+        if (other.valid())
+            TextureRegistry::Get().addRef(other.m_slot);
+        if (valid())
+            TextureRegistry::Get().release(m_slot);
+        m_slot = other.m_slot;
+    }
+    return *this;
+}
+
+TextureHandle &TextureHandle::operator=(TextureHandle &&other) noexcept {
+    if (this != &other) {
+        if (valid())
+            TextureRegistry::Get().release(m_slot);
+        m_slot = other.m_slot;
+        other.m_slot = InvalidSlot;
+    }
+    return *this;
+}
+
+unsigned int TextureHandle::id() const {
+    return valid() ? TextureRegistry::Get().m_entries[m_slot].id : 0;
+}
+
+uint32_t TextureRegistry::createEntry(unsigned int id, uint64_t contentHash) {
+    uint32_t slot;
+    if (!m_freeSlots.empty()) {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    } else {
+        slot = m_entries.size();
+        m_entries.emplace_back();
+    }
+    Entry &entry = m_entries[slot];
+    entry = Entry{};
+    entry.id = id;
+    entry.contentHash = contentHash;
+    entry.alive = true;
+    return slot;
+}
+
+void TextureRegistry::addPath(uint32_t slot, const std::string &canonicalPath) {
+    m_byPath[canonicalPath] = slot;
+    m_entries[slot].paths.push_back(canonicalPath);
+}
+
+TextureHandle TextureRegistry::acquire(const std::string &path, TextureUsage usage) {
+    return acquire(std::vector<std::string>{path}, std::vector<TextureUsage>{usage}).front();
+}
+
+std::vector<TextureHandle> TextureRegistry::acquire(const std::vector<std::string> &paths,
+                                                    const std::vector<TextureUsage> &usages) {
+    std::vector<TextureHandle> handles(paths.size());
+
+    // 1. canonical path and usage lookup, collecting the distinct pairs we have never seen
+    std::vector<std::string> missPaths;
+    std::vector<std::string> missKeys;
+    std::vector<TextureUsage> missUsages;
+    std::vector<std::vector<size_t>> missUsers;
+    std::unordered_map<std::string, size_t> missIndex;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        std::string canonical = canonicalPath(paths[i]);
+        TextureUsage usage = i < usages.size() ? usages[i] : TextureUsage::Color;
+        std::string key = pathKey(canonical, usage);
+        auto it = m_byPath.find(key);
+        if (it != m_byPath.end()) {
+            ++m_hits;
+            handles[i] = TextureHandle(it->second);
+            continue;
+        }
+        auto inserted = missIndex.emplace(key, missPaths.size());
+        if (inserted.second) {
+            missPaths.push_back(canonical);
+            missKeys.push_back(key);
+            missUsages.push_back(usage);
+            missUsers.emplace_back();
+        }
+        missUsers[inserted.first->second].push_back(i);
+    }
+    if (missPaths.empty())
+        return handles;
+
+    // 2. read the files and look them up by content and usage, only new pairs get decoded
+    TextureLoader loader;
+    std::vector<EncodedImage> encoded = loader.read(missPaths);
+    std::vector<uint32_t> slots(missPaths.size(), TextureHandle::InvalidSlot);
+    std::vector<size_t> uploadIndex(missPaths.size());
+    std::vector<EncodedImage> uploads;
+    std::vector<TextureUsage> uploadUsages;
+    std::vector<uint64_t> uploadKeys;
+    std::unordered_map<uint64_t, size_t> batchContent;
+    for (size_t j = 0; j < encoded.size(); ++j) {
+        uint64_t contentKey = cookHashFor(encoded[j].contentHash, missUsages[j]);
+        if (encoded[j].ok) {
+            auto known = m_byContent.find(contentKey);
+            if (known != m_byContent.end()) {
+                ++m_hits;
+                slots[j] = known->second;
+                addPath(known->second, missKeys[j]);
+                continue;
+            }
+            auto inBatch = batchContent.find(contentKey);
+            if (inBatch != batchContent.end()) {
+                uploadIndex[j] = inBatch->second;
+                continue;
+            }
+            batchContent.emplace(contentKey, uploads.size());
+        }
+        uploadIndex[j] = uploads.size();
+        uploads.push_back(std::move(encoded[j]));
+        uploadUsages.push_back(missUsages[j]);
+        uploadKeys.push_back(contentKey);
+    }
+
+    // 3. decode in parallel and upload on this thread
+    std::vector<unsigned int> ids = loader.upload2D(uploads, uploadUsages);
+    std::vector<uint32_t> uploadSlots(uploads.size());
+    for (size_t k = 0; k < uploads.size(); ++k) {
+        ++m_misses;
+        uploadSlots[k] = createEntry(ids[k], uploadKeys[k]);
+        // failed loads are handed out but not cached, the next acquire tries again
+        if (uploads[k].ok)
+            m_byContent[uploadKeys[k]] = uploadSlots[k];
+    }
+    for (size_t j = 0; j < missPaths.size(); ++j) {
+        if (slots[j] != TextureHandle::InvalidSlot)
+            continue;
+        slots[j] = uploadSlots[uploadIndex[j]];
+        if (uploads[uploadIndex[j]].ok)
+            addPath(slots[j], missKeys[j]);
+    }
+    for (size_t j = 0; j < missPaths.size(); ++j) {
+        for (size_t i : missUsers[j])
+            handles[i] = TextureHandle(slots[j]);
+    }
+    if (!uploads.empty())
+        loader.printTimings(std::cout);
+    return handles;
+}
+
+TextureHandle TextureRegistry::acquireCubemap(const std::vector<std::string> &faces) {
+    std::string key = "cubemap:";
+    for (const std::string &face : faces) {
+        key += canonicalPath(face);
+        key += '|';
+    }
+    auto it = m_byPath.find(key);
+    if (it != m_byPath.end()) {
+        ++m_hits;
+        return TextureHandle(it->second);
+    }
+
+    TextureLoader loader;
+    std::vector<EncodedImage> encoded = loader.read(faces);
+    bool ok = true;
+    // the cubemap is identified by the contents of all faces, tagged so it never matches a 2D texture
+    uint64_t contentHash = hashBytes("cubemap", 7);
+    for (const EncodedImage &face : encoded) {
+        ok = ok && face.ok;
+        contentHash = hashBytes(&face.contentHash, sizeof(face.contentHash), contentHash);
+    }
+    if (ok) {
+        auto known = m_byContent.find(contentHash);
+        if (known != m_byContent.end()) {
+            ++m_hits;
+            addPath(known->second, key);
+            return TextureHandle(known->second);
+        }
+    }
+
+    ++m_misses;
+    uint32_t slot = createEntry(loader.uploadCubemap(encoded), contentHash);
+    if (ok) {
+        m_byContent[contentHash] = slot;
+        addPath(slot, key);
+    }
+    loader.printTimings(std::cout);
+    return TextureHandle(slot);
+}
+
+TextureHandle TextureRegistry::adopt(const EncodedImage &encoded, const DecodedImage &decoded, TextureUsage usage) {
+    std::string key = pathKey(canonicalPath(encoded.path), usage);
+    auto it = m_byPath.find(key);
+    if (it != m_byPath.end()) {
+        ++m_hits;
+        return TextureHandle(it->second);
+    }
+    uint64_t contentKey = cookHashFor(encoded.contentHash, usage);
+    if (encoded.ok) {
+        auto known = m_byContent.find(contentKey);
+        if (known != m_byContent.end()) {
+            ++m_hits;
+            addPath(known->second, key);
+            return TextureHandle(known->second);
+        }
+    }
+
+    ++m_misses;
+    if (decoded.empty())
+        std::cout << "Texture failed to load at path: " << encoded.path << std::endl;
+    uint32_t slot = createEntry(uploadTexture(decoded), contentKey);
+    if (encoded.ok && !decoded.empty()) {
+        m_byContent[contentKey] = slot;
+        addPath(slot, key);
+    }
+    return TextureHandle(slot);
+}
+
+void TextureRegistry::purgeUnused() {
+    for (uint32_t slot = 0; slot < m_entries.size(); ++slot) {
+        Entry &entry = m_entries[slot];
+        if (!entry.alive || entry.refCount > 0)
+            continue;
+        GLState::Get().deleteTexture(entry.id);
+        for (const std::string &path : entry.paths)
+            m_byPath.erase(path);
+        auto content = m_byContent.find(entry.contentHash);
+        if (content != m_byContent.end() && content->second == slot)
+            m_byContent.erase(content);
+        entry = Entry{};
+        m_freeSlots.push_back(slot);
+    }
+}
+
+};
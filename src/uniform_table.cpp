@@ -0,0 +1,58 @@
+#include <glad/glad.h>
+
+#include "rg/uniform_table.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace rg {
+
+void UniformTable::reflect(unsigned int program) {
+    m_entries.clear();
+    GLint uniformCount = 0;
+    GLint maxNameLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+    std::vector<char> nameBuffer(std::max(maxNameLength, 1));
+    for (GLint i = 0; i < uniformCount; ++i) {
+        GLsizei length = 0;
+        GLint arraySize = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, (GLuint) i, (GLsizei) nameBuffer.size(), &length, &arraySize, &type, nameBuffer.data());
+        std::string name(nameBuffer.data(), length);
+        GLint location = glGetUniformLocation(program, name.c_str());
+        if (location < 0)
+            continue; // uniforms inside uniform blocks have no location
+        add(name, location);
+
+        // arrays are reported once as "name[0]", their other elements are looked up here, at link time
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+            std::string arrayName = name.substr(0, name.size() - 3);
+            add(arrayName, location);
+            for (GLint element = 1; element < arraySize; ++element) {
+                std::string elementName = arrayName + "[" + std::to_string(element) + "]";
+                add(elementName, glGetUniformLocation(program, elementName.c_str()));
+            }
+        }
+    }
+}
+
+void UniformTable::add(std::string_view name, int location) {
+    uint64_t hash = hashUniformName(name);
+    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), hash,
+                               [](const Entry &entry, uint64_t value) { return entry.hash < value; });
+    if (it != m_entries.end() && it->hash == hash) {
+        if (it->location != location)
+            std::cout << "ERROR::UNIFORM_TABLE::HASH_COLLISION " << name << std::endl;
+        return;
+    }
+    m_entries.insert(it, Entry{hash, location});
+}
+
+int UniformTable::find(uint64_t hash) const {
+    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), hash,
+                               [](const Entry &entry, uint64_t value) { return entry.hash < value; });
+    return it != m_entries.end() && it->hash == hash ? it->location : -1;
+}
+
+};
@@ -0,0 +1,62 @@
+#include "rg/vertex_packing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace rg {
+
+namespace {
+    uint32_t packSnorm(float value, int bits) {
+        const float maxValue = (float) ((1 << (bits - 1)) - 1);
+        int32_t quantized = (int32_t) std::lround(std::clamp(value, -1.0f, 1.0f) * maxValue);
+        return (uint32_t) quantized & ((1u << bits) - 1);
+    }
+}
+
+uint32_t packSnorm1010102(float x, float y, float z, float w) {
+    return packSnorm(x, 10) | packSnorm(y, 10) << 10 | packSnorm(z, 10) << 20 | packSnorm(w, 2) << 30;
+}
+
+uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7fffffff;
+
+    if (magnitude >= 0x7f800000) {
+        // inf stays inf, nan stays a (quiet) nan
+        return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+    }
+    if (magnitude >= 0x477ff000) {
+        // rounds to a value past the largest half
+        return sign | 0x7c00;
+    }
+    if (magnitude < 0x38800000) {
+        // subnormal half (or zero): shift the mantissa with the implicit bit into place and round
+        if (magnitude < 0x33000000)
+            return sign;
+        uint32_t exponent = magnitude >> 23;
+        uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1)))
+            ++half;
+        return sign | half;
+    }
+    // normal half: rebias the exponent and round the mantissa to 10 bits, the carry may bump the exponent
+    uint32_t rebased = magnitude - 0x38000000;
+    uint32_t half = rebased >> 13;
+    uint32_t remainder = rebased & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+        ++half;
+    return sign | half;
+}
+
+uint16_t quantizeUnorm16(float value) {
+    return (uint16_t) std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f);
+}
+
+};